@@ -0,0 +1,72 @@
+/***************************************************************
+ * Name:      BoundedQueue.h
+ * Purpose:   Blocking bounded FIFO between pipeline stages
+ * Author:    segment-cpp contributors
+ * Created:   18.10.2026
+ * Copyright: segment-cpp contributors
+ * License:
+ **************************************************************/
+
+#ifndef BOUNDEDQUEUE_H_INCLUDED
+#define BOUNDEDQUEUE_H_INCLUDED
+
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <mutex>
+
+/**
+ * Multi-producer, multi-consumer queue holding at most `capacity` items:
+ * push blocks while full, pop blocks while empty. The queue closes when all
+ * `producers` called producerDone(); pop then returns false once it is empty.
+ */
+template< typename T >
+class BoundedQueue
+{
+public:
+
+    BoundedQueue( size_t capacity, int producers = 1 )
+        : capacity( capacity ? capacity : 1 ), producers( producers ) {}
+
+    void push( const T& item )
+    {
+        std::unique_lock<std::mutex> lock( mutex );
+        notFull.wait( lock, [this]{ return items.size() < capacity; } );
+        items.push_back( item );
+        notEmpty.notify_one();
+    }
+
+    /// false if the queue is closed and empty
+    bool pop( T& item )
+    {
+        std::unique_lock<std::mutex> lock( mutex );
+        notEmpty.wait( lock, [this]{ return !items.empty() || producers <= 0; } );
+        if( items.empty() )
+            return false;
+
+        item = items.front();
+        items.pop_front();
+        notFull.notify_one();
+        return true;
+    }
+
+    /// a producer is finished, the last one closes the queue
+    void producerDone()
+    {
+        std::lock_guard<std::mutex> lock( mutex );
+        if( --producers <= 0 )
+            notEmpty.notify_all();
+    }
+
+private:
+
+    size_t capacity;
+    int producers;
+    std::deque<T> items;
+
+    std::mutex mutex;
+    std::condition_variable notFull;
+    std::condition_variable notEmpty;
+};
+
+#endif
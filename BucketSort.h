@@ -0,0 +1,54 @@
+/***************************************************************
+ * Name:      BucketSort.h
+ * Purpose:   In-place linear time sort of items with small integer keys
+ * Author:    segment-cpp contributors
+ * Created:   18.10.2026
+ * Copyright: segment-cpp contributors
+ * License:
+ **************************************************************/
+
+#ifndef BUCKETSORT_H_INCLUDED
+#define BUCKETSORT_H_INCLUDED
+
+#include <vector>
+
+/**
+ * Sort items[0..n-1] by key(item) in [0, numBuckets), counting sort with
+ * in-place permutation (no second buffer); not stable.
+ * On return, bucket b is items[ start[b] .. start[b+1]-1 ].
+ */
+template< typename T, typename Key >
+void bucketSort( T* items, int n, int numBuckets, std::vector<int>& start, Key key )
+{
+    start.assign( numBuckets + 1, 0 );
+
+    int i, b;
+    for ( i = 0; i < n; i++ )
+        start[ key( items[i] ) + 1 ]++;
+
+    for ( b = 0; b < numBuckets; b++ )
+        start[b + 1] += start[b];
+
+    // next free position in each bucket
+    std::vector<int> next( start.begin(), start.end() - 1 );
+
+    for ( b = 0; b < numBuckets; b++ )
+    {
+        while ( next[b] < start[b + 1] )
+        {
+            // move the item to its bucket, continue with the one it replaces
+            T item = items[ next[b] ];
+            int k = key( item );
+            while ( k != b )
+            {
+                T tmp = items[ next[k] ];
+                items[ next[k]++ ] = item;
+                item = tmp;
+                k = key( item );
+            }
+            items[ next[b]++ ] = item;
+        }
+    }
+}
+
+#endif
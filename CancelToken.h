@@ -0,0 +1,55 @@
+/***************************************************************
+ * Name:      CancelToken.h
+ * Purpose:   Cooperative cancellation and deadlines for segmentations
+ * Author:    segment-cpp contributors
+ * Created:   18.10.2026
+ * Copyright: segment-cpp contributors
+ * License:
+ **************************************************************/
+
+#ifndef CANCELTOKEN_H_INCLUDED
+#define CANCELTOKEN_H_INCLUDED
+
+#include <atomic>
+#include <chrono>
+
+/// the merge loops check the token every CANCEL_CHECK_EDGES edges
+#define CANCEL_CHECK_EDGES 4096
+
+/**
+ * Stop request for a running segmentation: cancel() from any thread, or a
+ * deadline set before the segmentation starts. The segmenters check it between
+ * the phases and every CANCEL_CHECK_EDGES edges of the merge loops; a stopped
+ * segmentation keeps the merges done so far (merging in sorted order, so the
+ * result is a valid, finer segmentation) and skips the small region merging.
+ */
+class CancelToken
+{
+public:
+
+    typedef std::chrono::steady_clock Clock;
+
+    CancelToken() : cancelled(false), hasDeadline(false) {}
+
+    void cancel() { cancelled = true; }
+    bool isCancelled() const { return cancelled; }
+
+    /// stop at time t / after `seconds` from now
+    void setDeadline( Clock::time_point t ) { deadline = t; hasDeadline = true; }
+    void setTimeout( double seconds )
+    {
+        setDeadline( Clock::now() + std::chrono::duration_cast<Clock::duration>( std::chrono::duration<double>( seconds ) ) );
+    }
+    bool deadlinePassed() const { return hasDeadline && Clock::now() >= deadline; }
+
+    /// cancelled or past the deadline
+    bool stopRequested() const { return cancelled || deadlinePassed(); }
+
+private:
+
+    std::atomic<bool> cancelled;
+    bool hasDeadline;
+    Clock::time_point deadline;
+};
+
+#endif
@@ -0,0 +1,203 @@
+/***************************************************************
+ * Name:      Contours.cpp
+ * Purpose:   Region contours (polygons) of a label map, crack following
+ * Author:    segment-cpp contributors
+ * Created:   18.10.2026
+ * Copyright: segment-cpp contributors
+ * License:
+ **************************************************************/
+
+#include <cmath>
+#include <utility>
+
+#include "Contours.h"
+
+using namespace std;
+
+// Boundaries are walked on the pixel corners (cx, cy), 0 <= cx <= width,
+// 0 <= cy <= height, with the region on the right. Directions:
+enum { CRACK_E = 0, CRACK_S, CRACK_W, CRACK_N };
+
+static const int crackDx[4] = { 1, 0, -1, 0 };
+static const int crackDy[4] = { 0, 1, 0, -1 };
+
+// pixel on the right / left of the crack from corner (cx, cy) in direction d
+static const int rightDx[4] = { 0, -1, -1, 0 };
+static const int rightDy[4] = { 0, 0, -1, -1 };
+static const int leftDx[4]  = { 0, 0, -1, -1 };
+static const int leftDy[4]  = { -1, 0, 0, -1 };
+
+/// label of pixel (x,y), -2 outside the image
+static inline int labelAt( const int* labels, int width, int height, int x, int y )
+{
+    if( x < 0 || y < 0 || x >= width || y >= height )
+        return -2;
+    return labels[ y * width + x ];
+}
+
+/**
+ * trace the contour of region `label` starting with the top edge of pixel (x0,y0),
+ * marks the top edges passed in `top`
+ */
+static void traceContour( const int* labels, int width, int height, int connect,
+                          int x0, int y0, int label, vector<uchar>& top, RegionContour& contour )
+{
+    contour.label = label;
+    contour.points.clear();
+
+    // candidate turns: left, straight, right (8-connected) or right, straight, left (4-connected)
+    int turns[3];
+    if( connect == 8 )
+        turns[0] = 3, turns[1] = 0, turns[2] = 1;
+    else
+        turns[0] = 1, turns[1] = 0, turns[2] = 3;
+
+    int d = CRACK_E;
+    top[ y0 * width + x0 ] = 1;
+    int cx = x0 + 1;
+    int cy = y0;
+
+    long long area2 = 0;    // twice the signed area
+    while( true )
+    {
+        int nd = d;
+        for ( int k = 0; k < 3; k++ )
+        {
+            nd = ( d + turns[k] ) & 3;
+            if( labelAt( labels, width, height, cx + rightDx[nd], cy + rightDy[nd] ) == label &&
+                labelAt( labels, width, height, cx + leftDx[nd], cy + leftDy[nd] ) != label )
+                break;
+        }
+
+        bool done = ( cx == x0 && cy == y0 && nd == CRACK_E );
+        if( nd != d )
+        {
+            if( !contour.points.empty() )
+            {
+                const Point& p = contour.points.back();
+                area2 += (long long)p.x * cy - (long long)cx * p.y;
+            }
+            contour.points.push_back( Point( cx, cy ) );
+        }
+
+        if( done )
+            break;
+
+        if( nd == CRACK_E )
+            top[ cy * width + cx ] = 1;
+
+        d = nd;
+        cx += crackDx[d];
+        cy += crackDy[d];
+    }
+
+    // close the polygon
+    const Point& first = contour.points.front();
+    const Point& last = contour.points.back();
+    area2 += (long long)last.x * first.y - (long long)first.x * last.y;
+
+    contour.hole = ( area2 < 0 );
+}
+
+void traceContours( const int* labels, int width, int height, int connect,
+                    vector<RegionContour>& contours )
+{
+    contours.clear();
+
+    // top edges already on a contour
+    vector<uchar> top( width * height, 0 );
+
+    for ( int y = 0; y < height; y++ )
+    {
+        const int* row = labels + y * width;
+        for ( int x = 0; x < width; x++ )
+        {
+            int label = row[x];
+            if( label < 0 || top[ y * width + x ] )
+                continue;
+
+            if( y > 0 && row[x - width] == label )
+                continue;
+
+            contours.push_back( RegionContour() );
+            traceContour( labels, width, height, connect, x, y, label, top, contours.back() );
+        }
+    }
+}
+
+/// distance of p to the line through a and b
+static double lineDistance( const Point& p, const Point& a, const Point& b )
+{
+    double dx = b.x - a.x;
+    double dy = b.y - a.y;
+    double len = sqrt( dx * dx + dy * dy );
+    if( len == 0.0 )
+        return sqrt( (double)( p.x - a.x ) * ( p.x - a.x ) + (double)( p.y - a.y ) * ( p.y - a.y ) );
+
+    return fabs( dy * ( p.x - a.x ) - dx * ( p.y - a.y ) ) / len;
+}
+
+/**
+ * closed polygon: split at the point farthest from the first one, then
+ * Douglas-Peucker on both chains (explicit stack, long contours)
+ */
+void simplifyPolygon( const vector<Point>& points, double epsilon, vector<Point>& out )
+{
+    int n = (int)points.size();
+    if( n <= 3 || epsilon <= 0.0 )
+    {
+        out = points;
+        return;
+    }
+
+    int far = 0;
+    double farDist = -1.0;
+    for ( int i = 1; i < n; i++ )
+    {
+        double dx = points[i].x - points[0].x;
+        double dy = points[i].y - points[0].y;
+        if( dx * dx + dy * dy > farDist )
+        {
+            farDist = dx * dx + dy * dy;
+            far = i;
+        }
+    }
+
+    // chains [0, far] and [far, n] (index n is point 0 again)
+    vector<uchar> keep( n + 1, 0 );
+    keep[0] = keep[far] = keep[n] = 1;
+
+    vector< pair<int,int> > stack;
+    stack.push_back( make_pair( 0, far ) );
+    stack.push_back( make_pair( far, n ) );
+    while( !stack.empty() )
+    {
+        int a = stack.back().first;
+        int b = stack.back().second;
+        stack.pop_back();
+
+        int best = -1;
+        double bestDist = epsilon;
+        for ( int i = a + 1; i < b; i++ )
+        {
+            double dist = lineDistance( points[i], points[a], points[ b % n ] );
+            if( dist > bestDist )
+            {
+                bestDist = dist;
+                best = i;
+            }
+        }
+
+        if( best < 0 )
+            continue;
+
+        keep[best] = 1;
+        stack.push_back( make_pair( a, best ) );
+        stack.push_back( make_pair( best, b ) );
+    }
+
+    out.clear();
+    for ( int i = 0; i < n; i++ )
+        if( keep[i] )
+            out.push_back( points[i] );
+}
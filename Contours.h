@@ -0,0 +1,41 @@
+/***************************************************************
+ * Name:      Contours.h
+ * Purpose:   Region contours (polygons) of a label map, crack following
+ * Author:    segment-cpp contributors
+ * Created:   18.10.2026
+ * Copyright: segment-cpp contributors
+ * License:
+ **************************************************************/
+
+#ifndef CONTOURS_H_INCLUDED
+#define CONTOURS_H_INCLUDED
+
+#include <vector>
+
+#include "opencv2/core/core.hpp"
+
+using namespace cv;
+
+/// a closed region boundary: polygon on the pixel corners (pixel (x,y) covers
+/// [x,x+1] x [y,y+1]), the region is on the right going along the points
+/// (clockwise on screen for outer boundaries, counter-clockwise for holes)
+struct RegionContour
+{
+    int label;
+    bool hole;
+    std::vector<Point> points;
+};
+
+/// Trace the outer boundaries and the holes of all the regions of `labels`
+/// (width x height, row major, label < 0: inactive, no contours), following the
+/// cracks between pixels; every contour is found in one raster pass over the
+/// top pixel edges and traced once, O(pixels + contour length).
+/// connect: 4 or 8, regions touching only diagonally are one contour if 8
+/// Points are the corners where the boundary turns.
+void traceContours( const int* labels, int width, int height, int connect,
+                    std::vector<RegionContour>& contours );
+
+/// Douglas-Peucker simplification of a closed polygon, max deviation `epsilon`
+void simplifyPolygon( const std::vector<Point>& points, double epsilon, std::vector<Point>& out );
+
+#endif
@@ -1,20 +1,26 @@
 
+#include <new>
+
 #include "DisjointSet.h"
 
 /**
  * constructor: create a disjoint set forest, numElements sets,
  * each set has size 1, rank 0, parent itself initially
  */
-DisjointSet :: DisjointSet( int numElements )
+template< typename Index >
+DisjointSetT<Index> :: DisjointSetT( Index numElements )
 {
 
-    elts = new uni_elt[ numElements ];
+    elts = new (std::nothrow) Element[ numElements ];
+    if( !elts )
+        throw "DisjointSet :: DisjointSet - out of memory!";
     this -> count = numElements;
 
     // initial number of elements, stored for resetting
     this -> numElements = numElements;
+    this -> maxElements = numElements;
 
-    for (int i = 0; i < numElements; i++)
+    for (Index i = 0; i < numElements; i++)
     {
         elts[i].rank = 0;
         elts[i].size = 1;
@@ -25,7 +31,8 @@ DisjointSet :: DisjointSet( int numElements )
 /**
  * destructor, releases memory
  */
-DisjointSet :: ~DisjointSet()
+template< typename Index >
+DisjointSetT<Index> :: ~DisjointSetT()
 {
     if( elts)
         delete [] elts;
@@ -35,10 +42,11 @@ DisjointSet :: ~DisjointSet()
 /**
  * find which set `x` belongs to (i.e., the root), with recursive path compression
  */
-int DisjointSet :: find( int x )
+template< typename Index >
+Index DisjointSetT<Index> :: find( Index x )
 {
     if (elts[x].p != x)
-        elts[x].p = find(elts[x].p)
+        elts[x].p = find(elts[x].p);
     
 
     return elts[x].p;
@@ -47,9 +55,10 @@ int DisjointSet :: find( int x )
 /**
  * find which set `x` belongs to (i.e., the root), with (almost) no path compression
  */
-int DisjointSet :: find_nopc( int x )
+template< typename Index >
+Index DisjointSetT<Index> :: find_nopc( Index x )
 {
-    int y = x;
+    Index y = x;
     while ( y != elts[y].p )
         y = elts[y].p;
 
@@ -61,7 +70,8 @@ int DisjointSet :: find_nopc( int x )
 /**
  * join/unite 2 sets x, y (union by rank)
  */
-void DisjointSet :: join( int x, int y ) {
+template< typename Index >
+void DisjointSetT<Index> :: join( Index x, Index y ) {
 
     // added, 05.07.2007
     if( x == y )
@@ -85,15 +95,70 @@ void DisjointSet :: join( int x, int y ) {
     count --;
 }
 
+/**
+ * link root x under root y, no union by rank
+ */
+template< typename Index >
+void DisjointSetT<Index> :: link( Index x, Index y )
+{
+    if( x == y )
+      return;
+
+    elts[x].p = y;
+    elts[y].size += elts[x].size;
+    if ( elts[y].rank <= elts[x].rank )
+        elts[y].rank = elts[x].rank + 1;
+
+    count --;
+}
+
+/**
+ * make the elements [begin, end) singletons again, subtract them from their sets
+ */
+template< typename Index >
+void DisjointSetT<Index> :: detach( Index begin, Index end )
+{
+    Index i;
+    for ( i = begin; i < end; i++ )
+    {
+        Index r = find( i );
+        if( r < begin || r >= end )
+            elts[r].size--;         // set continues outside the range
+        else if( r == i )
+            count--;                // set entirely inside the range
+    }
+
+    for ( i = begin; i < end; i++ )
+    {
+        elts[i].rank = 0;
+        elts[i].size = 1;
+        elts[i].p = i;
+    }
+    count += end - begin;
+}
+
 /**
  * reset the DSF, bring it to the initial state
  */
-void DisjointSet :: reset()
+template< typename Index >
+void DisjointSetT<Index> :: reset()
 {
+    this->reset( this->maxElements );
+}
+
+/**
+ * reset the DSF to the first `numElements` nodes, each a set by itself
+ */
+template< typename Index >
+void DisjointSetT<Index> :: reset( Index numElements )
+{
+    if( numElements > this->maxElements )
+        numElements = this->maxElements;
 
-  this -> count = this->numElements;
+    this -> numElements = numElements;
+    this -> count = numElements;
 
-    for (int i = 0; i < this->numElements; i++)
+    for (Index i = 0; i < numElements; i++)
     {
         elts[i].rank = 0;
         elts[i].size = 1;
@@ -101,3 +166,7 @@ void DisjointSet :: reset()
     }
 
 }
+
+// DisjointSet, DisjointSet64
+template class DisjointSetT<int>;
+template class DisjointSetT<long long>;
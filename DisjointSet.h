@@ -1,55 +1,90 @@
 #ifndef BIL_DISJOINT_SET_H
 #define BIL_DISJOINT_SET_H
 
+#include <cstddef>
+
 // Disjoint-set forest using union-by-rank and path compression.
+//
+// Index: element index and set size type, int (DisjointSet) or, for graphs
+// of more than 2^31 - 1 nodes, long long (DisjointSet64); instantiated for
+// these two in DisjointSet.cpp.
 
-typedef struct
+template< typename Index >
+struct DisjointSetElement
 {
     int rank;
-    int p;
-    int size;
-} uni_elt;
+    Index p;
+    Index size;
+};
+
+typedef DisjointSetElement<int> uni_elt;
 
-class DisjointSet
+template< typename Index >
+class DisjointSetT
 {
 
 public:
 
-    DisjointSet( int numElements );
-    ~DisjointSet();
+    typedef DisjointSetElement<Index> Element;
+
+    /// throws if the elements cannot be allocated
+    DisjointSetT( Index numElements );
+    ~DisjointSetT();
+
+    /// bytes allocated for a DSF of numElements elements
+    static size_t memoryFootprint( Index numElements ) { return sizeof(Element) * (size_t)numElements; }
 
     /// reset the DSF, bring it to the initial state
     void reset();
 
+    /// reset to `numElements` singleton sets, only the first numElements nodes
+    /// are used until the next reset (numElements <= the size given in the constructor)
+    void reset( Index numElements );
+
     /// which set does x belong to, with recursive path compression
-    int find( int x );
+    Index find( Index x );
     
     /// which set does x belong to, iterative, (almost) no path compression
-    int find_nopc( int x )
+    Index find_nopc( Index x );
     
     /// union: join sets x, y; do union-by-rank & path compression
-    void join( int x, int y );
+    void join( Index x, Index y );
+
+    /// union without rank: root x becomes a child of root y (y stays the root),
+    /// for forests that keep an order on the roots (VideoGraphSeg: newest frame)
+    void link( Index x, Index y );
+
+    /// take the elements [begin, end) out of their sets, they become singletons;
+    /// the sets shrink by the elements taken out. No element outside the range
+    /// may have its parent inside the range (e.g., roots always outside, see link)
+    void detach( Index begin, Index end );
 
     /// size of set x
-    int setSize( int x ) const { return elts[x].size; }
+    Index setSize( Index x ) const { return elts[x].size; }
 
     /// how many sets are in DSF
-    int numSets() const { return count; }
+    Index numSets() const { return count; }
 
     /// return total number of elements in all sets (total number of nodes)
-    int getNumElements() const { return numElements; }
+    Index getNumElements() const { return numElements; }
 
 
 private:
 
-    uni_elt* elts;
+    Element* elts;
 
     /// number of sets in the DSF
-    int count;
+    Index count;
 
     /// total number of elements in all the sets (initial number of sets)
-    int numElements;
+    Index numElements;
+
+    /// number of allocated elements, size given in the constructor
+    Index maxElements;
 };
 
+typedef DisjointSetT<int> DisjointSet;
+typedef DisjointSetT<long long> DisjointSet64;
+
 
 #endif
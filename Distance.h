@@ -0,0 +1,135 @@
+/***************************************************************
+ * Name:      Distance.h
+ * Purpose:   Pixel distance functors, used as graph edge weights
+ * Author:    segment-cpp contributors
+ * Created:   18.10.2026
+ * Copyright: segment-cpp contributors
+ * License:
+ **************************************************************/
+
+#ifndef DISTANCE_H_INCLUDED
+#define DISTANCE_H_INCLUDED
+
+#include <cmath>
+
+#include "opencv2/core/core.hpp"
+
+// Each functor takes two pixels of the same type and returns a float distance.
+// The pixel may be a single value (uchar, float, ...) or a cv::Vec<T,n>, so the
+// same functor works on 8-bit color images and on precomputed feature planes
+// (e.g., CV_32FC3 Lab). The segmenters take the functor as a template
+// parameter, so the call is inlined into the graph building loop.
+// A user-supplied functor only needs the same operator().
+
+/// channels of a pixel type: single values (uchar, float, ...) or cv::Vec<T,n>
+template< typename T >
+struct PixelTraits
+{
+    enum { channels = 1 };
+    static float channel( const T& p, int ) { return (float)p; }
+};
+
+template< typename T, int n >
+struct PixelTraits< cv::Vec<T,n> >
+{
+    enum { channels = n };
+    static float channel( const cv::Vec<T,n>& p, int c ) { return (float)p[c]; }
+};
+
+/// L1 (city-block) distance
+struct DistL1
+{
+    template< typename T >
+    float operator()( const T& p1, const T& p2 ) const
+    {
+        return std::fabs( (float)p1 - (float)p2 );
+    }
+
+    template< typename T, int n >
+    float operator()( const cv::Vec<T,n>& p1, const cv::Vec<T,n>& p2 ) const
+    {
+        float d = 0.0f;
+        for( int i = 0; i < n; i++ )
+            d += std::fabs( (float)p1[i] - (float)p2[i] );
+        return d;
+    }
+};
+
+/// L2 (Euclidean) distance, default metric of GreedyGraphSeg
+struct DistL2
+{
+    template< typename T >
+    float operator()( const T& p1, const T& p2 ) const
+    {
+        return std::fabs( (float)p1 - (float)p2 );
+    }
+
+    template< typename T, int n >
+    float operator()( const cv::Vec<T,n>& p1, const cv::Vec<T,n>& p2 ) const
+    {
+        float d = 0.0f;
+        for( int i = 0; i < n; i++ )
+        {
+            float di = (float)p1[i] - (float)p2[i];
+            d += di * di;
+        }
+        return std::sqrt( d );
+    }
+};
+
+/// L-infinity (max) distance, default metric of SRMSeg
+struct DistLinf
+{
+    template< typename T >
+    float operator()( const T& p1, const T& p2 ) const
+    {
+        return std::fabs( (float)p1 - (float)p2 );
+    }
+
+    template< typename T, int n >
+    float operator()( const cv::Vec<T,n>& p1, const cv::Vec<T,n>& p2 ) const
+    {
+        float d = 0.0f;
+        for( int i = 0; i < n; i++ )
+        {
+            float di = std::fabs( (float)p1[i] - (float)p2[i] );
+            if( di > d )
+                d = di;
+        }
+        return d;
+    }
+};
+
+/// CIE76 color difference on a precomputed Lab feature plane (CV_32FC3),
+/// lightness difference weighted by `wL` (< 1 makes it less sensitive to shading)
+struct DistLab
+{
+    float wL;
+
+    DistLab( float wL = 1.0f ) : wL(wL) {}
+
+    float operator()( const cv::Vec3f& p1, const cv::Vec3f& p2 ) const
+    {
+        float dL = wL * ( p1[0] - p2[0] );
+        float da = p1[1] - p2[1];
+        float db = p1[2] - p2[2];
+        return std::sqrt( dL*dL + da*da + db*db );
+    }
+};
+
+/// applies `Metric` to the color channels only, for 4-channel (BGRA/RGBA) pixels
+template< typename Metric >
+struct ColorOnly
+{
+    Metric metric;
+
+    ColorOnly( const Metric& metric = Metric() ) : metric(metric) {}
+
+    template< typename T >
+    float operator()( const cv::Vec<T,4>& p1, const cv::Vec<T,4>& p2 ) const
+    {
+        return metric( cv::Vec<T,3>( p1[0], p1[1], p1[2] ), cv::Vec<T,3>( p2[0], p2[1], p2[2] ) );
+    }
+};
+
+#endif
@@ -17,3 +17,8 @@ bool operator<( const edge &a, const edge &b )
 {
     return a.w < b.w;
 }
+
+bool operator<( const edge64 &a, const edge64 &b )
+{
+    return a.w < b.w;
+}
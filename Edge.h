@@ -10,15 +10,51 @@
 #ifndef EDGE_H_INCLUDED
 #define EDGE_H_INCLUDED
 
-/// an edge in a graph
-typedef struct
+/// an edge in a graph; Index: node index type, int (edge) or long long (edge64),
+/// see DisjointSetT
+template< typename Index >
+struct edgeT
 {
     float w;
-    int a;
-    int b;
-} edge;
+    Index a;
+    Index b;
+};
+
+typedef edgeT<int> edge;
+typedef edgeT<long long> edge64;
 
 //std::ostream& operator<<( std::ostream& ostr, const edge& e );
 bool operator<( const edge &a, const edge &b );
+bool operator<( const edge64 &a, const edge64 &b );
+
+/// graph builder output: edges with explicit ends
+/// (p, dir: source pixel and direction, used by compact edge outputs)
+struct EdgeSink
+{
+    edge* edges;
+    int n;
+
+    EdgeSink( edge* edges ) : edges(edges), n(0) {}
+
+    void operator()( int, int, int a, int b, float w )
+    {
+        edges[n].a = a;
+        edges[n].b = b;
+        edges[n].w = w;
+        n++;
+    }
+};
+
+/// edge list access for the merge loops
+struct EdgeArray
+{
+    const edge* edges;
+
+    EdgeArray( const edge* edges ) : edges(edges) {}
+
+    int a( int i ) const { return edges[i].a; }
+    int b( int i ) const { return edges[i].b; }
+    float w( int i ) const { return edges[i].w; }
+};
 
 #endif
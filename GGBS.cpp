@@ -13,7 +13,12 @@
 
 #include "GGBS.h"
 
-GGBS::GGBS( int numNodes, int numEdges, float threshold, int minsize )
+/// min-heap order on the edge weights (reorder buffer)
+template< typename Edge >
+static bool heavier( const Edge& e1, const Edge& e2 ) { return e1.w > e2.w; }
+
+template< typename Index >
+GGBST<Index>::GGBST( Index numNodes, Index numEdges, float threshold, int minsize )
 {
     this->minSize = 1;
     this->threshold = 0.50f;
@@ -27,41 +32,52 @@ GGBS::GGBS( int numNodes, int numEdges, float threshold, int minsize )
     this->dsf = NULL;
     this->thresholds = NULL;
     this->labels = NULL;
+    this->profiler = NULL;
+
+    this->online = false;
+    this->reorderSize = 0;
+    this->lastWeight = 0.0f;
+    this->numUnordered = 0;
+    this->numPending = 0;
 
     allocate( numNodes, numEdges );
 }
 
-GGBS::~GGBS()
+template< typename Index >
+GGBST<Index>::~GGBST()
 {
     deallocate();
 }
 
-void GGBS :: allocate( int numNodes, int numEdges )
+template< typename Index >
+void GGBST<Index> :: allocate( Index numNodes, Index numEdges )
 {
-	if( numNodes < 1 || numEdges < 1 )
-        throw "GGBS :: allocate: numNodes and numEdges must be > 0!";
+	if( numNodes < 1 || numEdges < 0 )
+        throw "GGBS :: allocate: numNodes must be > 0, numEdges >= 0!";
 
 	this->numNodes = numNodes;
 	this->numEdges = numEdges;
 
-	// will keep the graph edges
-    this -> edges = new edge[ numEdges ];
+	// will keep the graph edges (not in online mode)
+    if( numEdges > 0 )
+        this -> edges = new Edge[ numEdges ];
 
     // DSF, numVertices
-    this -> dsf = new DisjointSet( numNodes );
+    this -> dsf = new DisjointSetT<Index>( numNodes );
 
     // thresholds array, one threshold for each node
     this -> thresholds = new float[ numNodes ];
 
     // class labels for the nodes
-    this->labels = new int[ numNodes ];
+    this->labels = new Index[ numNodes ];
 
-    if( !this -> edges || !this -> dsf || !this -> thresholds || !this->labels)
+    if( ( numEdges > 0 && !this -> edges ) || !this -> dsf || !this -> thresholds || !this->labels)
         throw "GGBS :: allocate: Memory allocation failed!";
 
 }
 
-void GGBS :: deallocate()
+template< typename Index >
+void GGBST<Index> :: deallocate()
 {
 	if( edges )
         delete[] edges;
@@ -80,7 +96,8 @@ void GGBS :: deallocate()
     labels = NULL;
 }
 
-void GGBS :: setParameters( float threshold, int minsize )
+template< typename Index >
+void GGBST<Index> :: setParameters( float threshold, int minsize )
 {
     if(minsize > 0)
         this->minSize = minsize;
@@ -89,7 +106,8 @@ void GGBS :: setParameters( float threshold, int minsize )
         this->threshold = threshold;
 }
 
-void GGBS :: reset()
+template< typename Index >
+void GGBST<Index> :: reset()
 {
     if(dsf)
     {
@@ -99,9 +117,10 @@ void GGBS :: reset()
         throw "GGBS :: reset: no DSF to reset!";
 }
 
-void GGBS :: start(int numNodes, int numEdges)
+template< typename Index >
+void GGBST<Index> :: start(Index numNodes, Index numEdges)
 {
-    if( numNodes != this->numNodes ||  numEdges != this->numEdges)
+    if( numNodes != this->numNodes ||  numEdges != this->numEdges || !this->edges )
     {
         this->deallocate();
 		this->allocate( numNodes,  numEdges);
@@ -109,17 +128,70 @@ void GGBS :: start(int numNodes, int numEdges)
 
     reset();
     this->edgeIndex = 0;
+    this->online = false;
+}
+
+template< typename Index >
+void GGBST<Index> :: startOnline(Index numNodes, int reorderSize)
+{
+    if( numNodes != this->numNodes || this->edges )
+    {
+        this->deallocate();
+        this->allocate( numNodes, 0 );
+    }
+
+    reset();
+    this->edgeIndex = 0;
+    this->online = true;
+
+    this->reorderSize = ( reorderSize > 0 ) ? reorderSize : 0;
+    this->reorder.clear();
+    this->reorder.reserve( this->reorderSize + 1 );
+    this->lastWeight = 0.0f;
+    this->numUnordered = 0;
+    this->pending.clear();
+    this->numPending = 0;
+
+    for ( Index i = 0; i < numNodes; i++ )
+        thresholds[i] = this->threshold;
 }
 
 /**
  * add a new edge to the graph
  * a and b must be in [0, numNodes-1], or edge is not added & -1 returned
  */
-int GGBS :: addEdge(int a, int b, float weight)
+template< typename Index >
+Index GGBST<Index> :: addEdge(Index a, Index b, float weight)
 {
     if( a >= this->numNodes || b >= this->numNodes || a < 0 ||  b < 0  )
         return -1;
 
+    if( this->online )
+    {
+        Edge e;
+        e.a = a;
+        e.b = b;
+        e.w = weight;
+
+        if( this->reorderSize == 0 )
+            mergeEdge( e );
+        else
+        {
+            reorder.push_back( e );
+            std::push_heap( reorder.begin(), reorder.end(), heavier<Edge> );
+            if( (int)reorder.size() > this->reorderSize )
+            {
+                std::pop_heap( reorder.begin(), reorder.end(), heavier<Edge> );
+                mergeEdge( reorder.back() );
+                reorder.pop_back();
+            }
+        }
+        return ++this->edgeIndex;
+    }
+
+    if( this->edgeIndex >= this->numEdges )
+        return -1;
+
     this->edges[this->edgeIndex].a = a;
     this->edges[this->edgeIndex].b = b;
     this->edges[this->edgeIndex].w = weight;
@@ -139,29 +211,44 @@ int GGBS :: addEdge(int a, int b, float weight)
  * numEdges: number of edges in graph
  *
  **/
-void  GGBS :: segmentGraph()
+template< typename Index >
+void  GGBST<Index> :: segmentGraph()
 {
+    // online: the edges are merged already, except the buffered ones
+    if( this->online )
+    {
+        std::sort( reorder.begin(), reorder.end() );
+        for ( size_t i = 0; i < reorder.size(); i++ )
+            mergeEdge( reorder[i] );
+        reorder.clear();
+        return;
+    }
+
     // number of edges currently available in the graph
-    int numEdges = this->edgeIndex;
+    Index numEdges = this->edgeIndex;
 
     // sort edges by weight
-    std::sort(edges, edges + numEdges );
+    {
+        PerfScope scope( this->profiler, "ggbs sort", numEdges );
+        std::sort(edges, edges + numEdges );
+    }
 
     // initialize thresholds for each node
-    int i;
+    Index i;
     for (i = 0; i < numNodes; i++)
 	    thresholds[i] = this->threshold;    // eguiv. to: threshold/1
 
+    PerfScope scope( this->profiler, "ggbs merge", numEdges );
 
     // for each edge, in non-decreasing weight order...
-    edge* pedge = this->edges;
+    Edge* pedge = this->edges;
     for (i = 0; i < numEdges; i++, pedge++)
     {
 	    //pedge = &edges[i];
 
 		// components conected by this edge
-		int a = dsf -> find( pedge->a );
-		int b = dsf -> find( pedge->b );
+		Index a = dsf -> find( pedge->a );
+		Index b = dsf -> find( pedge->b );
 		if ( a != b )
 		{
 		    if ( ( pedge->w <= thresholds[a] ) && ( pedge->w <= thresholds[b] ) )
@@ -174,11 +261,77 @@ void  GGBS :: segmentGraph()
     }
 }
 
-void GGBS :: postProcess()
+/**
+ * online segmentation: merge one edge, in (nearly) non-decreasing weight order;
+ * a rejected edge with a small component is kept for postProcess
+ */
+template< typename Index >
+void GGBST<Index> :: mergeEdge(const Edge& e)
+{
+    if( e.w < this->lastWeight )
+        this->numUnordered++;
+    else
+        this->lastWeight = e.w;
+
+    Index a = dsf -> find( e.a );
+    Index b = dsf -> find( e.b );
+    if ( a == b )
+        return;
+
+    if ( ( e.w <= thresholds[a] ) && ( e.w <= thresholds[b] ) )
+    {
+        dsf->join(a, b);
+        a = dsf->find(a);
+        thresholds[a] = e.w + edgeThresh( dsf->setSize(a) );
+    }
+    else if( ( dsf->setSize(a) <= minSize ) || ( dsf->setSize(b) <= minSize ) )
+    {
+        pending.push_back( e );
+        if( (Index)pending.size() >= 2 * numPending + 1024 )
+            prunePending();
+    }
+}
+
+template< typename Index >
+void GGBST<Index> :: prunePending()
+{
+    size_t n = 0;
+    for ( size_t i = 0; i < pending.size(); i++ )
+    {
+        Index a = dsf->find( pending[i].a );
+        Index b = dsf->find( pending[i].b );
+        if ( (a != b) && ( ( dsf->setSize(a) <= minSize ) || ( dsf->setSize(b) <= minSize )))
+            pending[n++] = pending[i];
+    }
+    pending.resize( n );
+    numPending = (Index)n;
+}
+
+template< typename Index >
+void GGBST<Index> :: postProcess()
 {
-    int i, a, b;
+    Index i, a, b;
+    PerfScope scope( this->profiler, "ggbs small", this->online ? (long long)pending.size() : this->edgeIndex );
+
+    // online: the pending edges, in the order they were merged
+    if( this->online )
+    {
+        prunePending();
+        std::stable_sort( pending.begin(), pending.end() );
+        for ( size_t j = 0; j < pending.size(); j++ )
+        {
+            a = dsf->find( pending[j].a );
+            b = dsf->find( pending[j].b );
+            if ( (a != b) && ( ( dsf->setSize(a) <= minSize ) || ( dsf->setSize(b) <= minSize )))
+                dsf->join(a, b);
+        }
+        pending.clear();
+        numPending = 0;
+        return;
+    }
+
     // post process small components
-    edge* pedge = this->edges;
+    Edge* pedge = this->edges;
     for ( i = 0; i < this->edgeIndex; i++, pedge++ )
     {
         a = dsf->find( pedge->a );
@@ -192,19 +345,33 @@ void GGBS :: postProcess()
  * return class labels for all the nodes
  * labels are in the range [0, numNodes]
  */
-int* GGBS :: getLabels()
+template< typename Index >
+Index* GGBST<Index> :: getLabels()
 {
     if(!this->dsf)
         return 0;
 
     if(!this->labels)
-        this->labels = new int[numNodes];
+        this->labels = new Index[numNodes];
 
-    int* ltemp = this->labels;
-    for( int i = 0; i < numNodes; i++, ltemp++ )
+    Index* ltemp = this->labels;
+    for( Index i = 0; i < numNodes; i++, ltemp++ )
     {
         *ltemp = dsf->find(i);
     }
 
     return this->labels;
 }
+
+template< typename Index >
+void GGBST<Index> :: finalize( LabelSnapshot& snapshot )
+{
+    if( !this->dsf )
+        throw "GGBS :: finalize: no DSF!";
+
+    snapshot.build( *this->dsf );
+}
+
+// GGBS, GGBS64
+template class GGBST<int>;
+template class GGBST<long long>;
@@ -10,61 +10,95 @@
 #ifndef GGBS_H_INCLUDED
 #define GGBS_H_INCLUDED
 
+#include <vector>
+
 #include "DisjointSet.h"
 #include "Edge.h"
-
-class GGBS
+#include "LabelSnapshot.h"
+#include "PerfProfiler.h"
+
+/**
+ * Index: node and edge index type, int (GGBS) or long long (GGBS64) for graphs
+ * of more than 2^31 - 1 nodes or edges; instantiated for these two in GGBS.cpp
+ */
+template< typename Index >
+class GGBST
 {
     public:
-        GGBS( int numNodes, int numEdges, float threshold = 0.5f, int minSize = 5 );
-        ~GGBS();
+        typedef edgeT<Index> Edge;
 
-        void allocate( int numNodes, int numEdges );
+        GGBST( Index numNodes, Index numEdges, float threshold = 0.5f, int minSize = 5 );
+        ~GGBST();
+
+        void allocate( Index numNodes, Index numEdges );
         void deallocate();
         void setParameters( float threshold, int minsize );
 
         /// (re)allocates memory if needed and calls reset()
         /// and reset edgeIndex(0)
         /// should be called at the beginning of a new segmentation
-        void start(int numNodes, int numEdges);
+        void start(Index numNodes, Index numEdges);
+        /// start an online segmentation: addEdge merges right away, no edge array is kept
+        /// (memory O(numNodes + reorderSize), see postProcess below); edges must come in non-decreasing weight
+        /// order, or nearly so: up to reorderSize edges are buffered and merged lightest first.
+        /// segmentGraph() then merges the buffered edges. For postProcess() only the rejected
+        /// edges with a component of at most minSize are kept (components only grow, the
+        /// other edges never merge there), so set minSize before.
+        void startOnline(Index numNodes, int reorderSize = 0);
+        /// true after startOnline(), until start()
+        bool isOnline() const { return online; }
+        /// online: number of edges merged after a heavier edge (order not restored by the buffer)
+        Index getNumUnordered() const { return numUnordered; }
         /// reset the DSF (segmentation)
         void reset();
 
-        /// add a new edge to the graph
+        /// add a new edge to the graph (online: merge it)
         /// return the current number of edges in the graph, or -1
         /// a and b must be in [0, numNodes-1], or edge is not added & -1 returned
-        int addEdge(int a, int b, float weight);
+        /// (also when numEdges edges were added already)
+        Index addEdge(Index a, Index b, float weight);
 
         /// increment amount for edge weight, when joining 2 sets,
         /// used in segmentGraph
-        float edgeThresh(int size){ return threshold/size; }
+        float edgeThresh(Index size){ return threshold/size; }
         /// segment the graph into a set of DSFs
         void segmentGraph();
         /// eliminate small regions by merging
         void postProcess();
 
+        /// profile segmentGraph and postProcess (sort, merge, small) into `profiler`
+        /// (see PerfProfiler.h), NULL: no profiling (default)
+        void setProfiler(PerfProfiler* profiler) { this->profiler = profiler; }
+
         /// return class labels for all the nodes (ptr to this->labels)
         /// do not delete the returned pointer!
-        int* getLabels();
+        Index* getLabels();
 
         /// number of components in the current segmentation
-        int getNumComps() const { return ( dsf != NULL ) ? dsf->numSets() : -1; }
+        Index getNumComps() const { return ( dsf != NULL ) ? dsf->numSets() : -1; }
         /// size of the set that `id` belongs to
-        int getSize(int id) const {return ( dsf != NULL ) ? dsf->setSize(findSet(id)) : -1;}
-        /// which set does `id` belong to?
-        int findSet(int id) const {return ( dsf != NULL ) ? dsf->find(id) : -1;}
+        /// (not thread safe: the DSF lookup compresses paths, see finalize())
+        Index getSize(Index id) const {return ( dsf != NULL ) ? dsf->setSize(findSet(id)) : -1;}
+        /// which set does `id` belong to? (not thread safe, see finalize())
+        Index findSet(Index id) const {return ( dsf != NULL ) ? dsf->find(id) : -1;}
+
+        /// flatten the current segmentation into `snapshot` (dense labels, sizes, roots)
+        /// for concurrent read-only queries; the snapshot is independent of this object,
+        /// it stays valid while the next graph is segmented (labels are int: throws
+        /// past 2^31 - 1 nodes)
+        void finalize( LabelSnapshot& snapshot );
 
 
     /// ===== DATA =================================
     public:
 
         /// number of nodes and edges in the graph to be built
-        int numNodes;
-        int numEdges;
+        Index numNodes;
+        Index numEdges;
 
         /// which edge will be added next
         /// (hence, current number of edges in the graph)
-        int edgeIndex;
+        Index edgeIndex;
 
         /// used in segmentGraph() to decide whether to join two sets
         float threshold;
@@ -73,11 +107,11 @@ class GGBS
         int minSize;
 
         /// edge weights, array of size `numEdges`
-        edge* edges;
+        Edge* edges;
 
         /// disjoint set forest, total number of elements = `numNodes`
         /// initial number of sets = `numNodes`
-        DisjointSet* dsf;
+        DisjointSetT<Index>* dsf;
 
         /// thresholds in segmentGraph, one threshold for each node
         /// array size = `numNodes`
@@ -86,8 +120,37 @@ class GGBS
         /// labels of each node, array size = `numNodes`
         /// meaningful after segmentation
         /// range: [0, numNodes]
-        int* labels;
+        Index* labels;
+
+        /// phase profiling, or NULL
+        PerfProfiler* profiler;
+
+        /// online mode (startOnline), `edges` is NULL
+        bool online;
+
+        /// online: max number of buffered edges, buffer as a min-heap on weight
+        int reorderSize;
+        std::vector<Edge> reorder;
+
+        /// online: weight of the last merged edge, number of edges merged out of order
+        float lastWeight;
+        Index numUnordered;
+
+        /// online: rejected edges that may merge small components in postProcess,
+        /// pruned when it doubles (numPending: size after the last pruning)
+        std::vector<Edge> pending;
+        Index numPending;
+
+    private:
+
+        /// online: greedy merge of one edge
+        void mergeEdge(const Edge& e);
+        /// online: drop the pending edges that can no longer merge
+        void prunePending();
 };
 
+typedef GGBST<int> GGBS;
+typedef GGBST<long long> GGBS64;
+
 
 #endif
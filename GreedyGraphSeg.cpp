@@ -9,17 +9,20 @@
  **************************************************************/
 
 #include <algorithm>
+#include <climits>
 #include <cmath>
 #include <cstdlib>
 #include <ctime>
 #include <iomanip>
+#include <new>
 
+#include "BucketSort.h"
+#include "Contours.h"
 #include "GreedyGraphSeg.h"
+#include "Pyramid.h"
 
 #define THRESHOLD(size, c) (c/size)
 
-inline float square( double val){return val*val;}
-
 using namespace std;
 
 /**
@@ -27,6 +30,29 @@ using namespace std;
  */
 GreedyGraphSeg :: GreedyGraphSeg( int width, int height, float threshold, int minSize, int connect )
 {
+    this->coarse = NULL;
+    this->nodeMap = NULL;
+    this->smoothType = SMOOTH_NONE;
+    this->sigma = 0.8f;
+    this->masked = false;
+    this->nodeOrder = ORDER_RASTER;
+    this->orderTile = 64;
+    this->compact = false;
+    this->compactRequested = false;
+    this->memoryBudget = 0;
+    this->numThreads = 1;
+    this->cancelToken = NULL;
+    this->interrupted = false;
+    this->replayable = false;
+    this->profiler = NULL;
+    this->edges = NULL;
+    this->cedges = NULL;
+    this->ckeys = NULL;
+    this->dsf = NULL;
+    this->thresholds = NULL;
+    this->weightMode = WEIGHTS_FLOAT;
+    this->weightStep = 1.0f / 64;
+
 	// this must be called first, since parameters are used in allocate
     this->setParameters( minSize, threshold, connect );
 	this->allocate( width, height );
@@ -37,21 +63,61 @@ void GreedyGraphSeg :: allocate( int width, int height )
 	if( width < 1 || height < 1 )
         throw "GreedyGraphSeg :: allocate - Illegal width-height for image!";
 
-	this->width = width;
-	this->height = height;
+    // no storage until allocated, the next segmentation reallocates if this throws
+	this->width = 0;
+	this->height = 0;
 
-	// will keep the graph edges, size is more than required
-    this -> edges = new edge[ width * height * ( this ->connect / 2 ) ];
+    // compact edges if requested, or if the full edges exceed the memory budget
+    this->compact = this->compactRequested;
+    if( this->memoryBudget )
+    {
+        if( !this->compact && memoryFootprint( width, height, this->connect, false ) > this->memoryBudget )
+            this->compact = true;
+
+        if( memoryFootprint( width, height, this->connect, true, false, this->weightMode ) > this->memoryBudget )
+            throw "GreedyGraphSeg :: allocate - image exceeds the memory budget!";
+    }
 
-    // DSF, numVertices: width*height (one node for each pixel)
-    this -> dsf = new DisjointSet( width*height );
+    // node and edge indices are int (DisjointSet, edge); larger graphs: GGBS64
+    if( (double)width * height * ( this->connect / 2 ) > INT_MAX )
+        throw "GreedyGraphSeg :: allocate - image too large for 32-bit indices!";
+
+	// will keep the graph edges, size is more than required
+    size_t numEdges = (size_t)width * height * ( this ->connect / 2 );
+    if( this->compact )
+    {
+        if( (double)width * height >= GRID_MAX_PIXELS )
+            throw "GreedyGraphSeg :: allocate - image too large for compact edges!";
+        if( this->keyEdges() )
+            this -> ckeys = new (std::nothrow) gridkey[ numEdges ];
+        else
+            this -> cedges = new (std::nothrow) gridedge[ numEdges ];
+    }
+    else
+        this -> edges = new (std::nothrow) edge[ numEdges ];
 
     // thresholds array, numVertices: width*height
-    this -> thresholds = new float[ width*height ];
+    this -> thresholds = new (std::nothrow) float[ width*height ];
+
+    if( ( !this -> edges && !this -> cedges && !this -> ckeys ) || !this -> thresholds )
+    {
+        this->deallocate();
+        throw "GreedyGraphSeg :: allocate - out of memory!";
+    }
 
-    if( !this -> edges || !this -> dsf || !this -> thresholds )
-        throw "Memory allocation failed! GreedyGraphSeg::GreedyGraphSeg()";
+    // DSF, numVertices: width*height (one node for each pixel), throws if out of memory
+    try
+    {
+        this -> dsf = new DisjointSet( width*height );
+    }
+    catch( ... )
+    {
+        this->deallocate();
+        throw "GreedyGraphSeg :: allocate - out of memory!";
+    }
 
+	this->width = width;
+	this->height = height;
     this->area = width*height;
 
 }
@@ -64,7 +130,7 @@ void GreedyGraphSeg :: setParameters( int minsize, float threshold, int connecti
 	if( threshold < 1.0f )
 		throw "GreedyGraphSeg :: setParameters - Illegal threshold for segmentation!";
 
-	if( connectivity != 4 || connectivity != 8 )
+	if( connectivity != 4 && connectivity != 8 )
 		connectivity = 4;
 
 	this->minSize = minsize;
@@ -73,12 +139,139 @@ void GreedyGraphSeg :: setParameters( int minsize, float threshold, int connecti
 }
 
 
+void GreedyGraphSeg :: setSmoothing( int type, float sigma )
+{
+    if( type != SMOOTH_GAUSSIAN && type != SMOOTH_MEDIAN3 )
+        type = SMOOTH_NONE;
+
+    if( type == SMOOTH_GAUSSIAN && sigma <= 0.0f )
+        throw "GreedyGraphSeg :: setSmoothing - Illegal sigma for smoothing!";
+
+    this->smoothType = type;
+    this->sigma = sigma;
+}
+
+/**
+ * switch between full (edge) and compact (gridedge) edge storage
+ */
+void GreedyGraphSeg :: setCompactEdges( bool compact )
+{
+    if( compact == this->compactRequested )
+        return;
+
+    this->deallocate();
+    this->compactRequested = compact;
+    if( this->width > 0 )
+        this->allocate( this->width, this->height );
+}
+
+size_t GreedyGraphSeg :: memoryFootprint( int width, int height, int connect, bool compact,
+                                          bool nodeMap, int weightMode, int pyramidLevels )
+{
+    size_t numPixels = (size_t)width * height;
+    size_t numEdges = numPixels * ( ( connect == 8 ) ? 4 : 2 );
+    size_t edgeBytes = !compact ? sizeof(edge) : ( weightMode != WEIGHTS_FLOAT ) ? sizeof(gridkey) : sizeof(gridedge);
+
+    size_t bytes = numEdges * edgeBytes
+                 + DisjointSet::memoryFootprint( width * height )
+                 + numPixels * sizeof(float);
+
+    if( nodeMap )
+        bytes += numPixels * sizeof(int);
+
+    if( pyramidLevels > 0 )
+    {
+        // coarse segmenter (the same edge storage), downscaled image, coarse labels and
+        // representatives, pyramidBand's 3 coarse masks, fine band mask
+        int f = 1 << min( pyramidLevels, PYRAMID_MAX_LEVELS );
+        int cw = ( width + f - 1 ) / f;
+        int ch = ( height + f - 1 ) / f;
+        bytes += memoryFootprint( cw, ch, connect, compact, false, weightMode )
+               + (size_t)cw * ch * ( 3 + 2 * sizeof(int) + 3 )
+               + numPixels;
+    }
+
+    return bytes;
+}
+
+size_t GreedyGraphSeg :: memoryUsage() const
+{
+    if( this->width < 1 )
+        return 0;
+
+    return memoryFootprint( this->width, this->height, this->connect, this->compact, this->nodeMap != NULL, this->weightMode )
+         + ( this->coarse ? this->coarse->memoryUsage() : 0 );
+}
+
+/**
+ * set the memory budget, the storage is reallocated within the budget
+ */
+void GreedyGraphSeg :: setMemoryBudget( size_t bytes )
+{
+    if( bytes == this->memoryBudget )
+        return;
+
+    this->deallocate();
+    this->memoryBudget = bytes;
+    if( this->width > 0 )
+        this->allocate( this->width, this->height );
+}
+
+void GreedyGraphSeg :: setNodeOrder( int order, int tile )
+{
+    if( order != ORDER_TILED && order != ORDER_MORTON )
+        order = ORDER_RASTER;
+
+    if( tile < 1 || ( order == ORDER_MORTON && ( tile & ( tile - 1 ) ) ) )
+        throw "GreedyGraphSeg :: setNodeOrder - Illegal tile size!";
+
+    this->nodeOrder = order;
+    this->orderTile = tile;
+}
+
+void GreedyGraphSeg :: setWeightMode( int mode, float step )
+{
+    if( mode != WEIGHTS_QUANTIZED && mode != WEIGHTS_SQUARED )
+        mode = WEIGHTS_FLOAT;
+
+    if( mode == WEIGHTS_QUANTIZED && step <= 0.0f )
+        throw "GreedyGraphSeg :: setWeightMode - Illegal quantization step!";
+
+    // compact edges: weight and key (float), or the key only (buckets)
+    bool realloc = this->width > 0 && ( this->compact || this->memoryBudget )
+                   && ( mode == WEIGHTS_FLOAT ) != ( this->weightMode == WEIGHTS_FLOAT );
+    if( realloc )
+        this->deallocate();
+
+    this->weightMode = mode;
+    this->weightStep = step;
+
+    if( realloc )
+        this->allocate( this->width, this->height );
+}
+
+int GreedyGraphSeg :: weightBucket( float w ) const
+{
+    return weightToBucket( w, weightMode, weightStep );
+}
+
+float GreedyGraphSeg :: bucketWeight( int b ) const
+{
+    if( weightMode == WEIGHTS_QUANTIZED )
+        return b * weightStep;
+    return std::sqrt( (float)b );
+}
+
 /**
  * destructor
  */
 GreedyGraphSeg :: ~GreedyGraphSeg()
 {
     this->deallocate();
+
+    if( coarse )
+        delete coarse;
+    coarse = NULL;
 }
 
 void GreedyGraphSeg :: deallocate()
@@ -87,6 +280,14 @@ void GreedyGraphSeg :: deallocate()
         delete[] edges;
     edges = NULL;
 
+    if( cedges )
+        delete[] cedges;
+    cedges = NULL;
+
+    if( ckeys )
+        delete[] ckeys;
+    ckeys = NULL;
+
     if( dsf)
         delete dsf;
     dsf = NULL;
@@ -94,39 +295,218 @@ void GreedyGraphSeg :: deallocate()
     if( thresholds )
         delete[] thresholds;
     thresholds = NULL;
+
+    if( nodeMap )
+        delete[] nodeMap;
+    nodeMap = NULL;
+    masked = false;
+    replayable = false;
 }
 
 /**
  * segment image based on color only
  */
-void GreedyGraphSeg :: segmentImageColor( Mat& image )
+void GreedyGraphSeg :: segmentImageColor( const ImageView& image )
+{
+    if( image.depth != CV_8U )
+        throw "GreedyGraphSeg :: segmentImageColor - 8-bit image expected!";
+
+    if( this->smoothType != SMOOTH_NONE && !image.empty() )
+    {
+        // smoothed rows are computed while building the graph
+        DistL2 metric;
+        smoother.start( image, this->smoothType, this->sigma );
+        if( smoother.channels() == 1 )
+        {
+            SmoothedRows<float> rows( smoother );
+            this->segmentRows<float>( rows, image.width, image.height, metric );
+        }
+        else
+        {
+            SmoothedRows<Vec3f> rows( smoother );
+            this->segmentRows<Vec3f>( rows, image.width, image.height, metric );
+        }
+        return;
+    }
+
+    switch( image.channels() )
+    {
+        case 1:  this->segmentImage<uchar>( image, DistL2() ); break;
+        case 4:  this->segmentImage<Vec4b>( image, ColorOnly<DistL2>() ); break;
+        default: this->segmentImage<Vec3b>( image, DistL2() ); break;
+    }
+}
+
+/**
+ * segment the active pixels (mask, ROIs) based on color only
+ */
+void GreedyGraphSeg :: segmentImageColor( const ImageView& image, const Mat& mask, const vector<Rect>& rois )
+{
+    if( image.depth != CV_8U )
+        throw "GreedyGraphSeg :: segmentImageColor - 8-bit image expected!";
+
+    if( this->smoothType != SMOOTH_NONE && !image.empty() )
+    {
+        DistL2 metric;
+        smoother.start( image, this->smoothType, this->sigma );
+        if( smoother.channels() == 1 )
+        {
+            SmoothedRows<float> rows( smoother );
+            this->segmentRowsMasked<float>( rows, image.width, image.height, mask, rois, metric );
+        }
+        else
+        {
+            SmoothedRows<Vec3f> rows( smoother );
+            this->segmentRowsMasked<Vec3f>( rows, image.width, image.height, mask, rois, metric );
+        }
+        return;
+    }
+
+    switch( image.channels() )
+    {
+        case 1:  this->segmentImageMasked<uchar>( image, mask, rois, DistL2() ); break;
+        case 4:  this->segmentImageMasked<Vec4b>( image, mask, rois, ColorOnly<DistL2>() ); break;
+        default: this->segmentImageMasked<Vec3b>( image, mask, rois, DistL2() ); break;
+    }
+}
+
+/**
+ * coarse-to-fine segmentation
+ *
+ * The coarse segmentation (threshold and minsize scaled by the pixel area ratio)
+ * fixes the interior of the regions: full resolution pixels farther than `band`
+ * coarse pixels from a coarse boundary are joined to their projected region,
+ * whose threshold is taken from the coarse level. Only the edges touching the
+ * band are built, sorted and merged (segmentGraph2, keeps these thresholds).
+ */
+void GreedyGraphSeg :: segmentPyramid( const ImageView& image, int levels, int band )
 {
     if(image.empty())
         return;
 
-	if( image.cols != this->width || image.rows != this->height )
+    if( image.depth != CV_8U || image.channels() != 3 )
+        throw "GreedyGraphSeg :: segmentPyramid - 8-bit 3 channel image expected!";
+
+    if( levels < 1 )
+    {
+        this->segmentImage<Vec3b>( image, DistL2() );
+        return;
+    }
+
+	if( image.width != this->width || image.height != this->height )
 	{
 		this->deallocate();
-		this->allocate( image.cols, image.rows );
+		this->allocate( image.width, image.height );
 	}
 
-    int numEdges;
-    if( this->connect == 4 )
-        numEdges = buildGraph4( image );
+    this->interrupted = false;
+    this->replayable = false;
+
+    // coarse segmenter and band buffers within the memory budget, a coarse segmenter
+    // of the last pyramid is resized
+    size_t pyramidBytes = memoryFootprint( width, height, connect, compact, false, weightMode, levels )
+                        - memoryFootprint( width, height, connect, compact, false, weightMode );
+    size_t ownBytes = this->memoryUsage() - ( coarse ? coarse->memoryUsage() : 0 );
+    this->checkMemoryBudget( ownBytes + pyramidBytes, "GreedyGraphSeg :: segmentPyramid - pyramid exceeds the memory budget!" );
+
+    // coarse level (pyramidDown checks the levels)
+    Mat small;
+    pyramidDown( image, small, levels );
+    int area = 1 << ( 2 * levels );
+
+    float cthreshold = max( 1.0f, this->threshold / area );
+    int cminsize = max( 1, this->minSize / area );
+    if( !coarse )
+    {
+        coarse = new (std::nothrow) GreedyGraphSeg( small.cols, small.rows, cthreshold, cminsize, this->connect );
+        if( !coarse )
+            throw "GreedyGraphSeg :: segmentPyramid - out of memory!";
+    }
     else
-        numEdges = buildGraph8( image );
+        coarse->setParameters( cminsize, cthreshold, this->connect );
+    // the same weights and edge storage, within the budget left after this segmenter and the band buffers
+    size_t coarseBytes = memoryFootprint( small.cols, small.rows, connect, compact, false, weightMode );
+    coarse->setWeightMode( this->weightMode, this->weightStep );
+    coarse->setCompactEdges( this->compact );
+    if( this->memoryBudget )
+        coarse->setMemoryBudget( this->memoryBudget - ownBytes - ( pyramidBytes - coarseBytes ) );
+    coarse->setCancelToken( this->cancelToken );
+    coarse->setProfiler( this->profiler );
+    coarse->segmentImage<Vec3b>( small, DistL2() );
+    this->interrupted = coarse->wasInterrupted();
+
+    int cw = small.cols;
+    int ch = small.rows;
+    int w = this->width;
+    int h = this->height;
+    vector<int> clabels, rep;
+    vector<uchar> inBand;
+    try
+    {
+        clabels.resize( cw * ch );
+        rep.assign( cw * ch, -1 );
+        inBand.resize( w * h );
 
-    this->numEdges = numEdges;
+        for ( int i = 0; i < cw * ch; i++ )
+            clabels[i] = coarse->dsf->find(i);
 
+        // band around the projected boundaries
+        pyramidBand( &clabels[0], cw, ch, levels, w, h, band, &inBand[0] );
+    }
+    catch( const std::bad_alloc& )
+    {
+        throw "GreedyGraphSeg :: segmentPyramid - out of memory!";
+    }
 
-    // segment the graph and create a DSF
+    // bulk-assign the interior pixels, one representative node per coarse region
+    this->masked = false;
     dsf->reset();
-    //this->segmentGraph( (image.cols) * (image.rows), numEdges );
-    //this->segmentGraph3( (image.cols) * (image.rows), numEdges );
+    for ( int i = 0; i < w * h; i++ )
+        thresholds[i] = THRESHOLD(1, this->threshold );
+
+    for ( int y = 0; y < h; y++ )
+    {
+        int cyw = ( y >> levels ) * cw;
+        for ( int x = 0, i = y * w; x < w; x++, i++ )
+        {
+            if( inBand[i] )
+                continue;
+
+            int c = clabels[ cyw + ( x >> levels ) ];
+            if( rep[c] < 0 )
+                rep[c] = i;
+            else
+                dsf->join( dsf->find( rep[c] ), i );
+        }
+    }
+
+    for ( int c = 0; c < cw * ch; c++ )
+        if( rep[c] >= 0 )
+            thresholds[ dsf->find( rep[c] ) ] = coarse->thresholds[c];
+
+    // full resolution edges around the boundaries
+    DistL2 metric;
+    if( this->keyEdges() )
+    {
+        BucketKeySink out( this->ckeys, this->bucketStart, this->weightMode, this->weightStep );
+        buildGraphBand<Vec3b>( image, metric, &inBand[0], out );
+        out.startScatter();
+        this->numEdges = buildGraphBand<Vec3b>( image, metric, &inBand[0], out );
+    }
+    else if( compact )
+    {
+        GridEdgeSink out( this->cedges );
+        this->numEdges = buildGraphBand<Vec3b>( image, metric, &inBand[0], out );
+    }
+    else
+    {
+        EdgeSink out( this->edges );
+        this->numEdges = buildGraphBand<Vec3b>( image, metric, &inBand[0], out );
+    }
+    this->segmentGraph2( w * h, this->numEdges );
 
     // eliminate small components
     this->postProcess();
-
 }
 
 /**
@@ -143,32 +523,12 @@ void  GreedyGraphSeg :: segmentGraph( int numVertices,  int numEdges )
 
     int i;
 
-    // sort edges by weight
-    std::sort(edges, edges + numEdges );
-
     // initialize threshols
     for (i = 0; i < numVertices; i++)
 	    thresholds[i] = THRESHOLD(1, this->threshold );
 
-
-    // for each edge, in non-decreasing weight order...
-    edge* pedge = 0;
-    for (i = 0; i < numEdges; i++) {
-
-	    pedge = &edges[i];
-
-		// components conected by this edge
-		int a = dsf -> find( pedge->a );
-		int b = dsf -> find( pedge->b );
-		if ( a != b ) {
-		    if ( ( pedge->w <= thresholds[a] ) && ( pedge->w <= thresholds[b] ) ) {
-			    dsf->join(a, b);
-				a = dsf->find(a);
-				thresholds[a] = pedge->w + THRESHOLD( dsf->setSize(a), this->threshold );
-		    }
-	    }
-    }
-
+    // sort edges by weight, merge in non-decreasing weight order
+    this->segmentGraph2( numVertices, numEdges );
 }
 
 /**
@@ -183,36 +543,153 @@ void  GreedyGraphSeg :: segmentGraph( int numVertices,  int numEdges )
  **/
 void  GreedyGraphSeg :: segmentGraph2( int numVertices,  int numEdges ) {
 
-    int i;
+    // stop request before the sort
+    if( stopRequested() )
+        return;
 
-    // sort edges by weight
-    std::sort(edges, edges + numEdges );
+    if( weightMode != WEIGHTS_FLOAT )
+    {
+        this->segmentBuckets( numEdges );
+        return;
+    }
 
-    // initialize threshols
-    //for (i = 0; i < numVertices; i++)
-	//    thresholds[i] = THRESHOLD(1, this->threshold );
+    // sort edges by weight, then for each edge, in non-decreasing weight order...
+    {
+        PerfScope scope( this->profiler, "egbs sort", numEdges );
+        if( compact )
+            std::sort( cedges, cedges + numEdges );
+        else
+            std::sort( edges, edges + numEdges );
+    }
 
+    PerfScope scope( this->profiler, "egbs merge", numEdges );
+    if( compact )
+        this->mergeEdges( GridEdgeArray( cedges, width, masked ? nodeMap : NULL ), numEdges );
+    else
+        this->mergeEdges( EdgeArray( edges ), numEdges );
+
+}
+
+/**
+ * the sorted edges (or buckets) are kept by segmentGraph2, only the DSF and
+ * the thresholds are reset
+ */
+int GreedyGraphSeg :: replayMerge( float threshold )
+{
+    if( !this->replayable || !dsf )
+        throw "GreedyGraphSeg :: replayMerge - no sorted graph to replay!";
+    if( threshold < 1.0f )
+        throw "GreedyGraphSeg :: replayMerge - Illegal threshold for segmentation!";
 
-    // for each edge, in non-decreasing weight order...
-    edge* pedge = 0;
-    for (i = 0; i < numEdges; i++) {
+    this->threshold = threshold;
+    this->interrupted = false;
 
-	    pedge = &edges[i];
+    int numNodes = dsf->getNumElements();
+    dsf->reset( numNodes );
+    for ( int i = 0; i < numNodes; i++ )
+        thresholds[i] = THRESHOLD(1, this->threshold );
 
-		// components conected by this edge
-		int a = dsf -> find( pedge->a );
-		int b = dsf -> find( pedge->b );
-		if ( a != b ) {
-		    if ( ( pedge->w <= thresholds[a] ) && ( pedge->w <= thresholds[b] ) ) {
-			    dsf->join(a, b);
-				a = dsf->find(a);
-				thresholds[a] = pedge->w + THRESHOLD( dsf->setSize(a), this->threshold );
-		    }
-	    }
+    {
+        PerfScope scope( this->profiler, "egbs merge", numEdges );
+        if( weightMode != WEIGHTS_FLOAT )
+        {
+            if( this->keyEdges() )
+                this->mergeBuckets( GridKeyArray( ckeys, width, masked ? nodeMap : NULL ) );
+            else if( compact )
+                this->mergeBuckets( GridEdgeArray( cedges, width, masked ? nodeMap : NULL ) );
+            else
+                this->mergeBuckets( EdgeArray( edges ) );
+        }
+        else if( compact )
+            this->mergeEdges( GridEdgeArray( cedges, width, masked ? nodeMap : NULL ), numEdges );
+        else
+            this->mergeEdges( EdgeArray( edges ), numEdges );
     }
 
-}
-
+    this->postProcess();
+    return this->interrupted ? -1 : dsf->numSets();
+}
+
+/// replayMerge for searchRegionCount
+struct ThresholdReplay
+{
+    GreedyGraphSeg* seg;
+
+    ThresholdReplay( GreedyGraphSeg* seg ) : seg(seg) {}
+    int operator()( float threshold ) { return seg->replayMerge( threshold ); }
+};
+
+float GreedyGraphSeg :: segmentToCount( const ImageView& image, int numRegions, int maxReplays )
+{
+    if( numRegions < 1 )
+        throw "GreedyGraphSeg :: segmentToCount - Illegal number of regions!";
+
+    float start = this->threshold;
+    this->segmentImageColor( image );
+    if( this->interrupted || image.empty() )
+        return start;
+
+    ThresholdReplay replay( this );
+    float best = searchRegionCount( replay, start, dsf->numSets(), numRegions, false, 1.0f, maxReplays );
+
+    this->threshold = start;
+    return best;
+}
+
+/// bucket of an edge, after the weights are replaced by their buckets
+struct EdgeBucket
+{
+    int operator()( const edge& e ) const { return (int)e.w; }
+    int operator()( const gridedge& e ) const { return (int)gridEdgeWeight( e ); }
+};
+
+/**
+ * linear time sort and merge: replace the weights by their buckets, bucket sort,
+ * merge bucket by bucket; the thresholds must be initialized
+ */
+void  GreedyGraphSeg :: segmentBuckets( int numEdges )
+{
+    int i, b, maxBucket = 0;
+    if( this->keyEdges() )
+    {
+        // the keys were sorted into their buckets while building the graph
+        PerfScope scope( this->profiler, "egbs merge", numEdges );
+        this->mergeBuckets( GridKeyArray( ckeys, width, masked ? nodeMap : NULL ) );
+    }
+    else if( compact )
+    {
+        for ( i = 0; i < numEdges; i++ )
+        {
+            b = weightBucket( gridEdgeWeight( cedges[i] ) );
+            cedges[i] = packGridEdge( (float)b, gridEdgeKey( cedges[i] ) );
+            maxBucket = max( maxBucket, b );
+        }
+
+        {
+            PerfScope scope( this->profiler, "egbs sort", numEdges );
+            bucketSort( cedges, numEdges, maxBucket + 1, bucketStart, EdgeBucket() );
+        }
+        PerfScope scope( this->profiler, "egbs merge", numEdges );
+        this->mergeBuckets( GridEdgeArray( cedges, width, masked ? nodeMap : NULL ) );
+    }
+    else
+    {
+        for ( i = 0; i < numEdges; i++ )
+        {
+            b = weightBucket( edges[i].w );
+            edges[i].w = (float)b;
+            maxBucket = max( maxBucket, b );
+        }
+
+        {
+            PerfScope scope( this->profiler, "egbs sort", numEdges );
+            bucketSort( edges, numEdges, maxBucket + 1, bucketStart, EdgeBucket() );
+        }
+        PerfScope scope( this->profiler, "egbs merge", numEdges );
+        this->mergeBuckets( EdgeArray( edges ) );
+    }
+}
+
 void  GreedyGraphSeg :: segmentGraph3( int numVertices,  int numEdges )
 {
     int i;
@@ -271,131 +748,18 @@ void  GreedyGraphSeg :: segmentGraph3( int numVertices,  int numEdges )
  *  eliminate small regions by merging
  */
 void GreedyGraphSeg :: postProcess( ){
-    int i, a, b;
-    // post process small components
-    for ( i = 0; i < this->numEdges; i++ ) {
-        a = dsf->find( edges[i].a );
-        b = dsf->find( edges[i].b );
-        if ( (a != b) && ( (dsf->setSize(a) < minSize) || ( dsf->setSize(b) < minSize)))
-            dsf->join(a, b);
-    }
-
-}
-
-/**
- * Build graph, 4 connected
- */
-int GreedyGraphSeg :: buildGraph4( Mat& image ){
-
-    int width = image.cols;
-    int height = image.rows;
-
-    int numEdges = 0;
-    int yw = 0;     //y * width
-    int ywx = 0;    //y * width + x
-    int x,y;
-    for (y = 0; y < height; y++) {
-
-        yw = y * width;
-        for (x = 0; x < width; x++) {
-
-            ywx = yw + x;
-            if ( x < width - 1 ) {
-                this->edges[numEdges].a = ywx;        //	y * width + x
-                this->edges[numEdges].b = ywx + 1;    //  y * width + (x + 1)
-
-	            Vec3b& pix1 = image.at<Vec3b>(y, x);
-	            Vec3b& pix2 = image.at<Vec3b>(y, x+1);
-	            this->edges[numEdges].w = distance( pix1, pix2 );
-	            numEdges++;
-            }
-
-            if ( y < height - 1 ) {
-                this->edges[numEdges].a = ywx;            // y * width + x;
-                this->edges[numEdges].b = ywx + width;    // (y+1) * width + x;
-	            Vec3b& pix1 = image.at<Vec3b>(y, x);
-	            Vec3b& pix2 = image.at<Vec3b>(y+1, x);
-	            this->edges[numEdges].w = distance( pix1, pix2 );
-	            numEdges++;
-            }
-
-        }
-    }
-
-    return numEdges;
-}
-
-
-/**
- * Build graph, 8 connected
- */
-int GreedyGraphSeg :: buildGraph8( Mat& image )
-{
-    int width = image.cols;
-    int height = image.rows;
-
-    int numEdges = 0;
-    int yw = 0;     //y * width
-    int ywx = 0;    //y * width + x
-    int x,y;
-    for (y = 0; y < height; y++) {
-
-        yw = y * width;
-        for (x = 0; x < width; x++) {
-
-            ywx = yw + x;
-            if ( x < width - 1 ) {
-                this->edges[numEdges].a = ywx;        //	y * width + x
-                this->edges[numEdges].b = ywx + 1;    //  y * width + (x + 1)
-	            Vec3b& pix1 = image.at<Vec3b>(y, x);
-	            Vec3b& pix2 = image.at<Vec3b>(y, x+1);
-	            this->edges[numEdges].w = distance( pix1, pix2 );
-	            numEdges++;
-            }
-
-            if (y < height-1) {
-                this->edges[numEdges].a = ywx;            // y * width + x;
-                this->edges[numEdges].b = ywx + width;    // (y+1) * width + x;
-	            Vec3b& pix1 = image.at<Vec3b>(y, x);
-	            Vec3b& pix2 = image.at<Vec3b>(y+1, x);
-	            this->edges[numEdges].w = distance( pix1, pix2 );
-	            numEdges++;
-            }
-
-            if ((x < width-1) && (y < height-1)) {
-                this->edges[numEdges].a = ywx;            // y * width + x;
-	            this->edges[numEdges].b = ywx + width + 1;    // (y+1) * width + (x + 1);
-	            Vec3b& pix1 = image.at<Vec3b>(y, x);
-	            Vec3b& pix2 = image.at<Vec3b>(y+1, x+1);
-	            this->edges[numEdges].w = distance( pix1, pix2 );
-	            numEdges++;
-            }
-
-            if ((x < width-1) && (y > 0)) {
-	            this->edges[numEdges].a = ywx;            // y * width + x;
-	            this->edges[numEdges].b = ywx - width + 1;    // (y-1) * width + (x + 1);
-	            Vec3b& pix1 = image.at<Vec3b>(y, x);
-	            Vec3b& pix2 = image.at<Vec3b>(y-1, x+1);
-	            this->edges[numEdges].w = distance( pix1, pix2 );
-	            numEdges++;
-            }
-        }
-    }
-
-    return numEdges;
-}
-
-/**
- * distance between two pixels
- */
-inline float GreedyGraphSeg :: distance(Vec3b& pix1, Vec3b& pix2)
-{
-    return sqrt( square( pix1[0] - pix2[0] ) + square( pix1[1] - pix2[1] ) + square( pix1[2] - pix2[2] ) );
-}
+    // not after a stop request, the partial result is kept as is
+    if( interrupted )
+        return;
 
-inline float GreedyGraphSeg :: distance(Vec3f& pix1, Vec3f& pix2)
-{
-    return sqrt( square( pix1[0] - pix2[0] ) + square( pix1[1] - pix2[1] ) + square( pix1[2] - pix2[2] ) );
+    // post process small components
+    PerfScope scope( this->profiler, "egbs small", this->numEdges );
+    if( this->keyEdges() )
+        this->mergeSmall( GridKeyArray( ckeys, width, masked ? nodeMap : NULL ), this->numEdges );
+    else if( compact )
+        this->mergeSmall( GridEdgeArray( cedges, width, masked ? nodeMap : NULL ), this->numEdges );
+    else
+        this->mergeSmall( EdgeArray( edges ), this->numEdges );
 }
 
 /// 0 ... numComps-1
@@ -408,35 +772,29 @@ void GreedyGraphSeg :: getLabels( Mat& labels )
 	int w = this->width;
     int h = this->height;
 
-    if(labels.empty())
-        labels.create(h, w, CV_8UC1 );
+    labels.create(h, w, CV_8UC1 );     // no-op if already h x w of this type
 
-    vector <int> sids;
+    // label of each root, in raster order of first appearance
+    vector<int> rootLabel( dsf->getNumElements(), -1 );
+    int numLabels = 0;
 
-    bool found;
     int s;
     int yw;
     for ( int y = 0; y < h; y++ ) {
         yw = y * w;
         for ( int x = 0; x < w; x++ ) {
 
-          int comp = dsf->find(yw + x);
-          found = false;
-          for ( int k = sids.size() - 1; k >= 0 ; k-- ){
-              if( comp == sids[k] ){
-                  found = true;
-                  s = k;
-
-                  break;
-              }
-          }
-
-          if( !found )
+          int comp = findPixel(yw + x);
+          if( comp < 0 )
           {
-              sids.push_back( comp );
-              s = (int)sids.size() - 1;
+              labels.at<uchar>(y,x) = 255;
+              continue;
           }
 
+          if( rootLabel[comp] < 0 )
+              rootLabel[comp] = numLabels++;
+          s = rootLabel[comp];
+
           // give label to this pixel, single band image
           // labels start from 0, id of the component
           labels.at<uchar>(y,x) = (uchar)s;
@@ -455,35 +813,29 @@ void GreedyGraphSeg :: getLabelsInt( Mat& labels )
 	int w = this->width;
     int h = this->height;
 
-    if(labels.empty())
-        labels.create(h, w, CV_32SC1 );
+    labels.create(h, w, CV_32SC1 );     // no-op if already h x w of this type
 
-    vector <int> sids;
+    // label of each root, in raster order of first appearance
+    vector<int> rootLabel( dsf->getNumElements(), -1 );
+    int numLabels = 0;
 
-    bool found;
     int s;
     int yw;
     for ( int y = 0; y < h; y++ ) {
         yw = y * w;
         for ( int x = 0; x < w; x++ ) {
 
-          int comp = dsf->find(yw + x);
-          found = false;
-          for ( int k = sids.size() - 1; k >= 0 ; k-- ){
-              if( comp == sids[k] ){
-                  found = true;
-                  s = k;
-
-                  break;
-              }
-          }
-
-          if( !found )
+          int comp = findPixel(yw + x);
+          if( comp < 0 )
           {
-              sids.push_back( comp );
-              s = (int)sids.size() - 1;
+              labels.at<int>(y,x) = -1;
+              continue;
           }
 
+          if( rootLabel[comp] < 0 )
+              rootLabel[comp] = numLabels++;
+          s = rootLabel[comp];
+
           // give label to this pixel, single band image
           // labels start from 0, id of the component
           labels.at<int>(y,x) = s;
@@ -493,6 +845,74 @@ void GreedyGraphSeg :: getLabelsInt( Mat& labels )
 
 }
 
+/**
+ * labels as per-row runs, straight from the DSF (no dense map);
+ * the same labels as getLabelsInt: 0 .. numComps-1, -1 for inactive pixels
+ */
+void GreedyGraphSeg :: getLabelRuns( LabelRuns& runs )
+{
+    if( !dsf )
+        throw "Null pointer, dsf! GreedyGraphSeg::getLabelRuns()";
+
+    int w = this->width;
+    int h = this->height;
+    runs.create( w, h );
+
+    // component root -> label, in raster order of first appearance
+    vector<int> rootLabel( dsf->getNumElements(), -1 );
+    int numLabels = 0;
+
+    for ( int y = 0; y < h; y++ )
+    {
+        int yw = y * w;
+        int x0 = 0;
+        int comp = findPixel( yw );
+        for ( int x = 1; x <= w; x++ )
+        {
+            int next = ( x < w ) ? findPixel( yw + x ) : -2;
+            if( next == comp )
+                continue;
+
+            int label = -1;
+            if( comp >= 0 )
+            {
+                if( rootLabel[comp] < 0 )
+                    rootLabel[comp] = numLabels++;
+                label = rootLabel[comp];
+            }
+
+            runs.addRun( x0, x - x0, label );
+            x0 = x;
+            comp = next;
+        }
+        runs.endRow();
+    }
+}
+
+/**
+ * closed region contours (outer boundaries and holes), polygons on the pixel
+ * corners, simplified with max deviation `epsilon` if > 0 (Douglas-Peucker)
+ */
+void GreedyGraphSeg :: getContours( vector<RegionContour>& contours, double epsilon )
+{
+    LabelRuns runs;
+    this->getLabelRuns( runs );
+
+    Mat labels;
+    runs.toMat( labels );
+    traceContours( labels.ptr<int>(0), this->width, this->height, this->connect, contours );
+
+    if( epsilon <= 0.0 )
+        return;
+
+    vector<Point> simplified;
+    for ( size_t i = 0; i < contours.size(); i++ )
+    {
+        simplifyPolygon( contours[i].points, epsilon, simplified );
+        contours[i].points.swap( simplified );
+    }
+}
+
 /**
  * draw the boundaries of the segments with the given color on dst image
  */
@@ -515,9 +935,9 @@ void GreedyGraphSeg :: drawSegmentBoundaries( Mat& dst, Scalar bcolor )
     {
         for ( int x = 0; x < w - 1 ; x++ )
         {
-            cid = dsf->find(y * w + x);
-            cidx = dsf->find(y * w + x + 1);      // right pixel
-            cidy = dsf->find( (y + 1) * w + x);   // bottom pixel
+            cid = findPixel(y * w + x);
+            cidx = findPixel(y * w + x + 1);      // right pixel
+            cidy = findPixel( (y + 1) * w + x);   // bottom pixel
 
             flag = false;
             if(cid != cidx)
@@ -545,3 +965,57 @@ void GreedyGraphSeg :: drawSegmentBoundaries( Mat& dst, Scalar bcolor )
     }
 
 }
+
+/**
+ * mean color image: sum the pixels per region (flattened forest), then paint the rows
+ */
+void GreedyGraphSeg :: renderMeans( const ImageView& image, Mat& dst )
+{
+    if( !dsf )
+        throw "Null pointer, dsf! GreedyGraphSeg::renderMeans()";
+
+    if( image.depth != CV_8U || image.width != this->width || image.height != this->height )
+        throw "GreedyGraphSeg :: renderMeans - the segmented 8-bit image expected!";
+
+    LabelSnapshot snapshot;
+    snapshot.build( *this->dsf );
+
+    int nc = ( image.channels() == 1 ) ? 1 : 3;
+    int numLabels = snapshot.getNumLabels();
+    vector<long long> sums( nc * (size_t)numLabels, 0 );
+    switch( image.channels() )
+    {
+        case 1:  this->sumRegions<uchar>( image, snapshot, nc, sums ); break;
+        case 4:  this->sumRegions<Vec4b>( image, snapshot, nc, sums ); break;
+        default: this->sumRegions<Vec3b>( image, snapshot, nc, sums ); break;
+    }
+
+    // mean of each region, rounded
+    vector<uchar> colors( nc * (size_t)numLabels );
+    for ( int l = 0; l < numLabels; l++ )
+    {
+        long long size = snapshot.labelSize( l );
+        for ( int c = 0; c < nc; c++ )
+            colors[ nc * l + c ] = (uchar)( ( sums[ nc * l + c ] + size / 2 ) / size );
+    }
+
+    int w = this->width;
+    int h = this->height;
+    dst.create( h, w, nc == 1 ? CV_8UC1 : CV_8UC3 );
+
+    const int* map = this->masked ? this->nodeMap : 0;
+    const int* labels = snapshot.getLabels();
+#ifdef _OPENMP
+    #pragma omp parallel for num_threads(this->numThreads) schedule(static) if(this->numThreads > 1)
+#endif
+    for ( int y = 0; y < h; y++ )
+    {
+        uchar* drow = dst.ptr<uchar>(y);
+        for ( int x = 0, p = y * w; x < w; x++, p++ )
+        {
+            int node = map ? map[p] : p;
+            for ( int c = 0; c < nc; c++ )
+                drow[ nc * x + c ] = ( node < 0 ) ? 0 : colors[ nc * labels[node] + c ];
+        }
+    }
+}
@@ -11,15 +11,102 @@
 #ifndef __GreedyGraphSeg__H__
 #define __GreedyGraphSeg__H__
 
+#include <algorithm>
+#include <new>
 #include <vector>
 
 #include "opencv2/core/core.hpp"
 
+#include "CancelToken.h"
+#include "Contours.h"
 #include "DisjointSet.h"
+#include "Distance.h"
 #include "Edge.h"
+#include "GridEdge.h"
+#include "GridGraph.h"
+#include "ImageView.h"
+#include "LabelRuns.h"
+#include "LabelSnapshot.h"
+#include "NodeMap.h"
+#include "PerfProfiler.h"
+#include "RegionCount.h"
+#include "RowSmoother.h"
 
 using namespace cv;
 
+/// edge weight processing in GreedyGraphSeg, see setWeightMode()
+enum WeightMode
+{
+    WEIGHTS_FLOAT = 0,      // float weights, comparison sort (default)
+    WEIGHTS_QUANTIZED,      // weights rounded to multiples of a step, up to 65535 steps
+    WEIGHTS_SQUARED         // exact squared distances, for integer valued distances
+};
+
+/// max bucket of the quantized weights, 16-bit
+#define MAX_WEIGHT_STEPS 65535
+/// max bucket of the squared weights
+#define MAX_SQUARED_WEIGHT ( ( 1 << 20 ) - 1 )
+
+/// bucket of the weight w >= 0: WEIGHTS_QUANTIZED (multiples of step) or WEIGHTS_SQUARED
+inline int weightToBucket( float w, int mode, float step )
+{
+    double b;
+    if( mode == WEIGHTS_QUANTIZED )
+    {
+        b = w / step + 0.5;
+        return ( b < MAX_WEIGHT_STEPS ) ? (int)b : MAX_WEIGHT_STEPS;
+    }
+
+    b = (double)w * w + 0.5;
+    return ( b < MAX_SQUARED_WEIGHT ) ? (int)b : MAX_SQUARED_WEIGHT;
+}
+
+/// graph builder output of compact edges in the bucket weight modes: grid keys only,
+/// counting sorted by bucket (as SRMSeg's DeltaKeySink). The graph is built twice: the
+/// first pass counts the edges per bucket, startScatter() turns the counts into the bucket
+/// offsets (bucket b: keys[ start[b] .. start[b+1]-1 ]), the second pass computes the
+/// weights again and stores each key in its bucket, in the order of the builder
+struct BucketKeySink
+{
+    gridkey* keys;
+    std::vector<int>& start;
+    std::vector<int> next;
+    int mode;
+    float step;
+    bool scatter;
+    int n;
+
+    BucketKeySink( gridkey* keys, std::vector<int>& start, int mode, float step )
+        : keys(keys), start(start), mode(mode), step(step), scatter(false), n(0)
+    {
+        start.assign( 1, 0 );
+    }
+
+    void operator()( int p, int dir, int, int, float w )
+    {
+        int b = weightToBucket( w, mode, step );
+        if( scatter )
+            keys[ next[b]++ ] = gridKey( p, dir );
+        else
+        {
+            if( b + 1 >= (int)start.size() )
+                start.resize( b + 2, 0 );
+            start[b + 1]++;
+        }
+        n++;
+    }
+
+    /// after counting: bucket offsets, then store the keys
+    void startScatter()
+    {
+        for ( size_t b = 1; b < start.size(); b++ )
+            start[b] += start[b - 1];
+        next.assign( start.begin(), start.end() - 1 );
+        scatter = true;
+        n = 0;
+    }
+};
+
 class GreedyGraphSeg
 {
 public:
@@ -33,12 +120,51 @@ public:
 
 	void setParameters( int minsize = 100, float threshold = 300.0f, int connectivity = 4 );
 
-    /// color only segmentation
-    void segmentImageColor( Mat& image );
+    /// color only segmentation (8-bit gray, BGR/RGB or BGRA/RGBA image, L2 distance)
+    /// a cv::Mat or a view of any buffer (ImageView), the image is not modified
+    /// the image is pre-smoothed if set by setSmoothing()
+    void segmentImageColor( const ImageView& image );
+
+    /// pre-smoothing in segmentImageColor: SMOOTH_NONE, SMOOTH_GAUSSIAN (sigma) or SMOOTH_MEDIAN3
+    /// fused into graph building, the smoothed image is never stored (see RowSmoother)
+    void setSmoothing( int type, float sigma = 0.8f );
+
+    /// segmentation with the distance functor `metric` (see Distance.h);
+    /// `image` is any per-pixel feature plane of type `Pixel`,
+    /// e.g., segmentImage<Vec3f>( lab, DistLab() )
+    template< typename Pixel, typename Metric >
+    void segmentImage( const ImageView& image, Metric metric = Metric() );
+
+    /// segmentation restricted to the active pixels: mask(y,x) != 0 (CV_8UC1, optional)
+    /// and inside one of `rois` (optional); graph nodes and edges are built only for
+    /// the active pixels (compact node ids), inactive pixels get label -1
+    template< typename Pixel, typename Metric >
+    void segmentImageMasked( const ImageView& image, const Mat& mask,
+                             const std::vector<Rect>& rois = std::vector<Rect>(), Metric metric = Metric() );
+    void segmentImageColor( const ImageView& image, const Mat& mask, const std::vector<Rect>& rois = std::vector<Rect>() );
+
+    /// coarse-to-fine (preview) segmentation: segment the image downscaled by 2^levels,
+    /// project the labels up, bulk-assign the interior pixels and re-evaluate the
+    /// full resolution edges only within `band` coarse pixels of the projected boundaries
+    /// (8-bit BGR/RGB image); throws if 2^levels exceeds the width or the height
+    void segmentPyramid( const ImageView& image, int levels = 2, int band = 1 );
 
     // eliminate small regions by merging
     void postProcess( );
 
+    /// merge phase again with another threshold, on the graph of the last segmentImage*
+    /// (built and sorted, not rebuilt): components merged, then small components;
+    /// returns the number of components, -1 if stopped by the cancel token.
+    /// Throws after segmentPyramid or a segmentation stopped before its sort
+    int replayMerge( float threshold );
+
+    /// color only segmentation (see segmentImageColor) into about `numRegions` components:
+    /// one graph build and sort, then replayMerge with the threshold searched from the
+    /// current one (see RegionCount.h), at most `maxReplays` replays; the segmentation
+    /// with the closest number of components is kept. Returns its threshold
+    /// (the threshold of setParameters is not changed)
+    float segmentToCount( const ImageView& image, int numRegions, int maxReplays = 16 );
+
     /// increment amount for edge weight, when joining 2 sets,
     /// used in segmentGraph
     float edgeThresh(int size){ return threshold/size; }
@@ -46,30 +172,149 @@ public:
     float edgeThresh3(int size){ return threshold/(expf(size)); }
 
     /// input: labeled, single band image; populated with labels [0..#components -1]
-    // (upto 255 components), may overfow!!
+    // (upto 255 components), may overfow!! (masked: inactive pixels are 255, -1 in getLabelsInt)
 	void getLabels( Mat& labels );
 	// integer labels
     void getLabelsInt(Mat& labels);
+    /// labels as per-row runs (see LabelRuns), built from the DSF without a dense map;
+    /// no label limit, same labels as getLabelsInt
+    void getLabelRuns( LabelRuns& runs );
+    /// closed region contours, outer boundaries and holes (see Contours.h), in one raster
+    /// pass with crack following; polygons simplified if epsilon > 0 (Douglas-Peucker)
+    void getContours( std::vector<RegionContour>& contours, double epsilon = 0.0 );
 
     /// draw the segment boundaries with the given color
     void drawSegmentBoundaries( Mat& dst, Scalar bcolor = Scalar(255,0,0) );
 
+    /// each pixel painted with the mean color of its region in `image` (the segmented
+    /// 8-bit gray, BGR/RGB or BGRA/RGBA image): CV_8UC1 for gray, CV_8UC3 otherwise (alpha
+    /// dropped), inactive pixels (masked) are 0; one pass summing the pixels per region
+    /// over the flattened forest, one pass painting the rows on numThreads threads
+    void renderMeans( const ImageView& image, Mat& dst );
+
     /// Number of components in the current segmentation
     int getNumComps() const { return ( dsf != NULL ) ? dsf->numSets() : -1; }
 
+    /// store the edges as 32-bit grid keys (source pixel, direction) packed with
+    /// the weight, 8 bytes per edge instead of 12 (see GridEdge.h); in the bucket weight
+    /// modes (setWeightMode) the key only, 4 bytes per edge: the graph is built twice and
+    /// the keys are counting sorted by bucket (BucketKeySink); images up to 2^30 pixels
+    void setCompactEdges( bool compact );
+
+    /// Edge weight processing. WEIGHTS_QUANTIZED and WEIGHTS_SQUARED replace each
+    /// weight by an integer bucket, sort the edges by bucket in linear time (no
+    /// comparison sort) and merge bucket by bucket, with the threshold recurrence
+    /// on the bucket weight (bucket * step, or sqrt(bucket)).
+    ///
+    /// WEIGHTS_QUANTIZED: weights change by at most step/2 (weights above
+    /// 65535 * step are clamped), so the result is the exact segmentation of a graph
+    /// whose weights are off by at most step/2; a merge decision of the float path
+    /// with a margin larger than step (|w - threshold| > step) is kept, as long as
+    /// the earlier merges are the same.
+    /// WEIGHTS_SQUARED: no drift for integer valued squared distances
+    /// (8-bit pixels with DistL2, DistL1, DistLinf, up to 2^20 - 1), only the order
+    /// of the equal weight edges differs from the float path.
+    /// With compact edges, switching between the float and the bucket modes reallocates
+    /// the edges (8 or 4 bytes each).
+    void setWeightMode( int mode, float step = 1.0f / 64 );
+
+    /// threads for building the graph of all pixels and for renderMeans (OpenMP, 1: serial, default);
+    /// the results do not depend on the number of threads; smoothed, masked,
+    /// tiled/Morton ordered and pyramid graphs, and compact edges in the bucket weight
+    /// modes are built serially
+    void setNumThreads( int n ) { numThreads = ( n < 1 ) ? 1 : n; }
+
+    /// stop request checked while segmenting (see CancelToken.h), NULL: none (default);
+    /// the token must stay alive while this segmenter uses it
+    void setCancelToken( const CancelToken* token ) { cancelToken = token; }
+    /// true if the last segmentation was stopped by the cancel token: partial
+    /// result, the merges up to the stop, no small component merging
+    bool wasInterrupted() const { return interrupted; }
+
+    /// profile the phases (build, sort, merge, small components) into `profiler`
+    /// (see PerfProfiler.h), NULL: no profiling (default); one profiler per thread
+    void setProfiler( PerfProfiler* profiler ) { this->profiler = profiler; }
+
+    /// graph node numbering of the pixels (NodeOrder, see NodeMap.h): ORDER_RASTER
+    /// (default), ORDER_TILED or ORDER_MORTON in tile x tile blocks (Morton: power of two);
+    /// the nodes of a block are close in the DSF and the thresholds, for wide images
+    /// where raster order puts vertical neighbors a full row apart. The segmentation
+    /// is the same in any order, the labels are mapped back to raster order on output;
+    /// segmentPyramid always uses raster order
+    void setNodeOrder( int order, int tile = 64 );
+
+    /// bytes allocated for a width x height image: by allocate(), edges (12 bytes, compact:
+    /// 8 bytes each, 4 bytes in the bucket weight modes), DSF and thresholds; nodeMap: plus
+    /// the node map of masked or tiled/Morton ordered segmentation (4 bytes per pixel);
+    /// pyramidLevels > 0: plus the coarse segmenter of segmentPyramid (1/4^levels of the
+    /// image) and its band buffers
+    static size_t memoryFootprint( int width, int height, int connect = 4, bool compact = false,
+                                   bool nodeMap = false, int weightMode = WEIGHTS_FLOAT, int pyramidLevels = 0 );
+    /// bytes allocated now: allocate(), the node map and the coarse segmenter
+    size_t memoryUsage() const;
+
+    /// hard memory budget in bytes, 0: no limit (default); compact edges are used if the
+    /// full edges do not fit, and allocate() throws if the compact edges do not fit either;
+    /// the node map and the segmentPyramid storage, allocated on first use, throw if they
+    /// do not fit with the storage allocated before
+    void setMemoryBudget( size_t bytes );
+    size_t getMemoryBudget() const { return memoryBudget; }
+
+    /// true if the edges are compact (requested with setCompactEdges, or for the memory budget)
+    bool compactEdges() const { return compact; }
+
 
 private:
-    /// build graph. connect: connectivity, 4 or 8
-    int buildGraph4( Mat& image );
-    int buildGraph8( Mat& image );
+    /// segment the graph of a width x height image, pixel rows from `rows` (ViewRows, SmoothedRows)
+    template< typename Pixel, typename Metric, typename Rows >
+    void segmentRows( Rows& rows, int width, int height, Metric& metric );
+    template< typename Pixel, typename Metric, typename Rows >
+    void segmentRowsMasked( Rows& rows, int width, int height, const Mat& mask,
+                            const std::vector<Rect>& rois, Metric& metric );
+
+    /// build graph. Connect: connectivity, 4 or 8 (see GridGraph.h)
+    /// edges are written to `out` (EdgeSink, GridEdgeSink, BucketKeySink)
+    template< int Connect, typename Pixel, typename Metric, typename Rows, typename Sink >
+    int buildGraphGrid( Rows& rows, int width, int height, Metric& metric, Sink& out, int y0 = 0, int y1 = -1 );
+    /// edges between the active pixels (nodeMap), inside `bounds`
+    template< typename Pixel, typename Metric, typename Rows, typename Sink >
+    int buildGraphMasked( Rows& rows, int width, int height, Metric& metric, const Rect& bounds, Sink& out );
+    /// only the edges with at least one end in the band (inBand[node] != 0)
+    template< typename Pixel, typename Metric, typename Sink >
+    int buildGraphBand( const ImageView& image, Metric& metric, const uchar* inBand, Sink& out );
+
+    /// build the graph from `rows` into edges, cedges or ckeys (compact)
+    template< typename Pixel, typename Metric, typename Rows >
+    int buildGraph( Rows& rows, int width, int height, Metric& metric );
+    /// build the graph in bands of rows on numThreads threads; each row starts at its
+    /// fixed offset (gridRowEdges), so the edge list is the same as the serial one
+    template< typename Pixel, typename Sink, typename Metric, typename Rows, typename Out >
+    int buildGraphParallel( Rows& rows, int width, int height, Metric& metric, Out* out );
 
     /// segment graph, make a dsf
     void segmentGraph( int numVertices, int numEdges);
 	void segmentGraph2( int numVertices,  int numEdges );
 	void segmentGraph3( int numVertices,  int numEdges );
 
-    inline float distance(Vec3b& pix1, Vec3b& pix2);
-    inline float distance(Vec3f& pix1, Vec3f& pix2);
+    /// merge loops of segmentGraph and postProcess, over EdgeArray or GridEdgeArray
+    template< typename Edges >
+    void mergeEdges( const Edges& e, int numEdges );
+    template< typename Edges >
+    void mergeSmall( const Edges& e, int numEdges );
+
+    /// add the pixel values of each region (`channels` sums per label of `snapshot`)
+    template< typename Pixel >
+    void sumRegions( const ImageView& image, const LabelSnapshot& snapshot, int channels, std::vector<long long>& sums );
+
+    /// bucket of weight w (WEIGHTS_QUANTIZED, WEIGHTS_SQUARED), and the weight of bucket b
+    int weightBucket( float w ) const;
+    float bucketWeight( int b ) const;
+
+    /// replace the weights by their buckets, bucket sort and merge (segmentGraph2)
+    void segmentBuckets( int numEdges );
+    /// greedy merge over the bucket sorted edges `e`, bucket b: e[ bucketStart[b] .. bucketStart[b+1]-1 ]
+    template< typename Edges >
+    void mergeBuckets( const Edges& e );
 
 
 private:
@@ -95,12 +340,481 @@ private:
     ///
     edge* edges;
 
+    /// compact mode: packed grid edges, instead of `edges`
+    /// compactRequested: setCompactEdges; compact: in use (requested, or for the memory budget)
+    bool compact;
+    bool compactRequested;
+    gridedge* cedges;
+    /// compact mode with bucket weights: grid keys only, bucket sorted (bucketStart), instead of `cedges`
+    gridkey* ckeys;
+    bool keyEdges() const { return compact && weightMode != WEIGHTS_FLOAT; }
+
+    /// memory budget of allocate(), the node map and segmentPyramid, 0: no limit
+    size_t memoryBudget;
+    /// throws `error` if `bytes` exceed the memory budget
+    void checkMemoryBudget( size_t bytes, const char* error ) const
+    {
+        if( memoryBudget && bytes > memoryBudget )
+            throw error;
+    }
+
+    /// graph building threads
+    int numThreads;
+
+    /// stop request, and whether the last segmentation stopped early
+    const CancelToken* cancelToken;
+    bool interrupted;
+
+    /// the sorted graph of the last segmentation can be replayed (replayMerge)
+    bool replayable;
+
+    /// phase profiling, or NULL
+    PerfProfiler* profiler;
+
+    /// true (and `interrupted` set) if the cancel token requests a stop
+    bool stopRequested()
+    {
+        if( !interrupted && cancelToken && cancelToken->stopRequested() )
+            interrupted = true;
+        return interrupted;
+    }
+
+    /// edge weight processing (WeightMode), quantization step, bucket offsets
+    int weightMode;
+    float weightStep;
+    std::vector<int> bucketStart;
+
     /// disjoint set forest
     DisjointSet* dsf;
 
     /// thresholds in segmentGraph
     float* thresholds;
 
+    /// segmenter for the coarse level in segmentPyramid, allocated on first use
+    GreedyGraphSeg* coarse;
+
+    /// pre-smoothing in segmentImageColor
+    int smoothType;
+    float sigma;
+    RowSmoother smoother;
+
+    /// pixel (y*width + x) -> graph node, -1 for inactive pixels
+    /// used if `masked` (mask, ROIs or node order), otherwise node = pixel; allocated on first use
+    int* nodeMap;
+    bool masked;
+
+    /// node numbering (NodeOrder) and its block size
+    int nodeOrder;
+    int orderTile;
+
+    /// graph node of pixel p, -1 if not active
+    int nodeOf( int p ) const { return masked ? nodeMap[p] : p; }
+    /// component of pixel p, -1 if not active
+    int findPixel( int p ) { int n = nodeOf(p); return ( n < 0 ) ? -1 : dsf->find(n); }
+
 };
 
+
+/**
+ * segment image with the given distance functor
+ */
+template< typename Pixel, typename Metric >
+void GreedyGraphSeg :: segmentImage( const ImageView& image, Metric metric )
+{
+    if(image.empty())
+        return;
+
+    ViewRows<Pixel> rows( image );
+    this->segmentRows<Pixel>( rows, image.width, image.height, metric );
+}
+
+/**
+ * segment the active pixels only
+ */
+template< typename Pixel, typename Metric >
+void GreedyGraphSeg :: segmentImageMasked( const ImageView& image, const Mat& mask,
+                                           const std::vector<Rect>& rois, Metric metric )
+{
+    if(image.empty())
+        return;
+
+    ViewRows<Pixel> rows( image );
+    this->segmentRowsMasked<Pixel>( rows, image.width, image.height, mask, rois, metric );
+}
+
+/**
+ * build and segment the graph, all pixels
+ */
+template< typename Pixel, typename Metric, typename Rows >
+void GreedyGraphSeg :: segmentRows( Rows& rows, int width, int height, Metric& metric )
+{
+    // tiled/Morton nodes: the node map of all pixels
+    if( this->nodeOrder != ORDER_RASTER )
+    {
+        this->segmentRowsMasked<Pixel>( rows, width, height, Mat(), std::vector<Rect>(), metric );
+        return;
+    }
+
+	if( width != this->width || height != this->height )
+	{
+		this->deallocate();
+		this->allocate( width, height );
+	}
+
+    this->masked = false;
+    this->interrupted = false;
+    this->replayable = false;
+
+    int numEdges;
+    {
+        PerfScope scope( this->profiler, "egbs build" );
+        numEdges = buildGraph<Pixel>( rows, width, height, metric );
+        scope.setItems( numEdges );
+    }
+
+    this->numEdges = numEdges;
+
+
+    // segment the graph and create a DSF
+    dsf->reset();
+    this->segmentGraph( width * height, numEdges );
+    this->replayable = !this->interrupted;
+
+    // eliminate small components
+    this->postProcess();
+}
+
+/**
+ * build and segment the graph, active pixels only
+ */
+template< typename Pixel, typename Metric, typename Rows >
+void GreedyGraphSeg :: segmentRowsMasked( Rows& rows, int width, int height, const Mat& mask,
+                                          const std::vector<Rect>& rois, Metric& metric )
+{
+    if( mask.empty() && rois.empty() && this->nodeOrder == ORDER_RASTER )
+    {
+        this->segmentRows<Pixel>( rows, width, height, metric );
+        return;
+    }
+
+	if( width != this->width || height != this->height )
+	{
+		this->deallocate();
+		this->allocate( width, height );
+	}
+
+    if( !this->nodeMap )
+    {
+        size_t bytes = (size_t)width * height * sizeof(int);
+        this->checkMemoryBudget( this->memoryUsage() + bytes,
+                                 "GreedyGraphSeg :: segmentRowsMasked - node map exceeds the memory budget!" );
+        this->nodeMap = new (std::nothrow) int[ width * height ];
+        if( !this->nodeMap )
+            throw "GreedyGraphSeg :: segmentRowsMasked - out of memory!";
+    }
+
+    Rect bounds;
+    int numNodes = buildNodeMap( mask, rois, width, height, this->nodeMap, &bounds );
+    if( this->nodeOrder != ORDER_RASTER )
+        numNodes = orderNodeMap( this->nodeOrder, this->orderTile, width, height, this->nodeMap );
+    this->masked = true;
+    this->interrupted = false;
+    this->replayable = false;
+
+    {
+        PerfScope scope( this->profiler, "egbs build" );
+        if( this->keyEdges() )
+        {
+            BucketKeySink out( this->ckeys, this->bucketStart, this->weightMode, this->weightStep );
+            buildGraphMasked<Pixel>( rows, width, height, metric, bounds, out );
+            out.startScatter();
+            this->numEdges = buildGraphMasked<Pixel>( rows, width, height, metric, bounds, out );
+        }
+        else if( compact )
+        {
+            GridEdgeSink out( this->cedges );
+            this->numEdges = buildGraphMasked<Pixel>( rows, width, height, metric, bounds, out );
+        }
+        else
+        {
+            EdgeSink out( this->edges );
+            this->numEdges = buildGraphMasked<Pixel>( rows, width, height, metric, bounds, out );
+        }
+        scope.setItems( this->numEdges );
+    }
+
+    // segment the graph and create a DSF over the active nodes
+    dsf->reset( numNodes );
+    this->segmentGraph( numNodes, this->numEdges );
+    this->replayable = !this->interrupted;
+
+    // eliminate small components
+    this->postProcess();
+}
+
+/**
+ * build the graph of all pixels, 4 or 8 connected, into the current edge storage
+ */
+template< typename Pixel, typename Metric, typename Rows >
+int GreedyGraphSeg :: buildGraph( Rows& rows, int width, int height, Metric& metric )
+{
+    if( this->keyEdges() )
+    {
+        // counting pass, then storing pass
+        BucketKeySink out( this->ckeys, this->bucketStart, this->weightMode, this->weightStep );
+        for ( int pass = 0; pass < 2; pass++ )
+        {
+            if( pass == 1 )
+                out.startScatter();
+            if( this->connect == 4 )
+                buildGraphGrid<4, Pixel>( rows, width, height, metric, out );
+            else
+                buildGraphGrid<8, Pixel>( rows, width, height, metric, out );
+        }
+        return out.n;
+    }
+
+    if( this->numThreads > 1 && Rows::randomAccess && height > 1 )
+    {
+        if( compact )
+            return buildGraphParallel<Pixel, GridEdgeSink>( rows, width, height, metric, this->cedges );
+        return buildGraphParallel<Pixel, EdgeSink>( rows, width, height, metric, this->edges );
+    }
+
+    if( compact )
+    {
+        GridEdgeSink out( this->cedges );
+        if( this->connect == 4 )
+            return buildGraphGrid<4, Pixel>( rows, width, height, metric, out );
+        return buildGraphGrid<8, Pixel>( rows, width, height, metric, out );
+    }
+
+    EdgeSink out( this->edges );
+    if( this->connect == 4 )
+        return buildGraphGrid<4, Pixel>( rows, width, height, metric, out );
+    return buildGraphGrid<8, Pixel>( rows, width, height, metric, out );
+}
+
+/**
+ * parallel build, one band of rows per thread, edges written from the fixed row offsets
+ */
+template< typename Pixel, typename Sink, typename Metric, typename Rows, typename Out >
+int GreedyGraphSeg :: buildGraphParallel( Rows& rows, int width, int height, Metric& metric, Out* out )
+{
+    std::vector<int> offset( height + 1, 0 );
+    for ( int y = 0; y < height; y++ )
+        offset[y + 1] = offset[y] + gridRowEdges( width, height, y, this->connect );
+
+    int numBands = std::min( this->numThreads, height );
+
+#ifdef _OPENMP
+    #pragma omp parallel for num_threads(numBands) schedule(static)
+#endif
+    for ( int b = 0; b < numBands; b++ )
+    {
+        int y0 = (int)( (long long)height * b / numBands );
+        int y1 = (int)( (long long)height * ( b + 1 ) / numBands );
+        Sink sink( out + offset[y0] );
+        if( this->connect == 4 )
+            buildGraphGrid<4, Pixel>( rows, width, height, metric, sink, y0, y1 );
+        else
+            buildGraphGrid<8, Pixel>( rows, width, height, metric, sink, y0, y1 );
+    }
+
+    return offset[height];
+}
+
+/**
+ * Build graph, Connect (4 or 8) connected, rows y0 .. y1-1 (y1 < 0: all rows)
+ * out( p, dir, a, b, w ): edge from pixel p in direction dir (GridDir), nodes a-b, weight w
+ */
+template< int Connect, typename Pixel, typename Metric, typename Rows, typename Sink >
+int GreedyGraphSeg :: buildGraphGrid( Rows& rows, int width, int height, Metric& metric, Sink& out, int y0, int y1 )
+{
+    if( y1 < 0 )
+        y1 = height;
+
+    return buildGridRows<Connect, Pixel>( rows, width, height, metric, out, y0, y1 );
+}
+
+/**
+ * Build graph over the active pixels, 4 or 8 connected, edge ends are node ids
+ */
+template< typename Pixel, typename Metric, typename Rows, typename Sink >
+int GreedyGraphSeg :: buildGraphMasked( Rows& rows, int width, int height, Metric& metric,
+                                        const Rect& bounds, Sink& out )
+{
+    int x,y;
+    for (y = bounds.y; y < bounds.y + bounds.height; y++) {
+
+        const Pixel* row = rows.row(y);
+        const Pixel* below = ( y < height - 1 ) ? rows.row(y+1) : 0;
+        const Pixel* above = ( y > 0 ) ? rows.row(y-1) : 0;
+        const int* nrow = this->nodeMap + y * width;
+        for (x = bounds.x; x < bounds.x + bounds.width; x++) {
+
+            int a = nrow[x];
+            if ( a < 0 )
+                continue;
+
+            int p = y * width + x;
+            if ( x < width - 1 && nrow[x + 1] >= 0 )
+	            out( p, GRID_RIGHT, a, nrow[x + 1], metric( row[x], row[x+1] ) );
+
+            if ( y < height - 1 && nrow[x + width] >= 0 )
+	            out( p, GRID_DOWN, a, nrow[x + width], metric( row[x], below[x] ) );
+
+            if ( this->connect == 8 )
+            {
+                if ( (x < width-1) && (y < height-1) && nrow[x + width + 1] >= 0 )
+                    out( p, GRID_DOWNRIGHT, a, nrow[x + width + 1], metric( row[x], below[x+1] ) );
+
+                if ( (x < width-1) && (y > 0) && nrow[x - width + 1] >= 0 )
+                    out( p, GRID_UPRIGHT, a, nrow[x - width + 1], metric( row[x], above[x+1] ) );
+            }
+        }
+    }
+
+    return out.n;
+}
+
+/**
+ * Build graph over the band around the projected boundaries (segmentPyramid),
+ * 4 or 8 connected; edges between two interior pixels are skipped
+ */
+template< typename Pixel, typename Metric, typename Sink >
+int GreedyGraphSeg :: buildGraphBand( const ImageView& image, Metric& metric, const uchar* inBand, Sink& out )
+{
+    int width = image.width;
+    int height = image.height;
+
+    int ywx = 0;    //y * width + x
+    int x,y;
+    for (y = 0; y < height; y++) {
+
+        const Pixel* row = image.ptr<Pixel>(y);
+        const Pixel* below = ( y < height - 1 ) ? image.ptr<Pixel>(y+1) : 0;
+        const Pixel* above = ( y > 0 ) ? image.ptr<Pixel>(y-1) : 0;
+        for (x = 0, ywx = y * width; x < width; x++, ywx++) {
+
+            bool in = inBand[ywx] != 0;
+
+            if ( x < width - 1 && ( in || inBand[ywx + 1] ) )
+	            out( ywx, GRID_RIGHT, ywx, ywx + 1, metric( row[x], row[x+1] ) );
+
+            if ( y < height - 1 && ( in || inBand[ywx + width] ) )
+	            out( ywx, GRID_DOWN, ywx, ywx + width, metric( row[x], below[x] ) );
+
+            if ( this->connect == 8 )
+            {
+                if ( (x < width-1) && (y < height-1) && ( in || inBand[ywx + width + 1] ) )
+                    out( ywx, GRID_DOWNRIGHT, ywx, ywx + width + 1, metric( row[x], below[x+1] ) );
+
+                if ( (x < width-1) && (y > 0) && ( in || inBand[ywx - width + 1] ) )
+                    out( ywx, GRID_UPRIGHT, ywx, ywx - width + 1, metric( row[x], above[x+1] ) );
+            }
+        }
+    }
+
+    return out.n;
+}
+
+/**
+ * sum the pixel values per region, pixel by pixel in raster order
+ */
+template< typename Pixel >
+void GreedyGraphSeg :: sumRegions( const ImageView& image, const LabelSnapshot& snapshot, int channels,
+                                   std::vector<long long>& sums )
+{
+    const int* labels = snapshot.getLabels();
+    for ( int y = 0; y < this->height; y++ )
+    {
+        const Pixel* row = image.ptr<Pixel>(y);
+        for ( int x = 0, p = y * this->width; x < this->width; x++, p++ )
+        {
+            int node = nodeOf( p );
+            if( node < 0 )
+                continue;
+
+            long long* s = &sums[ channels * (size_t)labels[node] ];
+            for ( int c = 0; c < channels; c++ )
+                s[c] += (int)PixelTraits<Pixel>::channel( row[x], c );
+        }
+    }
+}
+
+/**
+ * greedy merge over the sorted edges `e` (EdgeArray, GridEdgeArray), thresholds initialized
+ */
+template< typename Edges >
+void GreedyGraphSeg :: mergeEdges( const Edges& e, int numEdges )
+{
+    // for each edge, in non-decreasing weight order...
+    for (int i = 0; i < numEdges; i++) {
+
+        if ( ( i % CANCEL_CHECK_EDGES ) == 0 && stopRequested() )
+            return;
+
+		// components conected by this edge
+		int a = dsf -> find( e.a(i) );
+		int b = dsf -> find( e.b(i) );
+		if ( a != b ) {
+		    float w = e.w(i);
+		    if ( ( w <= thresholds[a] ) && ( w <= thresholds[b] ) ) {
+			    dsf->join(a, b);
+				a = dsf->find(a);
+				thresholds[a] = w + edgeThresh( dsf->setSize(a) );
+		    }
+	    }
+    }
+}
+
+/**
+ * greedy merge over the bucket sorted edges, one weight per bucket
+ */
+template< typename Edges >
+void GreedyGraphSeg :: mergeBuckets( const Edges& e )
+{
+    int numBuckets = (int)bucketStart.size() - 1;
+    for (int k = 0; k < numBuckets; k++) {
+
+        int end = bucketStart[k + 1];
+        if ( bucketStart[k] == end )
+            continue;
+
+        float w = bucketWeight( k );
+        for (int i = bucketStart[k]; i < end; i++) {
+
+            if ( ( ( i - bucketStart[k] ) % CANCEL_CHECK_EDGES ) == 0 && stopRequested() )
+                return;
+
+            int a = dsf -> find( e.a(i) );
+            int b = dsf -> find( e.b(i) );
+            if ( a != b && ( w <= thresholds[a] ) && ( w <= thresholds[b] ) ) {
+                dsf->join(a, b);
+                a = dsf->find(a);
+                thresholds[a] = w + edgeThresh( dsf->setSize(a) );
+            }
+        }
+    }
+}
+
+/**
+ * merge the components smaller than minSize, edges in `e`
+ */
+template< typename Edges >
+void GreedyGraphSeg :: mergeSmall( const Edges& e, int numEdges )
+{
+    int i, a, b;
+    for ( i = 0; i < numEdges; i++ ) {
+        if ( ( i % CANCEL_CHECK_EDGES ) == 0 && stopRequested() )
+            return;
+
+        a = dsf->find( e.a(i) );
+        b = dsf->find( e.b(i) );
+        if ( (a != b) && ( (dsf->setSize(a) < minSize) || ( dsf->setSize(b) < minSize)))
+            dsf->join(a, b);
+    }
+}
+
 #endif
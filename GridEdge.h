@@ -0,0 +1,113 @@
+/***************************************************************
+ * Name:      GridEdge.h
+ * Purpose:   Compact edges of grid (image) graphs
+ * Author:    segment-cpp contributors
+ * Created:   18.10.2026
+ * Copyright: segment-cpp contributors
+ * License:
+ **************************************************************/
+
+#ifndef GRIDEDGE_H_INCLUDED
+#define GRIDEDGE_H_INCLUDED
+
+#include <cstring>
+
+// In a grid graph both ends of an edge follow from the source pixel index
+// p = y*width + x and the direction of the edge, so an edge is stored as a
+// 32-bit key: (p << 2) | direction. Pixel indices up to 2^30 - 1.
+
+/// directions of the grid edges, from pixel p
+enum GridDir
+{
+    GRID_RIGHT = 0,     // p + 1
+    GRID_DOWN,          // p + width
+    GRID_DOWNRIGHT,     // p + width + 1
+    GRID_UPRIGHT        // p - width + 1
+};
+
+/// max number of pixels with grid keys
+#define GRID_MAX_PIXELS ( 1 << 30 )
+
+typedef unsigned int gridkey;
+
+/// an edge with its weight, sortable as an integer: weight in the high word, key in the low word
+typedef unsigned long long gridedge;
+
+inline gridkey gridKey( int p, int dir ) { return ( (gridkey)p << 2 ) | (gridkey)dir; }
+
+/// source pixel of the edge
+inline int gridSource( gridkey key ) { return (int)( key >> 2 ); }
+
+/// target pixel of the edge
+inline int gridTarget( gridkey key, int width )
+{
+    int p = (int)( key >> 2 );
+    switch( key & 3 )
+    {
+        case GRID_RIGHT:     return p + 1;
+        case GRID_DOWN:      return p + width;
+        case GRID_DOWNRIGHT: return p + width + 1;
+        default:             return p - width + 1;
+    }
+}
+
+/// pack weight and key; weight must be >= 0, then the float bits sort like the float
+inline gridedge packGridEdge( float w, gridkey key )
+{
+    unsigned int bits;
+    memcpy( &bits, &w, sizeof(bits) );
+    return ( (gridedge)bits << 32 ) | key;
+}
+
+inline gridkey gridEdgeKey( gridedge e ) { return (gridkey)( e & 0xFFFFFFFFu ); }
+
+inline float gridEdgeWeight( gridedge e )
+{
+    unsigned int bits = (unsigned int)( e >> 32 );
+    float w;
+    memcpy( &w, &bits, sizeof(w) );
+    return w;
+}
+
+/// graph builder output: packed grid edges
+struct GridEdgeSink
+{
+    gridedge* edges;
+    int n;
+
+    GridEdgeSink( gridedge* edges ) : edges(edges), n(0) {}
+
+    void operator()( int p, int dir, int, int, float w ) { edges[n++] = packGridEdge( w, gridKey( p, dir ) ); }
+};
+
+/// edge list access for the merge loops: packed grid edges;
+/// nodeMap maps pixels to graph nodes (masked graphs), or 0 if node = pixel
+struct GridEdgeArray
+{
+    const gridedge* edges;
+    int width;
+    const int* nodeMap;
+
+    GridEdgeArray( const gridedge* edges, int width, const int* nodeMap )
+        : edges(edges), width(width), nodeMap(nodeMap) {}
+
+    int a( int i ) const { int p = gridSource( gridEdgeKey( edges[i] ) ); return nodeMap ? nodeMap[p] : p; }
+    int b( int i ) const { int p = gridTarget( gridEdgeKey( edges[i] ), width ); return nodeMap ? nodeMap[p] : p; }
+    float w( int i ) const { return gridEdgeWeight( edges[i] ); }
+};
+
+/// edge list access for the merge loops: grid keys only, in processing order
+struct GridKeyArray
+{
+    const gridkey* keys;
+    int width;
+    const int* nodeMap;
+
+    GridKeyArray( const gridkey* keys, int width, const int* nodeMap )
+        : keys(keys), width(width), nodeMap(nodeMap) {}
+
+    int a( int i ) const { int p = gridSource( keys[i] ); return nodeMap ? nodeMap[p] : p; }
+    int b( int i ) const { int p = gridTarget( keys[i], width ); return nodeMap ? nodeMap[p] : p; }
+};
+
+#endif
@@ -0,0 +1,103 @@
+/***************************************************************
+ * Name:      GridGraph.h
+ * Purpose:   Grid graph builders, connectivity as a template parameter
+ * Author:    segment-cpp contributors
+ * Created:   18.10.2026
+ * Copyright: segment-cpp contributors
+ * License:
+ **************************************************************/
+
+#ifndef GRIDGRAPH_H_INCLUDED
+#define GRIDGRAPH_H_INCLUDED
+
+#include "GridEdge.h"
+
+// The edges of a full grid graph go from each pixel to the right, down and,
+// 8 connected, down-right and up-right. Whether a row has a row below and
+// above is known per row, so the rows are built by one of four instances of
+// buildGridRow: no border test per pixel, only the last pixel of the row
+// (down edge only) is out of the loop.
+
+/// edges from the pixels of a row, Connect (4 or 8) connected, with a row below
+/// (Below) and above (Above): per pixel of the row but the last (`interior`), and
+/// from the last pixel (`last`)
+template< int Connect, bool Below, bool Above >
+struct GridRow
+{
+    enum
+    {
+        interior = 1 + ( Below ? 1 : 0 ) + ( Connect == 8 ? ( Below ? 1 : 0 ) + ( Above ? 1 : 0 ) : 0 ),
+        last = Below ? 1 : 0
+    };
+
+    static int edges( int width ) { return interior * ( width - 1 ) + last; }
+};
+
+/// number of edges from the pixels of row y (4 or 8 connected full grid graph),
+/// in the order of the graph builders; gives the fixed start of each row in the edge list
+inline int gridRowEdges( int width, int height, int y, int connect )
+{
+    bool below = y < height - 1;
+    bool above = y > 0;
+    if( connect == 8 )
+    {
+        if( below )
+            return above ? GridRow<8, true, true>::edges( width ) : GridRow<8, true, false>::edges( width );
+        return above ? GridRow<8, false, true>::edges( width ) : GridRow<8, false, false>::edges( width );
+    }
+    return below ? GridRow<4, true, false>::edges( width ) : GridRow<4, false, false>::edges( width );
+}
+
+/**
+ * edges from the pixels of one row, starting at pixel p0 = y * width:
+ * right, down, [down-right, up-right] per pixel, down from the last pixel.
+ * out( p, dir, a, b, w ): edge from pixel p in direction dir (GridDir), nodes a-b, weight w = weight( pixel a, pixel b )
+ */
+template< int Connect, bool Below, bool Above, typename Pixel, typename Weight, typename Sink >
+inline void buildGridRow( const Pixel* row, const Pixel* below, const Pixel* above, int width, int p0,
+                          Weight& weight, Sink& out )
+{
+    int last = width - 1;
+    int p = p0;
+    for ( int x = 0; x < last; x++, p++ )
+    {
+        out( p, GRID_RIGHT, p, p + 1, weight( row[x], row[x+1] ) );
+        if( Below )
+            out( p, GRID_DOWN, p, p + width, weight( row[x], below[x] ) );
+        if( Connect == 8 && Below )
+            out( p, GRID_DOWNRIGHT, p, p + width + 1, weight( row[x], below[x+1] ) );
+        if( Connect == 8 && Above )
+            out( p, GRID_UPRIGHT, p, p - width + 1, weight( row[x], above[x+1] ) );
+    }
+    if( Below )
+        out( p, GRID_DOWN, p, p + width, weight( row[last], below[last] ) );
+}
+
+/**
+ * Build the grid graph, Connect (4 or 8) connected, rows y0 .. y1-1, pixel rows
+ * from `rows` (row(y), read as y, y+1, y-1); returns out.n
+ */
+template< int Connect, typename Pixel, typename Rows, typename Weight, typename Sink >
+int buildGridRows( Rows& rows, int width, int height, Weight& weight, Sink& out, int y0, int y1 )
+{
+    for ( int y = y0; y < y1; y++ )
+    {
+        int p0 = y * width;
+        const Pixel* row = rows.row(y);
+        const Pixel* below = ( y < height - 1 ) ? rows.row(y+1) : 0;
+        const Pixel* above = ( Connect == 8 && y > 0 ) ? rows.row(y-1) : 0;
+
+        if( below && above )
+            buildGridRow<Connect, true, true>( row, below, above, width, p0, weight, out );
+        else if( below )
+            buildGridRow<Connect, true, false>( row, below, above, width, p0, weight, out );
+        else if( above )
+            buildGridRow<Connect, false, true>( row, below, above, width, p0, weight, out );
+        else
+            buildGridRow<Connect, false, false>( row, below, above, width, p0, weight, out );
+    }
+
+    return out.n;
+}
+
+#endif
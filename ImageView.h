@@ -0,0 +1,74 @@
+/***************************************************************
+ * Name:      ImageView.h
+ * Purpose:   Read-only view of an image in a raw buffer (no copy)
+ * Author:    segment-cpp contributors
+ * Created:   18.10.2026
+ * Copyright: segment-cpp contributors
+ * License:
+ **************************************************************/
+
+#ifndef IMAGEVIEW_H_INCLUDED
+#define IMAGEVIEW_H_INCLUDED
+
+#include <cstddef>
+
+#include "opencv2/core/core.hpp"
+
+/// channel layout of the pixels in a view
+enum PixelLayout
+{
+    LAYOUT_GRAY = 0,
+    LAYOUT_BGR,
+    LAYOUT_RGB,
+    LAYOUT_BGRA,
+    LAYOUT_RGBA
+};
+
+/// number of channels of a layout
+inline int layoutChannels( int layout )
+{
+    return ( layout == LAYOUT_GRAY ) ? 1 : ( layout == LAYOUT_BGR || layout == LAYOUT_RGB ) ? 3 : 4;
+}
+
+/// an image in memory owned by someone else: camera/DMA buffers, shared memory, cv::Mat
+/// rows are `stride` bytes apart (stride >= width * pixel size), pixels are interleaved
+class ImageView
+{
+public:
+
+    ImageView() : data(0), width(0), height(0), stride(0), layout(LAYOUT_BGR), depth(CV_8U) {}
+
+    ImageView( const uchar* data, int width, int height, size_t stride,
+               int layout = LAYOUT_BGR, int depth = CV_8U )
+        : data(data), width(width), height(height), stride(stride), layout(layout), depth(depth) {}
+
+    /// view of a cv::Mat, shares its data (1 channel: gray, 3: BGR, 4: BGRA)
+    ImageView( const cv::Mat& m )
+        : data(m.data), width(m.cols), height(m.rows), stride(m.step),
+          layout( m.channels() == 1 ? LAYOUT_GRAY : m.channels() == 4 ? LAYOUT_BGRA : LAYOUT_BGR ),
+          depth( m.depth() ) {}
+
+    bool empty() const { return data == 0 || width < 1 || height < 1; }
+    int channels() const { return layoutChannels( layout ); }
+
+    /// pointer to row y, as pixels of type T
+    template< typename T >
+    const T* ptr( int y ) const { return (const T*)( data + y * stride ); }
+
+public:
+
+    const uchar* data;
+    int width;
+    int height;
+
+    /// bytes between the starts of two consecutive rows
+    size_t stride;
+
+    /// PixelLayout
+    int layout;
+
+    /// depth of a channel, CV_8U, CV_32F, ...
+    int depth;
+};
+
+#endif
@@ -0,0 +1,300 @@
+/***************************************************************
+ * Name:      LabelRuns.cpp
+ * Purpose:   Run-length encoded label maps and their compressed format
+ * Author:    segment-cpp contributors
+ * Created:   18.10.2026
+ * Copyright: segment-cpp contributors
+ * License:
+ **************************************************************/
+
+#include <climits>
+#include <cstring>
+
+#include "LabelRuns.h"
+
+using namespace std;
+
+#define LZ_MIN_MATCH    4
+#define LZ_MAX_OFFSET   65535
+#define LZ_HASH_BITS    14
+#define LZ_MAX_EXPANSION 255
+
+void LabelRuns :: create( int width, int height )
+{
+    if( width < 1 || height < 1 )
+        throw "LabelRuns :: create - Illegal width-height for label map!";
+
+    this->width = width;
+    this->height = height;
+    this->numLabels = 0;
+
+    rowStart.clear();
+    rowStart.push_back( 0 );
+    runs.clear();
+}
+
+void LabelRuns :: addRun( int x, int length, int label )
+{
+    LabelRun run;
+    run.x = x;
+    run.length = length;
+    run.label = label;
+    runs.push_back( run );
+
+    if( label >= numLabels )
+        numLabels = label + 1;
+}
+
+void LabelRuns :: toMat( Mat& labels ) const
+{
+    labels.create( height, width, CV_32SC1 );
+
+    for ( int y = 0; y < height; y++ )
+    {
+        int* lrow = labels.ptr<int>(y);
+        const LabelRun* r = row(y);
+        for ( int k = numRuns(y); k > 0; k--, r++ )
+            for ( int x = r->x; x < r->x + r->length; x++ )
+                lrow[x] = r->label;
+    }
+}
+
+/// unsigned LEB128
+static void putVarint( vector<uchar>& out, unsigned int v )
+{
+    while( v >= 0x80 )
+    {
+        out.push_back( (uchar)( v | 0x80 ) );
+        v >>= 7;
+    }
+    out.push_back( (uchar)v );
+}
+
+static unsigned int getVarint( const uchar* in, size_t size, size_t& pos )
+{
+    unsigned int v = 0;
+    for ( int shift = 0; shift < 35; shift += 7 )
+    {
+        if( pos >= size )
+            throw "LabelRuns :: decode - truncated data!";
+
+        uchar b = in[pos++];
+        v |= (unsigned int)( b & 0x7F ) << shift;
+        if( !( b & 0x80 ) )
+            return v;
+    }
+    throw "LabelRuns :: decode - malformed varint!";
+}
+
+void LabelRuns :: encode( vector<uchar>& out ) const
+{
+    // RLE stream: run lengths and labels, x is implied
+    vector<uchar> rle;
+    rle.reserve( runs.size() * 3 + height );
+    for ( int y = 0; y < height; y++ )
+    {
+        putVarint( rle, numRuns(y) );
+        const LabelRun* r = row(y);
+        for ( int k = numRuns(y); k > 0; k--, r++ )
+        {
+            putVarint( rle, r->length );
+            putVarint( rle, r->label + 1 );
+        }
+    }
+
+    out.clear();
+    out.push_back( 'L' );
+    out.push_back( 'R' );
+    out.push_back( 'L' );
+    out.push_back( '1' );
+    putVarint( out, width );
+    putVarint( out, height );
+    putVarint( out, numLabels );
+    putVarint( out, (unsigned int)rle.size() );
+
+    lzCompress( rle.empty() ? 0 : &rle[0], rle.size(), out );
+}
+
+void LabelRuns :: decode( const uchar* data, size_t size )
+{
+    if( size < 4 || memcmp( data, "LRL1", 4 ) != 0 )
+        throw "LabelRuns :: decode - not a label run stream!";
+
+    size_t pos = 4;
+    int w = (int)getVarint( data, size, pos );
+    int h = (int)getVarint( data, size, pos );
+    int nl = (int)getVarint( data, size, pos );
+    size_t rleSize = getVarint( data, size, pos );
+
+    // the header is validated before the RLE stream is allocated
+    if( w < 1 || h < 1 || nl < 0 || (long long)w * h > INT_MAX )
+        throw "LabelRuns :: decode - illegal width-height or label count!";
+
+    // an LZ byte expands to at most 255 bytes; a row is at most w runs of two 5-byte varints
+    if( rleSize > ( size - pos ) * LZ_MAX_EXPANSION || rleSize > (size_t)h * ( 5 + (size_t)w * 10 ) )
+        throw "LabelRuns :: decode - RLE stream size out of range!";
+
+    vector<uchar> rle( rleSize );
+    lzDecompress( data + pos, size - pos, rle.empty() ? 0 : &rle[0], rleSize );
+
+    this->create( w, h );
+
+    const uchar* in = rle.empty() ? 0 : &rle[0];
+    pos = 0;
+    for ( int y = 0; y < h; y++ )
+    {
+        int n = (int)getVarint( in, rleSize, pos );
+        int x = 0;
+        for ( int k = 0; k < n; k++ )
+        {
+            int length = (int)getVarint( in, rleSize, pos );
+            int label = (int)getVarint( in, rleSize, pos ) - 1;
+            if( length < 1 || length > w - x || label < -1 || label >= nl )
+                throw "LabelRuns :: decode - malformed run!";
+
+            this->addRun( x, length, label );
+            x += length;
+        }
+
+        if( x != w )
+            throw "LabelRuns :: decode - row runs do not cover the row!";
+        this->endRow();
+    }
+
+    this->numLabels = nl;
+}
+
+/// LZ sequence length: 4 bits in the token, 15: continued in bytes of 255 + last byte
+static void putLength( vector<uchar>& out, size_t len )
+{
+    for ( ; len >= 255; len -= 255 )
+        out.push_back( 255 );
+    out.push_back( (uchar)len );
+}
+
+static void putSequence( vector<uchar>& out, const uchar* literals, size_t numLiterals,
+                         size_t offset, size_t matchLength )
+{
+    size_t ml = matchLength ? matchLength - LZ_MIN_MATCH : 0;
+    uchar token = (uchar)( ( ( numLiterals < 15 ) ? numLiterals : 15 ) << 4 ) | (uchar)( ( ml < 15 ) ? ml : 15 );
+    out.push_back( token );
+    if( numLiterals >= 15 )
+        putLength( out, numLiterals - 15 );
+
+    out.insert( out.end(), literals, literals + numLiterals );
+
+    if( !matchLength )
+        return;
+
+    out.push_back( (uchar)( offset & 0xFF ) );
+    out.push_back( (uchar)( offset >> 8 ) );
+    if( ml >= 15 )
+        putLength( out, ml - 15 );
+}
+
+static inline unsigned int lzHash( const uchar* p )
+{
+    unsigned int v;
+    memcpy( &v, p, 4 );
+    return ( v * 2654435761u ) >> ( 32 - LZ_HASH_BITS );
+}
+
+/**
+ * greedy LZ77, last position of each 4-byte hash; the block ends with a
+ * literals only sequence (possibly empty)
+ */
+void lzCompress( const uchar* in, size_t size, vector<uchar>& out )
+{
+    vector<size_t> table( 1 << LZ_HASH_BITS, (size_t)-1 );
+
+    size_t anchor = 0;
+    size_t i = 0;
+    while( i + LZ_MIN_MATCH <= size )
+    {
+        unsigned int h = lzHash( in + i );
+        size_t cand = table[h];
+        table[h] = i;
+
+        if( cand == (size_t)-1 || i - cand > LZ_MAX_OFFSET || memcmp( in + cand, in + i, LZ_MIN_MATCH ) != 0 )
+        {
+            i++;
+            continue;
+        }
+
+        size_t len = LZ_MIN_MATCH;
+        while( i + len < size && in[cand + len] == in[i + len] )
+            len++;
+
+        putSequence( out, in + anchor, i - anchor, i - cand, len );
+        i += len;
+        anchor = i;
+    }
+
+    putSequence( out, in + anchor, size - anchor, 0, 0 );
+}
+
+static size_t getLength( const uchar* in, size_t inSize, size_t& ip )
+{
+    size_t len = 0;
+    uchar b;
+    do
+    {
+        if( ip >= inSize )
+            throw "lzDecompress - truncated data!";
+        b = in[ip++];
+        len += b;
+    } while( b == 255 );
+    return len;
+}
+
+size_t lzDecompress( const uchar* in, size_t inSize, uchar* out, size_t size )
+{
+    size_t ip = 0;
+    size_t op = 0;
+    while( true )
+    {
+        if( ip >= inSize )
+            throw "lzDecompress - truncated data!";
+
+        uchar token = in[ip++];
+
+        // literals
+        size_t lit = token >> 4;
+        if( lit == 15 )
+            lit += getLength( in, inSize, ip );
+
+        if( lit > inSize - ip || lit > size - op )
+            throw "lzDecompress - malformed data!";
+
+        if( lit )
+            memcpy( out + op, in + ip, lit );
+        ip += lit;
+        op += lit;
+
+        if( op == size )
+            return ip;
+
+        // match
+        if( inSize - ip < 2 )
+            throw "lzDecompress - truncated data!";
+
+        size_t offset = in[ip] | ( in[ip + 1] << 8 );
+        ip += 2;
+
+        size_t len = token & 15;
+        if( len == 15 )
+            len += getLength( in, inSize, ip );
+        len += LZ_MIN_MATCH;
+
+        if( offset == 0 || offset > op || len > size - op )
+            throw "lzDecompress - malformed data!";
+
+        const uchar* src = out + op - offset;
+        if( offset >= len )
+            memcpy( out + op, src, len );
+        else
+            for ( size_t k = 0; k < len; k++ )      // overlapping copy, repeats the last `offset` bytes
+                out[op + k] = src[k];
+        op += len;
+    }
+}
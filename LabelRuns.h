@@ -0,0 +1,84 @@
+/***************************************************************
+ * Name:      LabelRuns.h
+ * Purpose:   Run-length encoded label maps and their compressed format
+ * Author:    segment-cpp contributors
+ * Created:   18.10.2026
+ * Copyright: segment-cpp contributors
+ * License:
+ **************************************************************/
+
+#ifndef LABELRUNS_H_INCLUDED
+#define LABELRUNS_H_INCLUDED
+
+#include <cstddef>
+#include <vector>
+
+#include "opencv2/core/core.hpp"
+
+using namespace cv;
+
+/// a run of pixels with the same label in one row: x .. x+length-1
+typedef struct
+{
+    int x;
+    int length;
+    int label;
+} LabelRun;
+
+/**
+ * Label map as per-row runs, filled by the segmenters (getLabelRuns) row by row.
+ * Labels are 0 .. numLabels-1 in raster order of first appearance, -1 for
+ * inactive (masked) pixels, the same labels as getLabelsInt.
+ *
+ * Compressed format (encode/decode): "LRL1", then varints width, height,
+ * numLabels and the size of the RLE stream, then the RLE stream compressed
+ * with a byte oriented LZ77 (see lzCompress). The RLE stream is, per row,
+ * varint number of runs, then varint length and varint label+1 of each run.
+ */
+class LabelRuns
+{
+public:
+
+    LabelRuns() : width(0), height(0), numLabels(0) {}
+
+    /// empty map of the given size, rows are added with addRun / endRow
+    void create( int width, int height );
+    void addRun( int x, int length, int label );
+    void endRow() { rowStart.push_back( (int)runs.size() ); }
+
+    int getWidth() const { return width; }
+    int getHeight() const { return height; }
+    int getNumLabels() const { return numLabels; }
+    int getNumRuns() const { return (int)runs.size(); }
+
+    /// runs of row y
+    int numRuns( int y ) const { return rowStart[y + 1] - rowStart[y]; }
+    const LabelRun* row( int y ) const { return &runs[ rowStart[y] ]; }
+
+    /// dense CV_32SC1 label map
+    void toMat( Mat& labels ) const;
+
+    /// serialize to the compressed format
+    void encode( std::vector<uchar>& out ) const;
+    /// read the compressed format, throws on malformed data
+    void decode( const uchar* data, size_t size );
+
+private:
+
+    int width;
+    int height;
+    int numLabels;
+
+    /// runs of row y: runs[ rowStart[y] .. rowStart[y+1]-1 ]
+    std::vector<int> rowStart;
+    std::vector<LabelRun> runs;
+};
+
+/// byte oriented LZ77 (LZ4 like blocks): token (literal count, match length - 4),
+/// literals, 16-bit match offset; appends to `out`
+void lzCompress( const uchar* in, size_t size, std::vector<uchar>& out );
+/// decompress exactly `size` bytes into `out`, returns the compressed bytes read,
+/// throws on malformed data
+size_t lzDecompress( const uchar* in, size_t inSize, uchar* out, size_t size );
+
+#endif
@@ -0,0 +1,44 @@
+/***************************************************************
+ * Name:      LabelSnapshot.cpp
+ * Purpose:   Flattened, read-only copy of a segmentation (DSF)
+ * Author:    segment-cpp contributors
+ * Created:   18.10.2026
+ * Copyright: segment-cpp contributors
+ * License:
+ **************************************************************/
+
+#include <climits>
+
+#include "LabelSnapshot.h"
+
+template< typename Index >
+void LabelSnapshot :: build( DisjointSetT<Index>& dsf )
+{
+    if( dsf.getNumElements() > INT_MAX )
+        throw "LabelSnapshot :: build - too many nodes for int labels!";
+    int n = (int)dsf.getNumElements();
+
+    labels.assign( n, -1 );
+    sizes.clear();
+    roots.clear();
+    sizes.reserve( dsf.numSets() );
+    roots.reserve( dsf.numSets() );
+
+    // labels[root] holds the label of its set from the first node of the set on
+    for ( int i = 0; i < n; i++ )
+    {
+        int r = (int)dsf.find( i );
+        if( labels[r] < 0 )
+        {
+            labels[r] = (int)sizes.size();
+            sizes.push_back( (int)dsf.setSize( r ) );
+            roots.push_back( r );
+        }
+        labels[i] = labels[r];
+    }
+
+    numLabels = (int)sizes.size();
+}
+
+template void LabelSnapshot :: build( DisjointSetT<int>& dsf );
+template void LabelSnapshot :: build( DisjointSetT<long long>& dsf );
@@ -0,0 +1,65 @@
+/***************************************************************
+ * Name:      LabelSnapshot.h
+ * Purpose:   Flattened, read-only copy of a segmentation (DSF)
+ * Author:    segment-cpp contributors
+ * Created:   18.10.2026
+ * Copyright: segment-cpp contributors
+ * License:
+ **************************************************************/
+
+#ifndef LABELSNAPSHOT_H_INCLUDED
+#define LABELSNAPSHOT_H_INCLUDED
+
+#include <vector>
+
+#include "DisjointSet.h"
+
+/**
+ * The sets of a disjoint set forest flattened into plain arrays: dense label of
+ * each node (0 .. numLabels-1, in order of the first node of each set), and the
+ * size and DSF root of each label. DisjointSet::find compresses paths, so it
+ * writes even in a lookup; a snapshot is never written after build(), so any
+ * number of threads can query it at the same time, each query O(1).
+ */
+class LabelSnapshot
+{
+public:
+
+    LabelSnapshot() : numLabels(0) {}
+
+    /// flatten `dsf` (first dsf.getNumElements() nodes); the DSF is not referenced afterwards.
+    /// Labels are int: throws past 2^31 - 1 nodes (DisjointSet64)
+    template< typename Index >
+    void build( DisjointSetT<Index>& dsf );
+
+    int getNumNodes() const { return (int)labels.size(); }
+    int getNumLabels() const { return numLabels; }
+
+    /// dense label of node
+    int label( int node ) const { return labels[node]; }
+    /// size of the set of node
+    int size( int node ) const { return sizes[ labels[node] ]; }
+    /// DSF root of the set of node, as returned by DisjointSet::find at build time
+    int root( int node ) const { return roots[ labels[node] ]; }
+    /// true if the two nodes are in the same set
+    bool sameSet( int a, int b ) const { return labels[a] == labels[b]; }
+
+    /// size and root by label
+    int labelSize( int label ) const { return sizes[label]; }
+    int labelRoot( int label ) const { return roots[label]; }
+
+    /// labels of all the nodes, array of getNumNodes()
+    const int* getLabels() const { return labels.empty() ? 0 : &labels[0]; }
+
+private:
+
+    int numLabels;
+
+    /// per node
+    std::vector<int> labels;
+    /// per label
+    std::vector<int> sizes;
+    std::vector<int> roots;
+};
+
+#endif
@@ -0,0 +1,142 @@
+/***************************************************************
+ * Name:      NodeMap.cpp
+ * Purpose:   Pixel to graph node mapping (masked/ROI segmentation)
+ * Author:    segment-cpp contributors
+ * Created:   18.10.2026
+ * Copyright: segment-cpp contributors
+ * License:
+ **************************************************************/
+
+#include <algorithm>
+
+#include "NodeMap.h"
+
+using namespace std;
+
+/**
+ * compact node ids for the active pixels, in raster order
+ */
+int buildNodeMap( const Mat& mask, const vector<Rect>& rois, int w, int h,
+                  int* nodeMap, Rect* bounds )
+{
+    if( !mask.empty() && ( mask.cols != w || mask.rows != h || mask.type() != CV_8UC1 ) )
+        throw "buildNodeMap: mask must be CV_8UC1, same size as the image!";
+
+    std::fill( nodeMap, nodeMap + w * h, -1 );
+
+    // rows and columns to visit: the ROIs' bounding box, clipped to the image
+    int x0 = 0, y0 = 0, x1 = w, y1 = h;
+    vector<uchar> inRoi;
+    if( !rois.empty() )
+    {
+        x0 = w; y0 = h; x1 = 0; y1 = 0;
+        for ( size_t r = 0; r < rois.size(); r++ )
+        {
+            x0 = min( x0, max( 0, rois[r].x ) );
+            y0 = min( y0, max( 0, rois[r].y ) );
+            x1 = max( x1, min( w, rois[r].x + rois[r].width ) );
+            y1 = max( y1, min( h, rois[r].y + rois[r].height ) );
+        }
+        inRoi.resize( w );
+    }
+
+    int numActive = 0;
+    int bx0 = w, by0 = h, bx1 = -1, by1 = -1;
+    for ( int y = y0; y < y1; y++ )
+    {
+        // ROI membership of this row
+        if( !rois.empty() )
+        {
+            std::fill( inRoi.begin(), inRoi.end(), 0 );
+            for ( size_t r = 0; r < rois.size(); r++ )
+            {
+                const Rect& roi = rois[r];
+                if( y < roi.y || y >= roi.y + roi.height )
+                    continue;
+                for ( int x = max( 0, roi.x ); x < min( w, roi.x + roi.width ); x++ )
+                    inRoi[x] = 1;
+            }
+        }
+
+        const uchar* mrow = mask.empty() ? 0 : mask.ptr<uchar>(y);
+        int* nrow = nodeMap + y * w;
+        for ( int x = x0; x < x1; x++ )
+        {
+            if( ( mrow && !mrow[x] ) || ( !inRoi.empty() && !inRoi[x] ) )
+                continue;
+
+            nrow[x] = numActive++;
+            bx0 = min( bx0, x ); bx1 = max( bx1, x );
+            by0 = min( by0, y ); by1 = max( by1, y );
+        }
+    }
+
+    if( bounds )
+        *bounds = ( numActive > 0 ) ? Rect( bx0, by0, bx1 - bx0 + 1, by1 - by0 + 1 ) : Rect();
+
+    return numActive;
+}
+
+/// x (even bits) and y (odd bits) of the Morton code m
+static inline void mortonDecode( int m, int& x, int& y )
+{
+    x = 0; y = 0;
+    for ( int b = 0; m; b++, m >>= 2 )
+    {
+        x |= ( m & 1 ) << b;
+        y |= ( ( m >> 1 ) & 1 ) << b;
+    }
+}
+
+/**
+ * active pixels renumbered block by block; Z-order blocks are walked over all
+ * tile*tile codes, skipping the pixels outside the image (partial blocks)
+ */
+int orderNodeMap( int order, int tile, int w, int h, int* nodeMap )
+{
+    if( tile < 1 || ( order == ORDER_MORTON && ( tile & ( tile - 1 ) ) ) )
+        throw "orderNodeMap: Illegal tile size!";
+
+    int numActive = 0;
+    if( order != ORDER_TILED && order != ORDER_MORTON )
+    {
+        for ( int i = 0; i < w * h; i++ )
+            if( nodeMap[i] >= 0 )
+                nodeMap[i] = numActive++;
+        return numActive;
+    }
+
+    for ( int ty = 0; ty < h; ty += tile )
+    {
+        int th = min( tile, h - ty );
+        for ( int tx = 0; tx < w; tx += tile )
+        {
+            int tw = min( tile, w - tx );
+            if( order == ORDER_TILED )
+            {
+                for ( int y = ty; y < ty + th; y++ )
+                {
+                    int* nrow = nodeMap + y * w;
+                    for ( int x = tx; x < tx + tw; x++ )
+                        if( nrow[x] >= 0 )
+                            nrow[x] = numActive++;
+                }
+                continue;
+            }
+
+            int x, y;
+            for ( int m = 0; m < tile * tile; m++ )
+            {
+                mortonDecode( m, x, y );
+                if( x >= tw || y >= th )
+                    continue;
+
+                int& node = nodeMap[ ( ty + y ) * w + tx + x ];
+                if( node >= 0 )
+                    node = numActive++;
+            }
+        }
+    }
+
+    return numActive;
+}
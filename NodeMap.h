@@ -0,0 +1,42 @@
+/***************************************************************
+ * Name:      NodeMap.h
+ * Purpose:   Pixel to graph node mapping (masked/ROI segmentation)
+ * Author:    segment-cpp contributors
+ * Created:   18.10.2026
+ * Copyright: segment-cpp contributors
+ * License:
+ **************************************************************/
+
+#ifndef NODEMAP_H_INCLUDED
+#define NODEMAP_H_INCLUDED
+
+#include <vector>
+
+#include "opencv2/core/core.hpp"
+
+using namespace cv;
+
+/// fill nodeMap (w*h, raster order) with compact node ids [0..numActive-1] for the
+/// active pixels and -1 for the others; a pixel is active if mask(y,x) != 0
+/// (when mask is not empty) and it is inside one of `rois` (when rois is not empty)
+/// bounds: bounding box of the active pixels (optional)
+/// returns the number of active pixels
+int buildNodeMap( const Mat& mask, const std::vector<Rect>& rois, int w, int h,
+                  int* nodeMap, Rect* bounds = 0 );
+
+/// graph node numbering of the pixels, see setNodeOrder() of the segmenters
+enum NodeOrder
+{
+    ORDER_RASTER = 0,       // y*width + x (default)
+    ORDER_TILED,            // tile x tile blocks in raster order, raster order inside a block
+    ORDER_MORTON            // tile x tile blocks in raster order, Z-order inside a block
+};
+
+/// renumber the active pixels of nodeMap (w*h, raster order, >= 0 active, -1 inactive)
+/// as 0..numActive-1 in the given order; `tile` (power of two for ORDER_MORTON):
+/// block size, neighbors in the same block are close in the node ids, so a vertical
+/// edge does not span a full image row in the DSF and the per node arrays
+/// returns the number of active pixels
+int orderNodeMap( int order, int tile, int w, int h, int* nodeMap );
+
+#endif
@@ -0,0 +1,182 @@
+/***************************************************************
+ * Name:      PerfProfiler.cpp
+ * Purpose:   Per phase timings and hardware performance counters
+ * Author:    segment-cpp contributors
+ * Created:   18.10.2026
+ * Copyright: segment-cpp contributors
+ * License:
+ **************************************************************/
+
+#include <cstdio>
+#include <cstring>
+
+#include "PerfProfiler.h"
+
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+using namespace std;
+
+#ifdef __linux__
+
+/// open one counter of the calling thread, user space only; group: leader fd or -1
+static int openCounter( unsigned long long config, int group )
+{
+    struct perf_event_attr attr;
+    memset( &attr, 0, sizeof(attr) );
+    attr.size = sizeof(attr);
+    attr.type = PERF_TYPE_HARDWARE;
+    attr.config = config;
+    attr.disabled = ( group < 0 ) ? 1 : 0;
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+    attr.read_format = PERF_FORMAT_GROUP | PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+
+    return (int)syscall( __NR_perf_event_open, &attr, 0, -1, group, 0 );
+}
+
+#endif
+
+PerfProfiler :: PerfProfiler()
+{
+    numCounters = 0;
+    for ( int i = 0; i < PERF_NUM_COUNTERS; i++ )
+        fds[i] = -1;
+
+#ifdef __linux__
+    static const unsigned long long configs[PERF_NUM_COUNTERS] =
+    {
+        PERF_COUNT_HW_CPU_CYCLES,
+        PERF_COUNT_HW_INSTRUCTIONS,
+        PERF_COUNT_HW_CACHE_MISSES,
+        PERF_COUNT_HW_BRANCH_MISSES
+    };
+
+    for ( int i = 0; i < PERF_NUM_COUNTERS; i++ )
+    {
+        fds[i] = openCounter( configs[i], fds[0] );
+        if( fds[i] < 0 )
+        {
+            // all or none: timings only
+            for ( int j = 0; j < i; j++ )
+            {
+                close( fds[j] );
+                fds[j] = -1;
+            }
+            return;
+        }
+    }
+
+    // the group counts from now on, PerfScope takes differences
+    ioctl( fds[0], PERF_EVENT_IOC_RESET, PERF_IOC_FLAG_GROUP );
+    ioctl( fds[0], PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP );
+    numCounters = PERF_NUM_COUNTERS;
+#endif
+}
+
+PerfProfiler :: ~PerfProfiler()
+{
+#ifdef __linux__
+    for ( int i = 0; i < PERF_NUM_COUNTERS; i++ )
+        if( fds[i] >= 0 )
+            close( fds[i] );
+#endif
+}
+
+void PerfProfiler :: read( long long* counters, chrono::steady_clock::time_point& time ) const
+{
+    for ( int i = 0; i < PERF_NUM_COUNTERS; i++ )
+        counters[i] = 0;
+
+#ifdef __linux__
+    if( numCounters )
+    {
+        // nr, time enabled, time running, values
+        unsigned long long data[3 + PERF_NUM_COUNTERS];
+        if( ::read( fds[0], data, sizeof(data) ) == (ssize_t)sizeof(data) && data[2] > 0 )
+        {
+            // scaled if the counters were multiplexed
+            double scale = (double)data[1] / data[2];
+            for ( int i = 0; i < PERF_NUM_COUNTERS; i++ )
+                counters[i] = (long long)( data[3 + i] * scale );
+        }
+    }
+#endif
+
+    time = chrono::steady_clock::now();
+}
+
+PhaseStats& PerfProfiler :: phase( const string& name )
+{
+    for ( size_t i = 0; i < phases.size(); i++ )
+        if( phases[i].name == name )
+            return phases[i];
+
+    phases.push_back( PhaseStats() );
+    phases.back().name = name;
+    return phases.back();
+}
+
+void PerfProfiler :: add( const char* name, double seconds, const long long* counters, long long items )
+{
+    PhaseStats& p = phase( name );
+    p.calls++;
+    p.seconds += seconds;
+    p.items += items;
+    for ( int c = 0; c < PERF_NUM_COUNTERS; c++ )
+        p.counters[c] += counters[c];
+}
+
+void PerfProfiler :: add( const PerfProfiler& other )
+{
+    for ( size_t i = 0; i < other.phases.size(); i++ )
+    {
+        const PhaseStats& o = other.phases[i];
+        PhaseStats& p = phase( o.name );
+        p.calls += o.calls;
+        p.seconds += o.seconds;
+        p.items += o.items;
+        for ( int c = 0; c < PERF_NUM_COUNTERS; c++ )
+            p.counters[c] += o.counters[c];
+    }
+    if( other.numCounters && !this->numCounters )
+        this->numCounters = other.numCounters;
+}
+
+void PerfProfiler :: report( ostream& out ) const
+{
+    char line[256];
+    if( !numCounters )
+    {
+        sprintf( line, "%-16s %6s %10s %12s %10s", "phase", "calls", "ms", "items", "ns/item" );
+        out << line << endl;
+        for ( size_t i = 0; i < phases.size(); i++ )
+        {
+            const PhaseStats& p = phases[i];
+            sprintf( line, "%-16s %6d %10.2f %12lld %10.2f", p.name.c_str(), p.calls, p.seconds * 1e3, p.items,
+                     p.items ? p.seconds * 1e9 / p.items : 0.0 );
+            out << line << endl;
+        }
+        out << "(no hardware counters: perf_event not available)" << endl;
+        return;
+    }
+
+    sprintf( line, "%-16s %6s %10s %12s %6s %9s %9s %9s %9s", "phase", "calls", "ms", "items", "IPC",
+             "cyc/item", "ins/item", "llc/item", "brm/item" );
+    out << line << endl;
+    for ( size_t i = 0; i < phases.size(); i++ )
+    {
+        const PhaseStats& p = phases[i];
+        double n = p.items ? (double)p.items : 1.0;
+        sprintf( line, "%-16s %6d %10.2f %12lld %6.2f %9.2f %9.2f %9.4f %9.4f", p.name.c_str(), p.calls,
+                 p.seconds * 1e3, p.items,
+                 p.counters[PERF_CYCLES] ? (double)p.counters[PERF_INSTRUCTIONS] / p.counters[PERF_CYCLES] : 0.0,
+                 p.counters[PERF_CYCLES] / n, p.counters[PERF_INSTRUCTIONS] / n,
+                 p.counters[PERF_LLC_MISSES] / n, p.counters[PERF_BRANCH_MISSES] / n );
+        out << line << endl;
+    }
+}
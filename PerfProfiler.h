@@ -0,0 +1,134 @@
+/***************************************************************
+ * Name:      PerfProfiler.h
+ * Purpose:   Per phase timings and hardware performance counters
+ * Author:    segment-cpp contributors
+ * Created:   18.10.2026
+ * Copyright: segment-cpp contributors
+ * License:
+ **************************************************************/
+
+#ifndef PERFPROFILER_H_INCLUDED
+#define PERFPROFILER_H_INCLUDED
+
+#include <chrono>
+#include <iostream>
+#include <string>
+#include <vector>
+
+/// hardware counters read by PerfProfiler
+enum PerfCounter
+{
+    PERF_CYCLES = 0,
+    PERF_INSTRUCTIONS,
+    PERF_LLC_MISSES,        // last level cache misses
+    PERF_BRANCH_MISSES,
+    PERF_NUM_COUNTERS
+};
+
+/// totals of one phase over all its calls
+struct PhaseStats
+{
+    std::string name;
+    int calls;
+    double seconds;
+    /// number of items processed (edges), for the per item numbers
+    long long items;
+    long long counters[PERF_NUM_COUNTERS];
+
+    PhaseStats() : calls(0), seconds(0.0), items(0) { for ( int i = 0; i < PERF_NUM_COUNTERS; i++ ) counters[i] = 0; }
+};
+
+/**
+ * Wall time and, on Linux with perf_event, cycles, instructions, LLC misses and
+ * branch misses of the phases of the segmenters (graph building, sort, merge, small
+ * regions). The counters count the user space of the calling thread only (no root
+ * needed up to perf_event_paranoid 2); threads started by a phase (OpenMP graph
+ * building) are not counted. Without perf_event, or if it cannot be opened, only
+ * the times are reported.
+ *
+ * One profiler per thread; the phases are accumulated by name, see PerfScope.
+ */
+class PerfProfiler
+{
+public:
+
+    PerfProfiler();
+    ~PerfProfiler();
+
+    /// true if the hardware counters could be opened
+    bool countersAvailable() const { return numCounters > 0; }
+
+    /// current counter values (running totals, scaled if multiplexed) and time
+    void read( long long* counters, std::chrono::steady_clock::time_point& time ) const;
+
+    /// add one call of phase `name`, counter deltas and items
+    void add( const char* name, double seconds, const long long* counters, long long items );
+
+    /// add all phases of another profiler (e.g., one per thread)
+    void add( const PerfProfiler& other );
+
+    const std::vector<PhaseStats>& getPhases() const { return phases; }
+    void clear() { phases.clear(); }
+
+    /// one line per phase: calls, time, items, counters, IPC, counters per item
+    void report( std::ostream& out ) const;
+
+private:
+
+    PerfProfiler( const PerfProfiler& );
+    PerfProfiler& operator=( const PerfProfiler& );
+
+    /// stats of phase `name`, added if new
+    PhaseStats& phase( const std::string& name );
+
+    /// perf_event file descriptors, group leader first, -1 if not opened
+    int fds[PERF_NUM_COUNTERS];
+    /// number of counters opened (0 or PERF_NUM_COUNTERS)
+    int numCounters;
+
+    std::vector<PhaseStats> phases;
+};
+
+/**
+ * Profiles the enclosing scope as phase `name` if `profiler` is not NULL:
+ *
+ *     PerfScope scope( profiler, "merge" );
+ *     ...
+ *     scope.setItems( numEdges );
+ */
+class PerfScope
+{
+public:
+
+    PerfScope( PerfProfiler* profiler, const char* name, long long items = 0 )
+        : profiler(profiler), name(name), items(items)
+    {
+        if( profiler )
+            profiler->read( start, startTime );
+    }
+
+    ~PerfScope()
+    {
+        if( !profiler )
+            return;
+
+        long long end[PERF_NUM_COUNTERS];
+        std::chrono::steady_clock::time_point endTime;
+        profiler->read( end, endTime );
+        for ( int i = 0; i < PERF_NUM_COUNTERS; i++ )
+            end[i] -= start[i];
+        profiler->add( name, std::chrono::duration<double>( endTime - startTime ).count(), end, items );
+    }
+
+    void setItems( long long n ) { items = n; }
+
+private:
+
+    PerfProfiler* profiler;
+    const char* name;
+    long long items;
+    long long start[PERF_NUM_COUNTERS];
+    std::chrono::steady_clock::time_point startTime;
+};
+
+#endif
@@ -0,0 +1,129 @@
+/***************************************************************
+ * Name:      Pyramid.cpp
+ * Purpose:   Helpers for coarse-to-fine (pyramid) segmentation
+ * Author:    segment-cpp contributors
+ * Created:   18.10.2026
+ * Copyright: segment-cpp contributors
+ * License:
+ **************************************************************/
+
+#include <algorithm>
+#include <vector>
+
+#include "Pyramid.h"
+
+using namespace std;
+
+/**
+ * downscale by 2^levels, each coarse pixel is the mean of its fine block
+ */
+void pyramidDown( const ImageView& src, Mat& dst, int levels )
+{
+    int w = src.width;
+    int h = src.height;
+
+    // 2^levels must fit the image (and 4^levels an int, the coarse pixel area of the callers)
+    if( levels < 0 || levels > PYRAMID_MAX_LEVELS || ( 1 << levels ) > w || ( 1 << levels ) > h )
+        throw "pyramidDown - levels out of range for the image!";
+
+    int f = 1 << levels;
+    int cw = ( w + f - 1 ) / f;
+    int ch = ( h + f - 1 ) / f;
+
+    dst.create( ch, cw, CV_8UC3 );
+
+    // per coarse row channel sums and counts; a block of 4^levels pixels
+    // times 255 overflows an int from levels = 12 on
+    vector<long long> sums( cw * 3 );
+    vector<int> counts( cw );
+
+    for ( int cy = 0; cy < ch; cy++ )
+    {
+        std::fill( sums.begin(), sums.end(), 0 );
+        std::fill( counts.begin(), counts.end(), 0 );
+
+        int y1 = min( h, ( cy + 1 ) * f );
+        for ( int y = cy * f; y < y1; y++ )
+        {
+            const Vec3b* row = src.ptr<Vec3b>(y);
+            for ( int x = 0; x < w; x++ )
+            {
+                int cx = x >> levels;
+                sums[3*cx]     += row[x][0];
+                sums[3*cx + 1] += row[x][1];
+                sums[3*cx + 2] += row[x][2];
+                counts[cx]++;
+            }
+        }
+
+        Vec3b* crow = dst.ptr<Vec3b>(cy);
+        for ( int cx = 0; cx < cw; cx++ )
+        {
+            int n = counts[cx];
+            crow[cx][0] = (uchar)( ( sums[3*cx]     + n/2 ) / n );
+            crow[cx][1] = (uchar)( ( sums[3*cx + 1] + n/2 ) / n );
+            crow[cx][2] = (uchar)( ( sums[3*cx + 2] + n/2 ) / n );
+        }
+    }
+}
+
+/**
+ * mark the fine pixels near the projected coarse region boundaries
+ */
+int pyramidBand( const int* coarseLabels, int cw, int ch, int levels,
+                 int fw, int fh, int band, uchar* inBand )
+{
+    if( band < 1 )
+        band = 1;
+
+    // a band over the whole coarse grid: every pixel, also without a boundary
+    if( band >= max( cw, ch ) )
+    {
+        std::fill( inBand, inBand + fw * fh, (uchar)1 );
+        return fw * fh;
+    }
+
+    // coarse pixels next to a label change (4 neighbors)
+    vector<uchar> edge( cw * ch, 0 );
+    for ( int y = 0; y < ch; y++ )
+    {
+        for ( int x = 0; x < cw; x++ )
+        {
+            int i = y * cw + x;
+            if ( x < cw - 1 && coarseLabels[i] != coarseLabels[i + 1] )
+                edge[i] = edge[i + 1] = 1;
+            if ( y < ch - 1 && coarseLabels[i] != coarseLabels[i + cw] )
+                edge[i] = edge[i + cw] = 1;
+        }
+    }
+
+    // dilate by band-1 more coarse pixels (separable, square window)
+    vector<uchar> tmp( cw * ch, 0 );
+    vector<uchar> dil( cw * ch, 0 );
+    int r = band - 1;
+    for ( int y = 0; y < ch; y++ )
+        for ( int x = 0; x < cw; x++ )
+            if ( edge[y * cw + x] )
+                for ( int k = max( 0, x - r ); k <= min( cw - 1, x + r ); k++ )
+                    tmp[y * cw + k] = 1;
+    for ( int y = 0; y < ch; y++ )
+        for ( int x = 0; x < cw; x++ )
+            if ( tmp[y * cw + x] )
+                for ( int k = max( 0, y - r ); k <= min( ch - 1, y + r ); k++ )
+                    dil[k * cw + x] = 1;
+
+    // project to the fine grid
+    int count = 0;
+    for ( int y = 0; y < fh; y++ )
+    {
+        const uchar* crow = &dil[ ( y >> levels ) * cw ];
+        uchar* frow = inBand + y * fw;
+        for ( int x = 0; x < fw; x++ )
+        {
+            frow[x] = crow[ x >> levels ];
+            count += frow[x];
+        }
+    }
+
+    return count;
+}
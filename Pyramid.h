@@ -0,0 +1,35 @@
+/***************************************************************
+ * Name:      Pyramid.h
+ * Purpose:   Helpers for coarse-to-fine (pyramid) segmentation
+ * Author:    segment-cpp contributors
+ * Created:   18.10.2026
+ * Copyright: segment-cpp contributors
+ * License:
+ **************************************************************/
+
+#ifndef PYRAMID_H_INCLUDED
+#define PYRAMID_H_INCLUDED
+
+#include "opencv2/core/core.hpp"
+
+#include "ImageView.h"
+
+using namespace cv;
+
+/// largest number of pyramid levels (4^levels, the coarse pixel area, fits an int)
+#define PYRAMID_MAX_LEVELS 15
+
+/// downscale a 3-channel 8-bit image by 2^levels, area average (box filter);
+/// border cells average only the pixels inside the image;
+/// throws if 2^levels is larger than the width or the height, or levels > PYRAMID_MAX_LEVELS
+void pyramidDown( const ImageView& src, Mat& dst, int levels );
+
+/// mark the fine pixels (inBand[y*fw+x] = 1) whose coarse pixel is within `band`
+/// coarse pixels of a coarse label change, all others 0 (interior pixels);
+/// band >= max(cw, ch) marks every pixel (a full resolution segmentation)
+/// coarseLabels: cw x ch array of coarse region ids, fine size: fw x fh
+/// returns the number of band pixels
+int pyramidBand( const int* coarseLabels, int cw, int ch, int levels,
+                 int fw, int fh, int band, uchar* inBand );
+
+#endif
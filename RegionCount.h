@@ -0,0 +1,97 @@
+/***************************************************************
+ * Name:      RegionCount.h
+ * Purpose:   Parameter search for a target number of regions
+ * Author:    segment-cpp contributors
+ * Created:   18.10.2026
+ * Copyright: segment-cpp contributors
+ * License:
+ **************************************************************/
+
+#ifndef REGIONCOUNT_H_INCLUDED
+#define REGIONCOUNT_H_INCLUDED
+
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+
+/**
+ * Parameter (EGBS threshold, SRM Q) giving about `target` regions, by replaying
+ * the merge phase over the graph sorted once (the edge order does not depend
+ * on the parameter). `replay(p)` merges with parameter p and returns the number
+ * of regions; `count` is the number of regions at `start` (already merged).
+ * The count is monotone in the parameter only in trend: decreasing for the
+ * EGBS threshold, increasing for Q (`increasing`).
+ *
+ * The parameter is scaled by 4 until the count crosses the target, then the
+ * interval is bisected on the log scale; at most `maxReplays` replays. The best
+ * parameter seen (closest count) is returned and its segmentation is left in
+ * the segmenter (replayed again if it is not the last one). Stops early if
+ * replay() returns a negative count (stopped by a cancel token).
+ */
+template< typename Replay >
+float searchRegionCount( Replay& replay, float start, int count, int target, bool increasing,
+                         float minParam, int maxReplays )
+{
+    float best = start;
+    int bestError = std::abs( count - target );
+    float last = start;
+
+    // more regions than wanted: larger EGBS threshold, smaller Q
+    bool tooMany = count > target;
+    bool up = ( tooMany != increasing );
+
+    float a = start, b = start;
+    bool crossed = false;
+    int n = 0;
+    while( count != target && n < maxReplays )
+    {
+        b = up ? a * 4.0f : std::max( minParam, a / 4.0f );
+        if( b == a )
+            break;
+
+        count = replay( b );
+        n++;
+        last = b;
+        if( count < 0 )
+            return last;
+        if( std::abs( count - target ) < bestError )
+        {
+            best = b;
+            bestError = std::abs( count - target );
+        }
+
+        if( ( count > target ) != tooMany || count == target )
+        {
+            crossed = true;
+            break;
+        }
+        a = b;
+    }
+
+    // a: count on the start side of the target, b: on the other side
+    while( crossed && bestError > 0 && n < maxReplays && std::fabs( b / a - 1.0f ) > 1e-3f )
+    {
+        float m = std::sqrt( a * b );
+        count = replay( m );
+        n++;
+        last = m;
+        if( count < 0 )
+            return last;
+        if( std::abs( count - target ) < bestError )
+        {
+            best = m;
+            bestError = std::abs( count - target );
+        }
+
+        if( ( count > target ) == tooMany )
+            a = m;
+        else
+            b = m;
+    }
+
+    if( last != best )
+        replay( best );
+    return best;
+}
+
+#endif
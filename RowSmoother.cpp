@@ -0,0 +1,223 @@
+/***************************************************************
+ * Name:      RowSmoother.cpp
+ * Purpose:   Image smoothing over a rolling window of rows
+ * Author:    segment-cpp contributors
+ * Created:   18.10.2026
+ * Copyright: segment-cpp contributors
+ * License:
+ **************************************************************/
+
+#include <algorithm>
+#include <cmath>
+
+#include "RowSmoother.h"
+
+using namespace std;
+
+// the inner loops run over contiguous float rows (width*cn values) without
+// branches, the channel counts are template parameters of the row filters
+// (1, 3 or 4 input channels), so that the compiler can vectorize them
+
+namespace
+{
+
+/**
+ * horizontal Gaussian pass of one row, replicated border;
+ * CN output channels, ICN input channels (compile time, constant strides)
+ */
+template< int CN, int ICN >
+void gaussianRowH( const uchar* src, float* out, int w, const float* kernel, int radius )
+{
+    // center tap
+    float k0 = kernel[0];
+    for ( int x = 0; x < w; x++ )
+        for ( int c = 0; c < CN; c++ )
+            out[x*CN + c] = k0 * src[x*ICN + c];
+
+    // symmetric taps; interior without border checks
+    for ( int k = 1; k <= radius; k++ )
+    {
+        float kk = kernel[k];
+        int x0 = min( k, w );
+        int x1 = max( x0, w - k );
+        for ( int x = 0; x < x0; x++ )
+        {
+            int xl = max( 0, x - k ), xr = min( w - 1, x + k );
+            for ( int c = 0; c < CN; c++ )
+                out[x*CN + c] += kk * ( src[xl*ICN + c] + src[xr*ICN + c] );
+        }
+        for ( int x = x0; x < x1; x++ )
+            for ( int c = 0; c < CN; c++ )
+                out[x*CN + c] += kk * ( src[(x-k)*ICN + c] + src[(x+k)*ICN + c] );
+        for ( int x = x1; x < w; x++ )
+        {
+            int xl = max( 0, x - k ), xr = min( w - 1, x + k );
+            for ( int c = 0; c < CN; c++ )
+                out[x*CN + c] += kk * ( src[xl*ICN + c] + src[xr*ICN + c] );
+        }
+    }
+}
+
+/// sort two values
+#define SORT2( a, b ) { float t = min( a, b ); b = max( a, b ); a = t; }
+
+/**
+ * 3x3 median of each channel of one row, replicated border;
+ * CN output channels, ICN input channels
+ */
+template< int CN, int ICN >
+void medianRowT( const uchar* rows[3], float* out, int w )
+{
+    for ( int x = 0; x < w; x++ )
+    {
+        int xs[3] = { max( 0, x - 1 ), x, min( w - 1, x + 1 ) };
+        for ( int c = 0; c < CN; c++ )
+        {
+            float p[9];
+            for ( int j = 0; j < 3; j++ )
+                for ( int i = 0; i < 3; i++ )
+                    p[3*j + i] = rows[j][ xs[i]*ICN + c ];
+
+            // median of 9, min/max network (Paeth)
+            SORT2(p[1], p[2]); SORT2(p[4], p[5]); SORT2(p[7], p[8]);
+            SORT2(p[0], p[1]); SORT2(p[3], p[4]); SORT2(p[6], p[7]);
+            SORT2(p[1], p[2]); SORT2(p[4], p[5]); SORT2(p[7], p[8]);
+            SORT2(p[0], p[3]); SORT2(p[5], p[8]); SORT2(p[4], p[7]);
+            SORT2(p[3], p[6]); SORT2(p[1], p[4]); SORT2(p[2], p[5]);
+            SORT2(p[4], p[7]); SORT2(p[4], p[2]); SORT2(p[6], p[4]);
+            SORT2(p[4], p[2]);
+
+            out[x*CN + c] = p[4];
+        }
+    }
+}
+
+} // namespace
+
+RowSmoother :: RowSmoother()
+{
+    this->type = SMOOTH_NONE;
+    this->cn = 3;
+    this->icn = 3;
+    this->radius = 0;
+    oy[0] = oy[1] = oy[2] = -1;
+}
+
+void RowSmoother :: start( const ImageView& image, int type, float sigma )
+{
+    if( image.depth != CV_8U )
+        throw "RowSmoother :: start - 8-bit image expected!";
+    if( image.channels() != 1 && image.channels() != 3 && image.channels() != 4 )
+        throw "RowSmoother :: start - 1, 3 or 4 channel image expected!";
+
+    this->image = image;
+    this->type = type;
+    this->icn = image.channels();
+    this->cn = ( icn == 1 ) ? 1 : 3;
+
+    int rowSize = image.width * cn;
+
+    if( type == SMOOTH_GAUSSIAN )
+    {
+        sigma = max( sigma, 0.01f );
+        radius = (int)ceil( sigma * 4.0f );
+
+        // normalized half kernel
+        kernel.resize( radius + 1 );
+        float sum = 0.0f;
+        for ( int i = 0; i <= radius; i++ )
+        {
+            kernel[i] = exp( -0.5f * ( i / sigma ) * ( i / sigma ) );
+            sum += ( i == 0 ) ? kernel[i] : 2.0f * kernel[i];
+        }
+        for ( int i = 0; i <= radius; i++ )
+            kernel[i] /= sum;
+
+        hbuf.resize( ( 2 * radius + 1 ) * rowSize );
+        hy.assign( 2 * radius + 1, -1 );
+    }
+    else
+        radius = 1;
+
+    obuf.resize( 3 * rowSize );
+    oy[0] = oy[1] = oy[2] = -1;
+}
+
+const float* RowSmoother :: row( int y )
+{
+    int slot = y % 3;
+    float* out = &obuf[ slot * image.width * cn ];
+    if( oy[slot] == y )
+        return out;
+
+    if( type == SMOOTH_GAUSSIAN )
+        gaussianRow( y, out );
+    else
+        medianRow( y, out );
+
+    oy[slot] = y;
+    return out;
+}
+
+/**
+ * source row sy filtered horizontally, replicated border
+ */
+const float* RowSmoother :: hrow( int sy )
+{
+    int n = 2 * radius + 1;
+    int slot = sy % n;
+    float* out = &hbuf[ slot * image.width * cn ];
+    if( hy[slot] == sy )
+        return out;
+
+    const uchar* src = image.ptr<uchar>(sy);
+    if( icn == 1 )
+        gaussianRowH<1, 1>( src, out, image.width, &kernel[0], radius );
+    else if( icn == 3 )
+        gaussianRowH<3, 3>( src, out, image.width, &kernel[0], radius );
+    else
+        gaussianRowH<3, 4>( src, out, image.width, &kernel[0], radius );
+
+    hy[slot] = sy;
+    return out;
+}
+
+/**
+ * Gaussian: vertical pass over the horizontally filtered rows
+ */
+void RowSmoother :: gaussianRow( int y, float* out )
+{
+    int h = image.height;
+    int n = image.width * cn;
+
+    const float* r0 = hrow( y );
+    for ( int i = 0; i < n; i++ )
+        out[i] = kernel[0] * r0[i];
+
+    for ( int k = 1; k <= radius; k++ )
+    {
+        const float* ru = hrow( max( 0, y - k ) );
+        const float* rd = hrow( min( h - 1, y + k ) );
+        float kk = kernel[k];
+        for ( int i = 0; i < n; i++ )
+            out[i] += kk * ( ru[i] + rd[i] );
+    }
+}
+
+/**
+ * 3x3 median of each channel, replicated border
+ */
+void RowSmoother :: medianRow( int y, float* out )
+{
+    int h = image.height;
+    const uchar* rows[3] = { image.ptr<uchar>( max( 0, y - 1 ) ),
+                             image.ptr<uchar>( y ),
+                             image.ptr<uchar>( min( h - 1, y + 1 ) ) };
+
+    if( icn == 1 )
+        medianRowT<1, 1>( rows, out, image.width );
+    else if( icn == 3 )
+        medianRowT<3, 3>( rows, out, image.width );
+    else
+        medianRowT<3, 4>( rows, out, image.width );
+}
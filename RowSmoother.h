@@ -0,0 +1,105 @@
+/***************************************************************
+ * Name:      RowSmoother.h
+ * Purpose:   Image smoothing over a rolling window of rows
+ * Author:    segment-cpp contributors
+ * Created:   18.10.2026
+ * Copyright: segment-cpp contributors
+ * License:
+ **************************************************************/
+
+#ifndef ROWSMOOTHER_H_INCLUDED
+#define ROWSMOOTHER_H_INCLUDED
+
+#include <vector>
+
+#include "ImageView.h"
+
+/// pre-smoothing of the image before computing edge weights
+enum SmoothType
+{
+    SMOOTH_NONE = 0,
+    SMOOTH_GAUSSIAN,    // separable Gaussian, sigma (Felzenszwalb & Huttenlocher use 0.8)
+    SMOOTH_MEDIAN3      // 3x3 median, each channel
+};
+
+/// Smooths an 8-bit image row by row, only a few rows are kept in memory:
+/// 2*radius+1 horizontally filtered rows and the last 3 output rows.
+/// Output rows have 1 (gray) or 3 (color, alpha dropped) float channels.
+/// Rows must be requested in non-decreasing order of y, except that rows
+/// y-1 and y stay valid after row(y+1) (enough for 4 and 8 connected graphs);
+/// a new pass may start again at row 0, the rows are then computed again
+/// (the two passes of BucketKeySink).
+class RowSmoother
+{
+public:
+
+    RowSmoother();
+
+    /// prepare for a new image
+    void start( const ImageView& image, int type, float sigma = 0.8f );
+
+    /// smoothed row y, channels() floats per pixel
+    const float* row( int y );
+
+    /// number of channels in the output rows
+    int channels() const { return cn; }
+
+private:
+
+    void gaussianRow( int y, float* out );
+    void medianRow( int y, float* out );
+
+    /// horizontally filtered source row sy, from the ring
+    const float* hrow( int sy );
+
+private:
+
+    ImageView image;
+    int type;
+
+    /// output channels, input channels
+    int cn;
+    int icn;
+
+    /// Gaussian kernel, half: kernel[0] center, size radius+1
+    std::vector<float> kernel;
+    int radius;
+
+    /// ring of horizontally filtered rows (2*radius+1 rows) and their source row index
+    std::vector<float> hbuf;
+    std::vector<int> hy;
+
+    /// ring of the last 3 output rows and their row index
+    std::vector<float> obuf;
+    int oy[3];
+};
+
+/// row provider for the graph builders: pixels of an image view, as `Pixel`
+template< typename Pixel >
+struct ViewRows
+{
+    const ImageView& image;
+
+    /// rows can be read in any order, also from several threads (parallel graph building)
+    enum { randomAccess = 1 };
+
+    ViewRows( const ImageView& image ) : image(image) {}
+
+    const Pixel* row( int y ) { return image.ptr<Pixel>(y); }
+};
+
+/// row provider for the graph builders: smoothed rows, as `Pixel` (float or Vec3f)
+template< typename Pixel >
+struct SmoothedRows
+{
+    RowSmoother& smoother;
+
+    /// rows must be read in order, from one thread (ring buffer)
+    enum { randomAccess = 0 };
+
+    SmoothedRows( RowSmoother& smoother ) : smoother(smoother) {}
+
+    const Pixel* row( int y ) { return (const Pixel*)smoother.row(y); }
+};
+
+#endif
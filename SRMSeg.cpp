@@ -14,12 +14,19 @@
 #define MAX3( A, B, C ) MAX2 ( ( A ), MAX2 ( ( B ), ( C ) ) )
 
 #include <algorithm>
+#include <climits>
 #include <cmath>
 #include <cstdlib>
 #include <ctime>
 #include <iostream>
+#include <new>
+#include <vector>
 
 #include "SRMSeg.h"
+#include "Contours.h"
+#include "Pyramid.h"
+
+using namespace std;
 
 // compare edge weights, needed in STL - sort, edges are sorted according to weights
 bool operator<( const RegionPair &a, const RegionPair &b )
@@ -32,8 +39,28 @@ SRMSeg::SRMSeg(int w, int h)
     this->mean1 = 0;
     this->mean2 = 0;
     this->mean3 = 0;
+    this->channels = 3;
     this->pairs = 0;
+    this->compact = false;
+    this->compactRequested = false;
+    this->memoryBudget = 0;
+    this->numThreads = 1;
+    this->cancelToken = 0;
+    this->interrupted = false;
+    this->replayable = false;
+    this->profiler = 0;
+    this->keys = 0;
     this->dsf = 0;
+    this->coarse = 0;
+    this->nodeMap = 0;
+    this->masked = false;
+    this->nodeOrder = ORDER_RASTER;
+    this->orderTile = 64;
+    this->fixedPoint = false;
+    this->sums = 0;
+    this->sumChannels = 0;
+    this->thresholdQ = 0;
+    this->thresholdNodes = 0;
 
     this->allocate(w,h);
 }
@@ -41,6 +68,10 @@ SRMSeg::SRMSeg(int w, int h)
 SRMSeg::~SRMSeg()
 {
     this->deallocate();
+
+    if(this->coarse)
+        delete this->coarse;
+    this->coarse = 0;
 }
 
 void SRMSeg::reallocate(int w, int h)
@@ -54,20 +85,121 @@ void SRMSeg::reallocate(int w, int h)
 
 void SRMSeg::allocate(int w, int h)
 {
-    this->width = w;
-    this->height = h;
+    // no storage until allocated, the next segmentation reallocates if this throws
+    this->width = 0;
+    this->height = 0;
+
+    // node and pair indices are int (DisjointSet, RegionPair), about 2 pairs per pixel
+    if( 2.0 * w * h > INT_MAX )
+        throw "SRMSeg::allocate - image too large for 32-bit indices!";
 
     int numpixels = w * h;
+    this->numNodes = numpixels;
+
+    // compact keys if requested, or if the pairs exceed the memory budget
+    this->compact = this->compactRequested;
+    if( this->memoryBudget )
+    {
+        if( !this->compact && memoryFootprint(w, h, false) > this->memoryBudget )
+            this->compact = true;
+
+        if( memoryFootprint(w, h, true) > this->memoryBudget )
+            throw "SRMSeg::allocate - image exceeds the memory budget!";
+    }
 
     this->numEdges = 2 * (h-1) * (w-1) + (h-1) + (w-1);
-    this->pairs = ( RegionPair * )new  RegionPair [ this->numEdges ];
+    if( this->compact )
+    {
+        if( (long long)numpixels >= GRID_MAX_PIXELS )
+            throw "SRMSeg::allocate - image too large for compact edges!";
+        this->keys = new (nothrow) gridkey [ this->numEdges ];
+    }
+    else
+        this->pairs = ( RegionPair * )new (nothrow) RegionPair [ this->numEdges ];
+
+    // one mean plane, the other two on the first color image (setChannels)
+    this->mean1 = new (nothrow) float [numpixels];
+
+    if( ( !this->pairs && !this->keys ) || !this->mean1 )
+    {
+        this->deallocate();
+        throw "SRMSeg::allocate - out of memory!";
+    }
+
+    // DSF, numVertices: width*height (one node for each pixel), throws if out of memory
+    try
+    {
+        this -> dsf = new DisjointSet( numpixels );
+    }
+    catch( ... )
+    {
+        this->deallocate();
+        throw "SRMSeg::allocate - out of memory!";
+    }
+
+    this->width = w;
+    this->height = h;
+}
+
+size_t SRMSeg::memoryFootprint(int w, int h, bool compact, int channels, bool nodeMap, bool fixedPoint, int pyramidLevels)
+{
+    size_t numpixels = (size_t)w * h;
+    size_t numEdges = 2 * numpixels;
+    int planes = ( channels == 1 ? 1 : 3 );
+
+    size_t bytes = numEdges * ( compact ? sizeof(gridkey) : sizeof(RegionPair) )
+                 + planes * numpixels * sizeof(float)
+                 + DisjointSet::memoryFootprint( w * h );
+
+    if( nodeMap )
+        bytes += numpixels * sizeof(int);
+
+    if( fixedPoint )
+        bytes += planes * numpixels * sizeof(long long) + ( numpixels + 1 ) * sizeof(long long);
+
+    if( pyramidLevels > 0 )
+    {
+        // coarse segmenter (color, the same edge storage and merge), downscaled image, coarse
+        // labels and representatives, pyramidBand's 3 coarse masks, interior sums (and
+        // fixed-point sums), fine band mask
+        int f = 1 << std::min( pyramidLevels, PYRAMID_MAX_LEVELS );
+        int cw = ( w + f - 1 ) / f;
+        int ch = ( h + f - 1 ) / f;
+        bytes += memoryFootprint( cw, ch, compact, 3, false, fixedPoint )
+               + (size_t)cw * ch * ( 3 + 2 * sizeof(int) + 3 + 3 * sizeof(double) )
+               + ( fixedPoint ? (size_t)cw * ch * 3 * sizeof(long long) : 0 )
+               + numpixels;
+    }
+
+    return bytes;
+}
 
-    this->mean1 = new float [numpixels];
-    this->mean2 = new float [numpixels];
-    this->mean3 = new float [numpixels];
+size_t SRMSeg::memoryUsage() const
+{
+    if( this->width < 1 )
+        return 0;
+
+    size_t numpixels = (size_t)this->width * this->height;
+    return memoryFootprint( this->width, this->height, this->compact, this->mean2 ? 3 : 1, this->nodeMap != 0 )
+         + ( this->sums ? this->sumChannels * numpixels * sizeof(long long) : 0 )
+         + this->sizeThresholds.capacity() * sizeof(long long)
+         + ( this->coarse ? this->coarse->memoryUsage() : 0 );
+}
 
-    // DSF, numVertices: width*height (one node for each pixel)
-    this -> dsf = new DisjointSet( numpixels );
+/**
+ * set the memory budget, the storage is reallocated within the budget
+ */
+void SRMSeg::setMemoryBudget(size_t bytes)
+{
+    if( bytes == this->memoryBudget )
+        return;
+
+    int w = this->width;
+    int h = this->height;
+    this->deallocate();
+    this->memoryBudget = bytes;
+    if( w > 0 )
+        this->allocate(w, h);
 }
 
 void SRMSeg::deallocate()
@@ -84,130 +216,442 @@ void SRMSeg::deallocate()
         delete[] this->mean3;
     this->mean3 = 0;
 
+    if(this->sums)
+        delete[] this->sums;
+    this->sums = 0;
+    this->sumChannels = 0;
+    this->sizeThresholds.clear();
+    this->thresholdNodes = 0;
+
     if(this->pairs)
         delete[] this->pairs;
     this->pairs = 0;
 
+    if(this->keys)
+        delete[] this->keys;
+    this->keys = 0;
+
     if(this->dsf)
         delete this->dsf;
     this->dsf = 0;
+
+    if(this->nodeMap)
+        delete[] this->nodeMap;
+    this->nodeMap = 0;
+    this->masked = false;
+    this->replayable = false;
 }
 
 /**
- * initialize the mean for the 3 channels with the pixel values
+ * switch between the region pair list and the compact grid keys;
+ * the graph storage is reallocated, the current segmentation is lost
  */
-void SRMSeg::initializeMeans(Mat& image)
+void SRMSeg::setCompactEdges(bool compact)
 {
-    int width = image.cols;
-    int height = image.rows;
-
-    int x, y;
-    int index = 0;
-    for (y = 0; y < height; y++)
-    {
-        for (x = 0; x < width; x++)
-        {
-            Vec3b& pix = image.at<Vec3b>(y, x);
+    if( compact == this->compactRequested )
+        return;
 
-            this->mean1[index] = pix[0];
-            this->mean2[index] = pix[1];
-            this->mean3[index] = pix[2];
-            index++;
-        }
-    }
+    int w = this->width;
+    int h = this->height;
+    this->deallocate();
+    this->compactRequested = compact;
+    if( w > 0 )
+        this->allocate(w, h);
 }
 
-void SRMSeg::segment(Mat& image, float Q, float minsize)
+void SRMSeg::setNodeOrder(int order, int tile)
 {
-    this->reallocate(image.cols, image.rows);
+    if( order != ORDER_TILED && order != ORDER_MORTON )
+        order = ORDER_RASTER;
 
-	this->Q = Q;
-	this->minsize = minsize;
+    if( tile < 1 || ( order == ORDER_MORTON && ( tile & ( tile - 1 ) ) ) )
+        throw "SRMSeg::setNodeOrder - Illegal tile size!";
 
-    this->initializeMeans(image);
+    this->nodeOrder = order;
+    this->orderTile = tile;
+}
 
-    this->numEdges = buildGraph4( image );
+void SRMSeg::setFixedPoint(bool fixed)
+{
+#ifndef __SIZEOF_INT128__
+    if( fixed )
+        throw "SRMSeg::setFixedPoint - no 128-bit integers on this compiler!";
+#endif
+    this->fixedPoint = fixed;
+}
 
-    this->dsf->reset();
+void SRMSeg::setChannels(int channels)
+{
+    this->channels = channels;
+    if( channels == 1 || this->mean2 )
+        return;
+
+    size_t numpixels = (size_t)this->width * this->height;
+    this->mean2 = new (nothrow) float [numpixels];
+    this->mean3 = new (nothrow) float [numpixels];
+    if( !this->mean2 || !this->mean3 )
+    {
+        delete[] this->mean2;
+        delete[] this->mean3;
+        this->mean2 = 0;
+        this->mean3 = 0;
+        this->channels = 1;
+        throw "SRMSeg::setChannels - out of memory!";
+    }
+}
 
+void SRMSeg::allocateSums()
+{
+    if( !this->fixedPoint || ( this->sums && this->sumChannels >= this->channels ) )
+        return;
 
-    this->segmentGraph(this->pairs, this->numEdges);
-    //this->segmentGraph2(image, this->pairs, this->numEdges);
+    if( this->sums )
+        delete[] this->sums;
+    this->sums = 0;
+    this->sumChannels = 0;
+
+    // sums and the threshold table (at most one entry per pixel, reserved here so that
+    // mergeRegionsFixed does not allocate)
+    size_t numpixels = (size_t)this->width * this->height;
+    size_t bytes = this->channels * numpixels * sizeof(long long);
+    if( this->sizeThresholds.capacity() < numpixels + 1 )
+        bytes += ( numpixels + 1 ) * sizeof(long long);
+    this->checkMemoryBudget( this->memoryUsage() + bytes, "SRMSeg::allocateSums - fixed-point tables exceed the memory budget!" );
+
+    this->sums = new (nothrow) long long [ this->channels * numpixels ];
+    if( !this->sums )
+        throw "SRMSeg::allocateSums - out of memory!";
+    this->sumChannels = this->channels;
+
+    try
+    {
+        this->sizeThresholds.reserve( numpixels + 1 );
+    }
+    catch( const std::bad_alloc& )
+    {
+        throw "SRMSeg::allocateSums - out of memory!";
+    }
+}
 
+void SRMSeg::segment(const ImageView& image, float Q, float minsize)
+{
+    if( image.depth != CV_8U )
+        throw "SRMSeg::segment - 8-bit image expected!";
+
+    if( image.channels() == 1 )
+        this->segment<uchar>(image, DistLinf(), Q, minsize);
+    else if( image.channels() == 4 )
+        this->segment<Vec4b>(image, ColorOnly<DistLinf>(), Q, minsize);
+    else
+        this->segment<Vec3b>(image, DistLinf(), Q, minsize);
+}
 
-    this->mergeSmall(this->pairs, this->numEdges, this->minsize);
+/**
+ * segment the active pixels (mask, ROIs)
+ */
+void SRMSeg::segment(const ImageView& image, const Mat& mask, const vector<Rect>& rois, float Q, float minsize)
+{
+    if( image.depth != CV_8U )
+        throw "SRMSeg::segment - 8-bit image expected!";
+
+    if( image.channels() == 1 )
+        this->segmentMasked<uchar>(image, mask, rois, DistLinf(), Q, minsize);
+    else if( image.channels() == 4 )
+        this->segmentMasked<Vec4b>(image, mask, rois, ColorOnly<DistLinf>(), Q, minsize);
+    else
+        this->segmentMasked<Vec3b>(image, mask, rois, DistLinf(), Q, minsize);
 }
 
 /**
- * Build graph, 4 connected
+ * coarse-to-fine segmentation
+ *
+ * The coarse segmentation (Q and minsize scaled by the pixel area ratio, since
+ * a coarse pixel stands for `area` samples) fixes the interior of the regions:
+ * full resolution pixels farther than `band` coarse pixels from a coarse
+ * boundary are joined to their projected region and the region means are
+ * recomputed from the full resolution pixels. Only the pairs touching the band
+ * are built, sorted and merged.
  */
-int SRMSeg :: buildGraph4( Mat& image )
+void SRMSeg::segmentPyramid(const ImageView& image, float Q, float minsize, int levels, int band)
 {
+    if( image.depth != CV_8U || image.channels() != 3 )
+        throw "SRMSeg::segmentPyramid - 8-bit 3 channel image expected!";
 
-    int width = image.cols;
-    int height = image.rows;
+    if(levels < 1)
+    {
+        this->segment<Vec3b>(image, DistLinf(), Q, minsize);
+        return;
+    }
 
-    int numEdges = 0;
-    int yw = 0;     //y * width
-    int ywx = 0;    //y * width + x
-    int x,y;
-    for (y = 0; y < height; y++) {
+    this->reallocate(image.width, image.height);
 
-        yw = y * width;
-        for (x = 0; x < width; x++) {
+	this->Q = Q;
+	this->minsize = minsize;
+    this->interrupted = false;
+    this->replayable = false;
+
+    // coarse segmenter and band buffers within the memory budget, a coarse segmenter
+    // of the last pyramid is resized
+    size_t pyramidBytes = memoryFootprint(this->width, this->height, this->compact, 3, false, this->fixedPoint, levels)
+                        - memoryFootprint(this->width, this->height, this->compact, 3, false, this->fixedPoint);
+    size_t ownBytes = this->memoryUsage() - ( this->coarse ? this->coarse->memoryUsage() : 0 );
+    this->checkMemoryBudget( ownBytes + pyramidBytes, "SRMSeg::segmentPyramid - pyramid exceeds the memory budget!" );
+
+    // coarse level (pyramidDown checks the levels)
+    Mat small;
+    pyramidDown( image, small, levels );
+    int area = 1 << ( 2 * levels );
+
+    if(!this->coarse)
+    {
+        this->coarse = new (nothrow) SRMSeg(small.cols, small.rows);
+        if(!this->coarse)
+            throw "SRMSeg::segmentPyramid - out of memory!";
+    }
 
-            ywx = yw + x;
-            if ( x < width - 1 )
-            {
-                this->pairs[numEdges].reg1 = ywx;        //	y * width + x
-                this->pairs[numEdges].reg2 = ywx + 1;    //  y * width + (x + 1)
+    // the coarse level merges with the same predicate and edge storage, within the budget
+    // left after this segmenter and the band buffers
+    size_t coarseBytes = memoryFootprint(small.cols, small.rows, this->compact, 3, false, this->fixedPoint);
+    this->coarse->setFixedPoint( this->fixedPoint );
+    this->coarse->setCompactEdges( this->compact );
+    if( this->memoryBudget )
+        this->coarse->setMemoryBudget( this->memoryBudget - ownBytes - ( pyramidBytes - coarseBytes ) );
+    this->coarse->setCancelToken( this->cancelToken );
+    this->coarse->setProfiler( this->profiler );
+    this->coarse->segment<Vec3b>(small, DistLinf(), Q * area, max(1.0f, minsize/area));
+    this->interrupted = this->coarse->wasInterrupted();
+
+    int cw = small.cols;
+    int ch = small.rows;
+    int w = this->width;
+    int h = this->height;
+    vector<int> clabels, rep;
+    vector<uchar> inBand;
+    // interior region sums (double: a float sum of many pixels loses the low bits of the mean)
+    vector<double> sum1, sum2, sum3;
+    vector<long long> isum;
+    try
+    {
+        clabels.resize( cw * ch );
+        rep.assign( cw * ch, -1 );
+        inBand.resize( w * h );
+        sum1.assign( cw * ch, 0.0 );
+        sum2.assign( cw * ch, 0.0 );
+        sum3.assign( cw * ch, 0.0 );
+        isum.assign( this->fixedPoint ? 3 * cw * ch : 0, 0 );
+
+        for ( int i = 0; i < cw * ch; i++ )
+            clabels[i] = this->coarse->dsf->find(i);
+
+        // band around the projected boundaries
+        pyramidBand( &clabels[0], cw, ch, levels, w, h, band, &inBand[0] );
+    }
+    catch( const std::bad_alloc& )
+    {
+        throw "SRMSeg::segmentPyramid - out of memory!";
+    }
 
-	            Vec3b& pix1 = image.at<Vec3b>(y, x);
-	            Vec3b& pix2 = image.at<Vec3b>(y, x+1);
-	            this->pairs[numEdges].delta = distance( pix1, pix2 );
-	            numEdges++;
-            }
+    // bulk-assign the interior pixels, one representative node per coarse region
+    this->masked = false;
+    this->numNodes = w * h;
+    this->setChannels(3);
+    this->allocateSums();
+    this->initializeMeans<Vec3b>(image);
+    this->dsf->reset();
 
-            if ( y < height - 1 )
-            {
-                this->pairs[numEdges].reg1 = ywx;            // y * width + x;
-                this->pairs[numEdges].reg2 = ywx + width;    // (y+1) * width + x;
+    for ( int y = 0; y < h; y++ )
+    {
+        int cyw = ( y >> levels ) * cw;
+        for ( int x = 0, i = y * w; x < w; x++, i++ )
+        {
+            if( inBand[i] )
+                continue;
+
+            int c = clabels[ cyw + ( x >> levels ) ];
+            if( rep[c] < 0 )
+                rep[c] = i;
+            else
+                this->dsf->join( this->dsf->find( rep[c] ), i );
+        }
+    }
 
-	            Vec3b& pix1 = image.at<Vec3b>(y, x);
-	            Vec3b& pix2 = image.at<Vec3b>(y+1, x);
-	            this->pairs[numEdges].delta = distance( pix1, pix2 );
-	            numEdges++;
+    // interior region means: sum the pixel values at the root, then divide
+    for ( int y = 0; y < h; y++ )
+    {
+        int cyw = ( y >> levels ) * cw;
+        for ( int x = 0, i = y * w; x < w; x++, i++ )
+        {
+            if( inBand[i] )
+                continue;
+
+            int c = clabels[ cyw + ( x >> levels ) ];
+            sum1[c] += this->mean1[i];
+            sum2[c] += this->mean2[i];
+            sum3[c] += this->mean3[i];
+            if( this->fixedPoint )
+            {
+                isum[3*c] += this->sums[3*i];
+                isum[3*c + 1] += this->sums[3*i + 1];
+                isum[3*c + 2] += this->sums[3*i + 2];
             }
+        }
+    }
 
+    for ( int c = 0; c < cw * ch; c++ )
+    {
+        if( rep[c] < 0 )
+            continue;
+
+        int reg = this->dsf->find( rep[c] );
+        double size = (double)this->dsf->setSize( reg );
+        this->mean1[reg] = (float)( sum1[c] / size );
+        this->mean2[reg] = (float)( sum2[c] / size );
+        this->mean3[reg] = (float)( sum3[c] / size );
+        if( this->fixedPoint )
+        {
+            this->sums[3*reg] = isum[3*c];
+            this->sums[3*reg + 1] = isum[3*c + 1];
+            this->sums[3*reg + 2] = isum[3*c + 2];
         }
     }
 
-    return numEdges;
+    // full resolution pairs around the boundaries
+    DistLinf metric;
+    this->numEdges = buildGraph<Vec3b>( image, metric, 0, &inBand[0] );
+
+    this->segmentGraph();
+
+    this->mergeSmall();
+}
+
+/**
+ * Build graph, 4 connected
+ */
+int SRMSeg :: buildGraph4( const ImageView& image )
+{
+    DistLinf metric;
+    PairSink out( this->pairs );
+    return this->buildGraph4<Vec3b>( image, metric, out );
 }
 
 #define NUM_GRAY 256    // number of gray levels in 8-bit images
 
-using namespace std;
 void SRMSeg :: segmentGraph(RegionPair* pairs, int numEdges)
 {
+    // stop request before the sort
+    if( this->stopRequested() )
+        return;
+
     // sort edges by weight
-    std::sort(pairs, pairs + numEdges );
+    {
+        PerfScope scope( this->profiler, "srm sort", numEdges );
+        std::sort(pairs, pairs + numEdges );
+    }
 
-    float logdelta = 2.0 * log ( 6.0 * this->width*this->height );
+    PerfScope scope( this->profiler, "srm merge", numEdges );
+    if( this->fixedPoint )
+        this->mergeRegionsFixed( PairArray(pairs), numEdges );
+    else
+        this->mergeRegions( PairArray(pairs), numEdges );
+}
+
+/**
+ * merge over the current graph; the compact keys are already sorted by delta
+ */
+void SRMSeg :: segmentGraph()
+{
+    if( !this->compact )
+    {
+        this->segmentGraph(this->pairs, this->numEdges);
+        return;
+    }
+
+    this->mergeGraph();
+}
+
+void SRMSeg :: mergeGraph()
+{
+    PerfScope scope( this->profiler, "srm merge", this->numEdges );
+    if( !this->compact )
+    {
+        if( this->fixedPoint )
+            this->mergeRegionsFixed( PairArray(this->pairs), this->numEdges );
+        else
+            this->mergeRegions( PairArray(this->pairs), this->numEdges );
+        return;
+    }
+
+    GridKeyArray keys( this->keys, this->width, this->masked ? this->nodeMap : 0 );
+    if( this->fixedPoint )
+        this->mergeRegionsFixed( keys, this->numEdges );
+    else
+        this->mergeRegions( keys, this->numEdges );
+}
+
+int SRMSeg :: replayMerge(const ImageView& image, float Q)
+{
+    if( image.depth != CV_8U )
+        throw "SRMSeg::replayMerge - 8-bit image expected!";
+
+    if( image.channels() == 1 )
+        return this->replayMerge<uchar>(image, Q);
+    if( image.channels() == 4 )
+        return this->replayMerge<Vec4b>(image, Q);
+    return this->replayMerge<Vec3b>(image, Q);
+}
+
+/// replayMerge for searchRegionCount
+struct QReplay
+{
+    SRMSeg* seg;
+    const ImageView& image;
+
+    QReplay( SRMSeg* seg, const ImageView& image ) : seg(seg), image(image) {}
+    int operator()( float Q ) { return seg->replayMerge( image, Q ); }
+};
+
+float SRMSeg :: segmentToCount(const ImageView& image, int numRegions, float Q, float minsize, int maxReplays)
+{
+    if( numRegions < 1 )
+        throw "SRMSeg::segmentToCount - Illegal number of regions!";
+
+    this->segment( image, Q, minsize );
+    if( this->interrupted )
+        return Q;
+
+    QReplay replay( this, image );
+    return searchRegionCount( replay, Q, this->dsf->numSets(), numRegions, true, 1e-3f, maxReplays );
+}
+
+template< typename Pairs >
+void SRMSeg :: mergeRegions( const Pairs& p, int numEdges )
+{
+    float logdelta = 2.0 * log ( 6.0 * this->numNodes );
     float threshfactor = ( NUM_GRAY * NUM_GRAY ) / ( 2.0 * this->Q );
-    cout << "logdelta: " << logdelta << endl;
-    cout << "threshfactor: " << threshfactor << endl;
 
+    if( this->channels == 1 )
+        this->mergeRegions<1>( p, numEdges, logdelta, threshfactor );
+    else
+        this->mergeRegions<3>( p, numEdges, logdelta, threshfactor );
+}
+
+/**
+ * merge loop on 1 (gray) or 3 mean planes
+ */
+template< int Channels, typename Pairs >
+void SRMSeg :: mergeRegions( const Pairs& p, int numEdges, float logdelta, float threshfactor )
+{
     // for each edge, in non-decreasing weight order...
-    RegionPair* pair = 0;
     int reg1, reg2, reg;
     int size1, size2, size;
     float threshold;
     for (int i = 0; i < numEdges; i++)
     {
-        pair = &pairs[i];
-        reg1 = this->dsf -> find( pair->reg1 );
-        reg2 = this->dsf -> find( pair->reg2 );
+        if( ( i % CANCEL_CHECK_EDGES ) == 0 && this->stopRequested() )
+            return;
+
+        reg1 = this->dsf -> find( p.a(i) );
+        reg2 = this->dsf -> find( p.b(i) );
         if( reg1 != reg2 )
         {
             size1 = this->dsf->setSize(reg1);
@@ -217,8 +661,8 @@ void SRMSeg :: segmentGraph(RegionPair* pairs, int numEdges)
 
             // merge if distance is less than threshold
             if( fabs(this->mean1[reg1] - this->mean1[reg2]) < threshold
-               && fabs(this->mean2[reg1] - this->mean2[reg2]) < threshold
-               && fabs(this->mean3[reg1] - this->mean3[reg2]) < threshold )
+               && ( Channels == 1 || ( fabs(this->mean2[reg1] - this->mean2[reg2]) < threshold
+                                       && fabs(this->mean3[reg1] - this->mean3[reg2]) < threshold ) ) )
             {
                 dsf->join(reg1, reg2);  // merge two regions
                 reg = dsf->find(reg1);  // resulting region
@@ -226,8 +670,141 @@ void SRMSeg :: segmentGraph(RegionPair* pairs, int numEdges)
 
                 // update mean values
                 this->mean1[reg] = ( (size1*this->mean1[reg1]) + (size2*this->mean1[reg2]) )/size;
-                this->mean2[reg] = ( (size1*this->mean2[reg1]) + (size2*this->mean2[reg2]) )/size;
-                this->mean3[reg] = ( (size1*this->mean3[reg1]) + (size2*this->mean3[reg2]) )/size;
+                if( Channels == 3 )
+                {
+                    this->mean2[reg] = ( (size1*this->mean2[reg1]) + (size2*this->mean2[reg2]) )/size;
+                    this->mean3[reg] = ( (size1*this->mean3[reg1]) + (size2*this->mean3[reg2]) )/size;
+                }
+            }
+        }
+    }
+}
+
+#ifdef __SIZEOF_INT128__
+typedef __int128 int128;
+#endif
+
+/// fractional bits of the fixed-point size thresholds
+#define THRESHOLD_FRACTION_BITS 24
+
+/**
+ * fixed-point threshold of a region of `size` pixels:
+ * (NUM_GRAY^2 / 2Q) * ( min(NUM_GRAY, size) * log(1 + size) + logdelta ) * 2^24;
+ * the squared SRM threshold of regions of sizes n1, n2 is ( H(n1)/n1 + H(n2)/n2 ) / 2^24
+ */
+long long SRMSeg :: sizeThreshold( int size )
+{
+    long long& h = this->sizeThresholds[size];
+    if( h < 0 )
+    {
+        double logdelta = 2.0 * log( 6.0 * this->numNodes );
+        double threshfactor = ( NUM_GRAY * NUM_GRAY ) / ( 2.0 * this->Q );
+        h = (long long)( threshfactor * ( MIN2( NUM_GRAY, size ) * log( 1.0 + size ) + logdelta )
+                         * ( 1 << THRESHOLD_FRACTION_BITS ) + 0.5 );
+    }
+    return h;
+}
+
+/**
+ * |sum1/size1 - sum2/size2| < threshold for all channels, in integers:
+ * with D = sum1*size2 - sum2*size1 and k = size1*size2 the test is
+ * D^2 * 2^24 < ( H(size1)*size2 + H(size2)*size1 ) * k. D^2 does not fit
+ * in 128 bits for large regions (k >= 2^32), then D^2/k = q + r/k is computed
+ * from |D| = a*k + b (a <= 255) as q = |D|*a + a*b + b^2 / k, r = b^2 % k
+ */
+bool SRMSeg :: similarFixed( int reg1, int reg2, int size1, int size2 )
+{
+#ifdef __SIZEOF_INT128__
+    int128 k = (int128)size1 * size2;
+    int128 x = (int128)sizeThreshold( size1 ) * size2 + (int128)sizeThreshold( size2 ) * size1;
+
+    int nc = this->channels;
+    const long long* s1 = this->sums + nc * (size_t)reg1;
+    const long long* s2 = this->sums + nc * (size_t)reg2;
+
+    // small regions (most pairs): D^2 * 2^24 and x * k fit, no division
+    if( k < ( (int128)1 << 32 ) && x < ( (int128)1 << 94 ) )
+    {
+        int128 xk = x * k;
+        for ( int c = 0; c < nc; c++ )
+        {
+            int128 u = (int128)s1[c] * size2 - (int128)s2[c] * size1;
+            if( ( ( u * u ) << THRESHOLD_FRACTION_BITS ) >= xk )
+                return false;
+        }
+        return true;
+    }
+
+    for ( int c = 0; c < nc; c++ )
+    {
+        int128 u = (int128)s1[c] * size2 - (int128)s2[c] * size1;
+        if( u < 0 )
+            u = -u;
+
+        int128 a = u / k;
+        int128 b = u - a * k;
+        int128 bb = b * b;
+        int128 q = u * a + a * b + bb / k;
+        int128 r = bb - ( bb / k ) * k;
+
+        // ( q + r/k ) * 2^24 < x
+        int128 A = q << THRESHOLD_FRACTION_BITS;
+        if( A >= x )
+            return false;
+        int128 diff = x - A;
+        if( diff < ( (int128)1 << THRESHOLD_FRACTION_BITS ) && ( r << THRESHOLD_FRACTION_BITS ) >= diff * k )
+            return false;
+    }
+    return true;
+#else
+    return false;
+#endif
+}
+
+/**
+ * merge loop of the fixed-point path: integer sums, no float in the predicate
+ */
+template< typename Pairs >
+void SRMSeg :: mergeRegionsFixed( const Pairs& p, int numEdges )
+{
+    // thresholds depend on Q and the node count only, kept over the segmentations
+    if( this->thresholdQ != this->Q || this->thresholdNodes != this->numNodes )
+    {
+        this->sizeThresholds.assign( this->numNodes + 1, -1 );
+        this->thresholdQ = this->Q;
+        this->thresholdNodes = this->numNodes;
+    }
+
+    int reg1, reg2, reg;
+    int size1, size2;
+    for (int i = 0; i < numEdges; i++)
+    {
+        if( ( i % CANCEL_CHECK_EDGES ) == 0 && this->stopRequested() )
+            return;
+
+        reg1 = this->dsf -> find( p.a(i) );
+        reg2 = this->dsf -> find( p.b(i) );
+        if( reg1 != reg2 )
+        {
+            size1 = this->dsf->setSize(reg1);
+            size2 = this->dsf->setSize(reg2);
+            if( this->similarFixed( reg1, reg2, size1, size2 ) )
+            {
+                dsf->join(reg1, reg2);
+                reg = dsf->find(reg1);
+
+                // sums of the merged region at its root
+                int nc = this->channels;
+                long long* s = this->sums + nc * (size_t)reg;
+                const long long* s1 = this->sums + nc * (size_t)reg1;
+                const long long* s2 = this->sums + nc * (size_t)reg2;
+                if( nc == 1 )
+                    s[0] = s1[0] + s2[0];
+                else
+                {
+                    long long t0 = s1[0] + s2[0], t1 = s1[1] + s2[1], t2 = s1[2] + s2[2];
+                    s[0] = t0; s[1] = t1; s[2] = t2;
+                }
             }
         }
     }
@@ -236,14 +813,35 @@ void SRMSeg :: segmentGraph(RegionPair* pairs, int numEdges)
 /// merge small components (< minsize)
 void SRMSeg :: mergeSmall(RegionPair* pairs, int numEdges, int minsize)
 {
-    RegionPair* pair = 0;
-    int reg1, reg2;
-    int size1, size2;
+    this->mergeSmallRegions( PairArray(pairs), numEdges, minsize );
+}
+
+void SRMSeg :: mergeSmall()
+{
+    // not after a stop request, the partial result is kept as is
+    if( this->interrupted )
+        return;
+
+    PerfScope scope( this->profiler, "srm small", this->numEdges );
+    if( !this->compact )
+        this->mergeSmallRegions( PairArray(this->pairs), this->numEdges, (int)this->minsize );
+    else
+        this->mergeSmallRegions( GridKeyArray( this->keys, this->width, this->masked ? this->nodeMap : 0 ),
+                                 this->numEdges, (int)this->minsize );
+}
+
+template< typename Pairs >
+void SRMSeg :: mergeSmallRegions( const Pairs& p, int numEdges, int minsize )
+{
+    int reg1, reg2, reg;
+    int size1, size2, size;
     for (int i = 0; i < numEdges; i++)
     {
-        pair = &pairs[i];
-        reg1 = this->dsf -> find( pair->reg1 );
-        reg2 = this->dsf -> find( pair->reg2 );
+        if( ( i % CANCEL_CHECK_EDGES ) == 0 && this->stopRequested() )
+            return;
+
+        reg1 = this->dsf -> find( p.a(i) );
+        reg2 = this->dsf -> find( p.b(i) );
         if( reg1 != reg2 )
         {
             size1 = this->dsf->setSize(reg1);
@@ -251,16 +849,38 @@ void SRMSeg :: mergeSmall(RegionPair* pairs, int numEdges, int minsize)
 
             // merge if distance is less than threshold
             if( size1 < minsize || size2 < minsize )
+            {
                 dsf->join(reg1, reg2);  // merge two regions
+                reg = dsf->find(reg1);
+                size = size1 + size2;
+
+                // means (sums) of the merged region, for renderMeans
+                if( this->fixedPoint )
+                {
+                    int nc = this->channels;
+                    for ( int c = 0; c < nc; c++ )
+                    {
+                        long long t = this->sums[ nc * (size_t)reg1 + c ] + this->sums[ nc * (size_t)reg2 + c ];
+                        this->sums[ nc * (size_t)reg + c ] = t;
+                    }
+                }
+                else
+                {
+                    this->mean1[reg] = ( (size1*this->mean1[reg1]) + (size2*this->mean1[reg2]) )/size;
+                    if( this->channels == 3 )
+                    {
+                        this->mean2[reg] = ( (size1*this->mean2[reg1]) + (size2*this->mean2[reg2]) )/size;
+                        this->mean3[reg] = ( (size1*this->mean3[reg1]) + (size2*this->mean3[reg2]) )/size;
+                    }
+                }
+            }
         }
     }
 }
 
-int SRMSeg :: distance(Vec3b& pix1, Vec3b& pix2)
+int SRMSeg :: distance(const Vec3b& pix1, const Vec3b& pix2)
 {
-    return MAX3( abs(pix1[0] - pix2[0]),
-                 abs(pix1[1] - pix2[1]),
-                 abs(pix1[2] - pix2[2]));
+    return (int)DistLinf()( pix1, pix2 );
 }
 
 
@@ -274,35 +894,29 @@ void SRMSeg :: getLabels( Mat& labels )
 	int w = this->width;
     int h = this->height;
 
-    if(labels.empty())
-        labels.create(h, w, CV_8UC1 );
+    labels.create(h, w, CV_8UC1 );     // no-op if already h x w of this type
 
-    vector <int> sids;
+    // label of each root, in raster order of first appearance
+    vector<int> rootLabel( dsf->getNumElements(), -1 );
+    int numLabels = 0;
 
-    bool found;
     int s;
     int yw;
     for ( int y = 0; y < h; y++ ) {
         yw = y * w;
         for ( int x = 0; x < w; x++ ) {
 
-          int comp = dsf->find(yw + x);
-          found = false;
-          for ( int k = sids.size() - 1; k >= 0 ; k-- ){
-              if( comp == sids[k] ){
-                  found = true;
-                  s = k;
-
-                  break;
-              }
-          }
-
-          if( !found )
+          int comp = findPixel(yw + x);
+          if( comp < 0 )
           {
-              sids.push_back( comp );
-              s = (int)sids.size() - 1;
+              labels.at<uchar>(y,x) = 255;
+              continue;
           }
 
+          if( rootLabel[comp] < 0 )
+              rootLabel[comp] = numLabels++;
+          s = rootLabel[comp];
+
           // give label to this pixel, single band image
           // labels start from 0, id of the component
           labels.at<uchar>(y,x) = (uchar)s;
@@ -322,35 +936,29 @@ void SRMSeg :: getLabelsInt( Mat& labels )
 	int w = this->width;
     int h = this->height;
 
-    if(labels.empty())
-        labels.create(h, w, CV_32SC1 );
+    labels.create(h, w, CV_32SC1 );     // no-op if already h x w of this type
 
-    vector <int> sids;
+    // label of each root, in raster order of first appearance
+    vector<int> rootLabel( dsf->getNumElements(), -1 );
+    int numLabels = 0;
 
-    bool found;
     int s;
     int yw;
     for ( int y = 0; y < h; y++ ) {
         yw = y * w;
         for ( int x = 0; x < w; x++ ) {
 
-          int comp = dsf->find(yw + x);
-          found = false;
-          for ( int k = sids.size() - 1; k >= 0 ; k-- ){
-              if( comp == sids[k] ){
-                  found = true;
-                  s = k;
-
-                  break;
-              }
-          }
-
-          if( !found )
+          int comp = findPixel(yw + x);
+          if( comp < 0 )
           {
-              sids.push_back( comp );
-              s = (int)sids.size() - 1;
+              labels.at<int>(y,x) = -1;
+              continue;
           }
 
+          if( rootLabel[comp] < 0 )
+              rootLabel[comp] = numLabels++;
+          s = rootLabel[comp];
+
           // give label to this pixel, single band image
           // labels start from 0, id of the component
           labels.at<int>(y,x) = s;
@@ -360,6 +968,74 @@ void SRMSeg :: getLabelsInt( Mat& labels )
 
 }
 
+/**
+ * labels as per-row runs, straight from the DSF (no dense map);
+ * the same labels as getLabelsInt: 0 .. numComps-1, -1 for inactive pixels
+ */
+void SRMSeg :: getLabelRuns( LabelRuns& runs )
+{
+    if( !dsf )
+        throw "Null pointer, dsf! SRMSeg::getLabelRuns()";
+
+    int w = this->width;
+    int h = this->height;
+    runs.create( w, h );
+
+    // component root -> label, in raster order of first appearance
+    vector<int> rootLabel( dsf->getNumElements(), -1 );
+    int numLabels = 0;
+
+    for ( int y = 0; y < h; y++ )
+    {
+        int yw = y * w;
+        int x0 = 0;
+        int comp = findPixel( yw );
+        for ( int x = 1; x <= w; x++ )
+        {
+            int next = ( x < w ) ? findPixel( yw + x ) : -2;
+            if( next == comp )
+                continue;
+
+            int label = -1;
+            if( comp >= 0 )
+            {
+                if( rootLabel[comp] < 0 )
+                    rootLabel[comp] = numLabels++;
+                label = rootLabel[comp];
+            }
+
+            runs.addRun( x0, x - x0, label );
+            x0 = x;
+            comp = next;
+        }
+        runs.endRow();
+    }
+}
+
+/**
+ * closed region contours (outer boundaries and holes), polygons on the pixel
+ * corners, simplified with max deviation `epsilon` if > 0 (Douglas-Peucker)
+ */
+void SRMSeg :: getContours( vector<RegionContour>& contours, double epsilon )
+{
+    LabelRuns runs;
+    this->getLabelRuns( runs );
+
+    Mat labels;
+    runs.toMat( labels );
+    traceContours( labels.ptr<int>(0), this->width, this->height, 4, contours );
+
+    if( epsilon <= 0.0 )
+        return;
+
+    vector<Point> simplified;
+    for ( size_t i = 0; i < contours.size(); i++ )
+    {
+        simplifyPolygon( contours[i].points, epsilon, simplified );
+        contours[i].points.swap( simplified );
+    }
+}
+
 /**
  * draw the boundaries of the segments with the given color on dst image
  */
@@ -382,9 +1058,9 @@ void SRMSeg :: drawSegmentBoundaries( Mat& dst, Scalar bcolor )
     {
         for ( int x = 0; x < w - 1 ; x++ )
         {
-            cid = dsf->find(y * w + x);
-            cidx = dsf->find(y * w + x + 1);      // right pixel
-            cidy = dsf->find( (y + 1) * w + x);   // bottom pixel
+            cid = findPixel(y * w + x);
+            cidx = findPixel(y * w + x + 1);      // right pixel
+            cidy = findPixel( (y + 1) * w + x);   // bottom pixel
 
             flag = false;
             if(cid != cidx)
@@ -412,3 +1088,59 @@ void SRMSeg :: drawSegmentBoundaries( Mat& dst, Scalar bcolor )
     }
 
 }
+
+/// 8-bit value of a mean, rounded and clamped
+static inline uchar meanValue( float v )
+{
+    int i = cvRound( v );
+    return (uchar)( i < 0 ? 0 : i > 255 ? 255 : i );
+}
+
+/**
+ * mean color image: one color per region from the flattened forest, then the rows
+ */
+void SRMSeg :: renderMeans( Mat& dst )
+{
+    if( !dsf )
+        throw "Null pointer, dsf! SRMSeg::renderMeans()";
+
+    LabelSnapshot snapshot;
+    snapshot.build( *this->dsf );
+
+    // color of each region, from the means (sums) at its root
+    int nc = this->channels;
+    vector<uchar> colors( nc * snapshot.getNumLabels() );
+    for ( int l = 0; l < snapshot.getNumLabels(); l++ )
+    {
+        int r = snapshot.labelRoot( l );
+        for ( int c = 0; c < nc; c++ )
+        {
+            float mean;
+            if( this->fixedPoint )
+                mean = (float)( (double)this->sums[ nc * (size_t)r + c ] / snapshot.labelSize( l ) );
+            else
+                mean = ( c == 0 ) ? this->mean1[r] : ( c == 1 ) ? this->mean2[r] : this->mean3[r];
+            colors[ nc * l + c ] = meanValue( mean );
+        }
+    }
+
+    int w = this->width;
+    int h = this->height;
+    dst.create( h, w, nc == 1 ? CV_8UC1 : CV_8UC3 );
+
+    const int* map = this->masked ? this->nodeMap : 0;
+    const int* labels = snapshot.getLabels();
+#ifdef _OPENMP
+    #pragma omp parallel for num_threads(this->numThreads) schedule(static) if(this->numThreads > 1)
+#endif
+    for ( int y = 0; y < h; y++ )
+    {
+        uchar* drow = dst.ptr<uchar>(y);
+        for ( int x = 0, p = y * w; x < w; x++, p++ )
+        {
+            int node = map ? map[p] : p;
+            for ( int c = 0; c < nc; c++ )
+                drow[ nc * x + c ] = ( node < 0 ) ? 0 : colors[ nc * labels[node] + c ];
+        }
+    }
+}
@@ -11,9 +11,25 @@
 #ifndef SRMSEG__H__
 #define SRMSEG__H__
 
+#include <algorithm>
+#include <new>
+#include <vector>
+
 #include "opencv2/core/core.hpp"
 
+#include "CancelToken.h"
+#include "Contours.h"
 #include "DisjointSet.h"
+#include "Distance.h"
+#include "GridEdge.h"
+#include "GridGraph.h"
+#include "ImageView.h"
+#include "LabelRuns.h"
+#include "LabelSnapshot.h"
+#include "NodeMap.h"
+#include "PerfProfiler.h"
+#include "RegionCount.h"
+#include "RowSmoother.h"
 
 using namespace cv;
 
@@ -22,6 +38,94 @@ typedef struct
  int reg1, reg2, delta;
 } RegionPair;
 
+
+/// graph builder output: region pairs
+/// (p, dir: source pixel and direction, used by the compact output)
+struct PairSink
+{
+    RegionPair* pairs;
+    int n;
+
+    PairSink( RegionPair* pairs ) : pairs(pairs), n(0) {}
+
+    void operator()( int, int, int a, int b, int delta )
+    {
+        pairs[n].reg1 = a;
+        pairs[n].reg2 = b;
+        pairs[n].delta = delta;
+        n++;
+    }
+};
+
+/// edge weight of the graph builders: the distance rounded to int (delta)
+template< typename Metric >
+struct RoundedDelta
+{
+    Metric& metric;
+
+    RoundedDelta( Metric& metric ) : metric(metric) {}
+
+    template< typename Pixel >
+    int operator()( const Pixel& a, const Pixel& b ) { return (int)( metric( a, b ) + 0.5f ); }
+};
+
+/// graph builder output, compact: grid keys bucket sorted by delta (counting sort),
+/// the graph is built twice, first counting the deltas, then storing the keys;
+/// the deltas themselves are not stored
+struct DeltaKeySink
+{
+    gridkey* keys;
+    std::vector<int>& next;
+    bool scatter;
+    int n;
+
+    DeltaKeySink( gridkey* keys, std::vector<int>& next ) : keys(keys), next(next), scatter(false), n(0)
+    {
+        next.clear();
+    }
+
+    void operator()( int p, int dir, int, int, int delta )
+    {
+        if( delta < 0 )
+            delta = 0;
+
+        if( scatter )
+            keys[ next[delta]++ ] = gridKey( p, dir );
+        else
+        {
+            if( delta >= (int)next.size() )
+                next.resize( delta + 1, 0 );
+            next[delta]++;
+        }
+        n++;
+    }
+
+    /// after counting: bucket start offsets, then store the keys
+    void startScatter()
+    {
+        int start = 0;
+        for ( size_t d = 0; d < next.size(); d++ )
+        {
+            int count = next[d];
+            next[d] = start;
+            start += count;
+        }
+        scatter = true;
+        n = 0;
+    }
+};
+
+/// pair list access for the merge loops
+struct PairArray
+{
+    const RegionPair* pairs;
+
+    PairArray( const RegionPair* pairs ) : pairs(pairs) {}
+
+    int a( int i ) const { return pairs[i].reg1; }
+    int b( int i ) const { return pairs[i].reg2; }
+};
+
 class SRMSeg
 {
     public:
@@ -32,32 +136,189 @@ class SRMSeg
         void allocate(int w, int h);
         void deallocate();
 
-        void initializeMeans(Mat& image);
+        template< typename Pixel >
+        void initializeMeans(const ImageView& image);
+        /// means of the active nodes (nodeMap)
+        template< typename Pixel >
+        void initializeMeansMasked(const ImageView& image, const Rect& bounds);
+
+        /// segment an 8-bit gray, BGR/RGB or BGRA/RGBA image (Linf distance);
+        /// a cv::Mat or a view of any buffer (ImageView), the image is not modified;
+        /// gray images are segmented on one mean plane (no conversion to BGR)
+        void segment(const ImageView& image, float Q = 40.0f, float minsize = 100.0f);
+        /// segment with the distance functor `metric` (see Distance.h) ordering the edges;
+        /// `image` is a 1 or 3-channel feature plane of type `Pixel`, in the range [0,255]
+        template< typename Pixel, typename Metric >
+        void segment(const ImageView& image, Metric metric, float Q = 40.0f, float minsize = 100.0f);
+
+        /// segmentation restricted to the active pixels: mask(y,x) != 0 (CV_8UC1, optional)
+        /// and inside one of `rois` (optional); graph nodes and edges are built only for
+        /// the active pixels (compact node ids), inactive pixels get label -1
+        void segment(const ImageView& image, const Mat& mask, const std::vector<Rect>& rois = std::vector<Rect>(),
+                     float Q = 40.0f, float minsize = 100.0f);
+        template< typename Pixel, typename Metric >
+        void segmentMasked(const ImageView& image, const Mat& mask, const std::vector<Rect>& rois,
+                           Metric metric, float Q = 40.0f, float minsize = 100.0f);
+
+        /// coarse-to-fine (preview) segmentation: segment the image downscaled by 2^levels,
+        /// project the labels up, bulk-assign the interior pixels and re-evaluate the
+        /// full resolution edges only within `band` coarse pixels of the projected boundaries
+        /// (8-bit BGR/RGB image); throws if 2^levels exceeds the width or the height
+        void segmentPyramid(const ImageView& image, float Q = 40.0f, float minsize = 100.0f, int levels = 2, int band = 1);
 
-        void segment(Mat& image, float Q = 40.0f, float minsize = 100.0f);
         void segmentGraph(RegionPair* pairs, int numEdges);
         void mergeSmall(RegionPair* pairs, int numEdges, int minsize);
 
-        int buildGraph4( Mat& image );
-        inline int distance(Vec3b& pix1, Vec3b& pix2);
+        /// merge phase again with another Q, on the graph of the last segment() of `image`
+        /// (built and sorted, not rebuilt; the means are reset from the image): regions
+        /// merged, then small regions; returns the number of regions, -1 if stopped by the
+        /// cancel token. Throws after segmentPyramid or a segmentation stopped early
+        int replayMerge(const ImageView& image, float Q);
+        /// the same for a feature plane of type `Pixel` (segment<Pixel>)
+        template< typename Pixel >
+        int replayMerge(const ImageView& image, float Q);
+
+        /// segment an 8-bit gray, BGR/RGB or BGRA/RGBA image into about `numRegions` regions:
+        /// one graph build and sort, then replayMerge with Q searched from `Q` (see RegionCount.h),
+        /// at most `maxReplays` replays; the segmentation with the closest number of
+        /// regions is kept. Returns its Q
+        float segmentToCount(const ImageView& image, int numRegions, float Q = 40.0f, float minsize = 100.0f, int maxReplays = 16);
+
+        /// store the graph as 32-bit grid keys (source pixel, direction, see GridEdge.h),
+        /// bucket sorted by delta, 4 bytes per edge instead of 12; images up to 2^30 pixels
+        void setCompactEdges( bool compact );
+
+        /// graph node numbering of the pixels (NodeOrder, see NodeMap.h): ORDER_RASTER
+        /// (default), ORDER_TILED or ORDER_MORTON in tile x tile blocks (Morton: power of two);
+        /// keeps the DSF and the region means of a block together, the segmentation
+        /// does not change; segmentPyramid always uses raster order
+        void setNodeOrder( int order, int tile = 64 );
+
+        /// fixed-point merge predicate: integer channel sums per region (pixel values rounded
+        /// to integers) and an integer threshold table per region size, the mean comparison is
+        /// done on squared, cross-multiplied sums in 128-bit integers (no float division in the
+        /// merge loop); the decisions are the exact SRM predicate with the thresholds in
+        /// 24 fractional bits, the same as the float path unless float rounding decides,
+        /// and the same on every build. Needs a compiler with 128-bit integers (gcc, clang)
+        void setFixedPoint( bool fixed );
+        bool fixedPointMerge() const { return fixedPoint; }
 
-        //uchar labels (upto 255 components), may overfow!!
+        /// bytes allocated for a w x h image: by allocate(), pairs (12 bytes, compact: 4 bytes each),
+        /// region means (one plane per channel: 1, or 3 after the first color image) and DSF;
+        /// nodeMap: plus the node map of masked or tiled/Morton ordered segmentation (4 bytes per pixel);
+        /// fixedPoint: plus the sums and the threshold table of the fixed-point merge (8 bytes per
+        /// channel and pixel, 8 bytes per pixel); pyramidLevels > 0: plus the coarse segmenter of
+        /// segmentPyramid (1/4^levels of the image) and its band buffers
+        static size_t memoryFootprint(int w, int h, bool compact = false, int channels = 3,
+                                      bool nodeMap = false, bool fixedPoint = false, int pyramidLevels = 0);
+        /// bytes allocated now: allocate(), node map, fixed-point tables and coarse segmenter
+        size_t memoryUsage() const;
+
+        /// hard memory budget in bytes, 0: no limit (default); compact edges are used if the
+        /// pairs do not fit, and allocate() throws if the compact edges do not fit either;
+        /// the node map, the fixed-point tables and the segmentPyramid storage, allocated on
+        /// first use, throw if they do not fit with the storage allocated before
+        void setMemoryBudget(size_t bytes);
+        size_t getMemoryBudget() const { return memoryBudget; }
+
+        /// true if the edges are compact (requested with setCompactEdges, or for the memory budget)
+        bool compactEdges() const { return compact; }
+
+        /// threads for building the pairs of all pixels and for renderMeans (OpenMP, 1: serial, default);
+        /// the results do not depend on the number of threads; compact, masked,
+        /// tiled/Morton ordered and pyramid graphs are built serially
+        void setNumThreads( int n ) { numThreads = ( n < 1 ) ? 1 : n; }
+
+        /// stop request checked while segmenting (see CancelToken.h), NULL: none (default);
+        /// the token must stay alive while this segmenter uses it
+        void setCancelToken( const CancelToken* token ) { cancelToken = token; }
+        /// true if the last segmentation was stopped by the cancel token: partial
+        /// result, the merges up to the stop, no small region merging
+        bool wasInterrupted() const { return interrupted; }
+
+        /// profile the phases (build, sort, merge, small regions) into `profiler`
+        /// (see PerfProfiler.h), NULL: no profiling (default); one profiler per thread
+        void setProfiler( PerfProfiler* profiler ) { this->profiler = profiler; }
+
+        int buildGraph4( const ImageView& image );
+        /// edges are written to `out` (PairSink, DeltaKeySink)
+        template< typename Pixel, typename Metric, typename Sink >
+        int buildGraph4( const ImageView& image, Metric& metric, Sink& out, int y0 = 0, int y1 = -1 );
+        /// pairs between the active pixels (nodeMap), inside `bounds`
+        template< typename Pixel, typename Metric, typename Sink >
+        int buildGraphMasked( const ImageView& image, Metric& metric, const Rect& bounds, Sink& out );
+        /// only the edges with at least one end in the band (inBand[node] != 0)
+        template< typename Pixel, typename Metric, typename Sink >
+        int buildGraphBand( const ImageView& image, Metric& metric, const uchar* inBand, Sink& out );
+        int distance(const Vec3b& pix1, const Vec3b& pix2);
+
+        //uchar labels (upto 255 components), may overfow!! (masked: inactive pixels are 255, -1 in getLabelsInt)
         void getLabels( Mat& labels );
         // integer labels
         void getLabelsInt(Mat& labels);
+        /// labels as per-row runs (see LabelRuns), built from the DSF without a dense map;
+        /// no label limit, same labels as getLabelsInt
+        void getLabelRuns( LabelRuns& runs );
+        /// closed region contours, outer boundaries and holes (see Contours.h), in one raster
+        /// pass with crack following; polygons simplified if epsilon > 0 (Douglas-Peucker)
+        void getContours( std::vector<RegionContour>& contours, double epsilon = 0.0 );
 
         /// draw the segment boundaries with the given color
         void drawSegmentBoundaries( Mat& dst, Scalar bcolor = Scalar(0,255,222) );
 
+        /// each pixel painted with the mean color of its region, from the region means at
+        /// the roots (no pass over the image): CV_8UC3 in the channel order of the image,
+        /// CV_8UC1 for gray images; inactive pixels (masked) are 0; rows on numThreads threads
+        void renderMeans( Mat& dst );
+
         /// Number of components in the current segmentation
         int getNumComps() const { return ( dsf != NULL ) ? dsf->numSets() : -1; }
 
     protected:
 
+        /// build the graph into pairs, or keys (compact): all pixels, the active pixels
+        /// inside `bounds` (masked) or the band pixels (inBand, segmentPyramid)
+        template< typename Pixel, typename Metric >
+        int buildGraph( const ImageView& image, Metric& metric, const Rect* bounds = 0, const uchar* inBand = 0 );
+        template< typename Pixel, typename Metric, typename Sink >
+        int buildGraphInto( const ImageView& image, Metric& metric, const Rect* bounds, const uchar* inBand, Sink& out );
+        /// pairs of all pixels in bands of rows on numThreads threads, each row from its fixed
+        /// offset (gridRowEdges), the same pair list as the serial build
+        template< typename Pixel, typename Metric >
+        int buildGraphParallel( const ImageView& image, Metric& metric );
+
+        /// merge over the current graph (pairs or keys) and eliminate small regions
+        void segmentGraph();
+        void mergeSmall();
+        /// merge over the current graph, already sorted
+        void mergeGraph();
+
+        /// merge loops over PairArray or GridKeyArray, in processing order
+        template< typename Pairs >
+        void mergeRegions( const Pairs& p, int numEdges );
+        template< int Channels, typename Pairs >
+        void mergeRegions( const Pairs& p, int numEdges, float logdelta, float threshfactor );
+        template< typename Pairs >
+        void mergeRegionsFixed( const Pairs& p, int numEdges );
+
+        /// mean planes for 1 (gray) or 3 channels, mean2 and mean3 allocated on first use
+        void setChannels( int channels );
+
+        /// fixed-point merge: sums allocated on first use, SRM predicate on the sums of regions
+        /// reg1, reg2 (sizes size1, size2), threshold of a region of `size` pixels
+        void allocateSums();
+        bool similarFixed( int reg1, int reg2, int size1, int size2 );
+        long long sizeThreshold( int size );
+        template< typename Pairs >
+        void mergeSmallRegions( const Pairs& p, int numEdges, int minsize );
+
         /// current image size
         int width;
         int height;
 
+        /// number of graph nodes: width*height, or the number of active pixels (masked)
+        int numNodes;
+
         /// determines the coarseness/fineness of segmentation
         /// larger value more (smaller) regions
         float Q;
@@ -68,15 +329,404 @@ class SRMSeg
         int numEdges;
 
         /// mean values for each channels, e.g., Red, Green, Blue
+        /// gray: mean1 only, mean2 and mean3 are not used (NULL until a color image)
         float* mean1;
         float* mean2;
         float* mean3;
+        int channels;
+
+        /// fixed-point merge: channel sums of each region (`channels` per node, at the roots),
+        /// allocated on first use, for sumChannels channels; threshold per region size (-1: not computed yet)
+        /// for the Q and node count in thresholdQ, thresholdNodes
+        bool fixedPoint;
+        long long* sums;
+        int sumChannels;
+        std::vector<long long> sizeThresholds;
+        float thresholdQ;
+        int thresholdNodes;
 
         /// region pairs, edges..
         RegionPair* pairs;
 
+        /// compact mode: grid keys bucket sorted by delta, instead of `pairs`
+        /// deltaStart[d]: end of bucket d (start of bucket d+1)
+        bool compact;
+        bool compactRequested;
+        gridkey* keys;
+        std::vector<int> deltaStart;
+
+        /// memory budget of allocate(), the node map, the fixed-point tables and segmentPyramid, 0: no limit
+        size_t memoryBudget;
+        /// throws `error` if `bytes` exceed the memory budget
+        void checkMemoryBudget(size_t bytes, const char* error) const
+        {
+            if( memoryBudget && bytes > memoryBudget )
+                throw error;
+        }
+
+        /// graph building threads
+        int numThreads;
+
+        /// stop request, and whether the last segmentation stopped early
+        const CancelToken* cancelToken;
+        bool interrupted;
+
+        /// the sorted graph of the last segmentation can be replayed (replayMerge),
+        /// bounding box of the active pixels (masked) for the means
+        bool replayable;
+        Rect nodeBounds;
+
+        /// phase profiling, or NULL
+        PerfProfiler* profiler;
+
+        /// true (and `interrupted` set) if the cancel token requests a stop
+        bool stopRequested()
+        {
+            if( !interrupted && cancelToken && cancelToken->stopRequested() )
+                interrupted = true;
+            return interrupted;
+        }
+
         /// disjoint set forest
         DisjointSet* dsf;
+
+        /// segmenter for the coarse level in segmentPyramid, allocated on first use
+        SRMSeg* coarse;
+
+        /// pixel (y*width + x) -> graph node, -1 for inactive pixels
+        /// used if `masked` (mask, ROIs or node order), otherwise node = pixel; allocated on first use
+        int* nodeMap;
+        bool masked;
+
+        /// node numbering (NodeOrder) and its block size
+        int nodeOrder;
+        int orderTile;
+
+        /// graph node of pixel p, -1 if not active
+        int nodeOf( int p ) const { return masked ? nodeMap[p] : p; }
+        /// region of pixel p, -1 if not active
+        int findPixel( int p ) { int n = nodeOf(p); return ( n < 0 ) ? -1 : dsf->find(n); }
 };
 
+
+/**
+ * initialize the means (1 or 3 channels) with the pixel values
+ */
+template< typename Pixel >
+void SRMSeg::initializeMeans(const ImageView& image)
+{
+    int width = image.width;
+    int height = image.height;
+
+    int x, y;
+    int index = 0;
+    for (y = 0; y < height; y++)
+    {
+        const Pixel* row = image.ptr<Pixel>(y);
+        for (x = 0; x < width; x++)
+        {
+            const Pixel& pix = row[x];
+
+            this->mean1[index] = PixelTraits<Pixel>::channel( pix, 0 );
+            if( this->channels == 3 )
+            {
+                this->mean2[index] = PixelTraits<Pixel>::channel( pix, 1 );
+                this->mean3[index] = PixelTraits<Pixel>::channel( pix, 2 );
+            }
+            if( this->fixedPoint )
+            {
+                for ( int c = 0; c < this->channels; c++ )
+                    this->sums[ this->channels * index + c ] = cvRound( PixelTraits<Pixel>::channel( pix, c ) );
+            }
+            index++;
+        }
+    }
+}
+
+template< typename Pixel, typename Metric >
+void SRMSeg::segment(const ImageView& image, Metric metric, float Q, float minsize)
+{
+    // tiled/Morton nodes: the node map of all pixels
+    if( this->nodeOrder != ORDER_RASTER )
+    {
+        this->segmentMasked<Pixel>(image, Mat(), std::vector<Rect>(), metric, Q, minsize);
+        return;
+    }
+
+    this->reallocate(image.width, image.height);
+
+	this->Q = Q;
+	this->minsize = minsize;
+    this->interrupted = false;
+    this->replayable = false;
+
+    this->masked = false;
+    this->numNodes = this->width * this->height;
+
+    this->setChannels( PixelTraits<Pixel>::channels == 1 ? 1 : 3 );
+    this->allocateSums();
+    this->initializeMeans<Pixel>(image);
+
+    {
+        PerfScope scope( this->profiler, "srm build" );
+        this->numEdges = buildGraph<Pixel>( image, metric );
+        scope.setItems( this->numEdges );
+    }
+
+    this->dsf->reset();
+
+    this->segmentGraph();
+    this->replayable = !this->interrupted;
+
+    this->mergeSmall();
+}
+
+/**
+ * initialize the means of the active nodes with the pixel values
+ */
+template< typename Pixel >
+void SRMSeg::initializeMeansMasked(const ImageView& image, const Rect& bounds)
+{
+    int x, y;
+    for (y = bounds.y; y < bounds.y + bounds.height; y++)
+    {
+        const Pixel* row = image.ptr<Pixel>(y);
+        const int* nrow = this->nodeMap + y * image.width;
+        for (x = bounds.x; x < bounds.x + bounds.width; x++)
+        {
+            int node = nrow[x];
+            if( node < 0 )
+                continue;
+
+            const Pixel& pix = row[x];
+            this->mean1[node] = PixelTraits<Pixel>::channel( pix, 0 );
+            if( this->channels == 3 )
+            {
+                this->mean2[node] = PixelTraits<Pixel>::channel( pix, 1 );
+                this->mean3[node] = PixelTraits<Pixel>::channel( pix, 2 );
+            }
+            if( this->fixedPoint )
+            {
+                for ( int c = 0; c < this->channels; c++ )
+                    this->sums[ this->channels * node + c ] = cvRound( PixelTraits<Pixel>::channel( pix, c ) );
+            }
+        }
+    }
+}
+
+/**
+ * segment the active pixels only
+ */
+template< typename Pixel, typename Metric >
+void SRMSeg::segmentMasked(const ImageView& image, const Mat& mask, const std::vector<Rect>& rois,
+                           Metric metric, float Q, float minsize)
+{
+    if( mask.empty() && rois.empty() && this->nodeOrder == ORDER_RASTER )
+    {
+        this->segment<Pixel>(image, metric, Q, minsize);
+        return;
+    }
+
+    this->reallocate(image.width, image.height);
+
+	this->Q = Q;
+	this->minsize = minsize;
+    this->interrupted = false;
+    this->replayable = false;
+
+    if( !this->nodeMap )
+    {
+        size_t bytes = (size_t)this->width * this->height * sizeof(int);
+        this->checkMemoryBudget( this->memoryUsage() + bytes, "SRMSeg::segmentMasked - node map exceeds the memory budget!" );
+        this->nodeMap = new (std::nothrow) int[ this->width * this->height ];
+        if( !this->nodeMap )
+            throw "SRMSeg::segmentMasked - out of memory!";
+    }
+
+    Rect bounds;
+    this->numNodes = buildNodeMap( mask, rois, this->width, this->height, this->nodeMap, &bounds );
+    if( this->nodeOrder != ORDER_RASTER )
+        this->numNodes = orderNodeMap( this->nodeOrder, this->orderTile, this->width, this->height, this->nodeMap );
+    this->masked = true;
+    this->nodeBounds = bounds;
+
+    this->setChannels( PixelTraits<Pixel>::channels == 1 ? 1 : 3 );
+    this->allocateSums();
+    this->initializeMeansMasked<Pixel>(image, bounds);
+
+    {
+        PerfScope scope( this->profiler, "srm build" );
+        this->numEdges = buildGraph<Pixel>( image, metric, &bounds );
+        scope.setItems( this->numEdges );
+    }
+
+    this->dsf->reset( this->numNodes );
+
+    this->segmentGraph();
+    this->replayable = !this->interrupted;
+
+    this->mergeSmall();
+}
+
+/**
+ * the sorted pairs (keys) are kept by segmentGraph, the means are reset from the image
+ */
+template< typename Pixel >
+int SRMSeg::replayMerge(const ImageView& image, float Q)
+{
+    if( !this->replayable || image.width != this->width || image.height != this->height )
+        throw "SRMSeg::replayMerge - no sorted graph of this image to replay!";
+
+    this->Q = Q;
+    this->interrupted = false;
+
+    if( this->masked )
+        this->initializeMeansMasked<Pixel>(image, this->nodeBounds);
+    else
+        this->initializeMeans<Pixel>(image);
+
+    this->dsf->reset( this->numNodes );
+    this->mergeGraph();
+    this->mergeSmall();
+
+    return this->interrupted ? -1 : this->dsf->numSets();
+}
+
+/**
+ * build the graph into the current storage; compact: counting pass, then storing pass
+ */
+template< typename Pixel, typename Metric >
+int SRMSeg :: buildGraph( const ImageView& image, Metric& metric, const Rect* bounds, const uchar* inBand )
+{
+    if( !this->compact )
+    {
+        if( this->numThreads > 1 && !bounds && !inBand && image.height > 1 )
+            return buildGraphParallel<Pixel>( image, metric );
+
+        PairSink out( this->pairs );
+        return buildGraphInto<Pixel>( image, metric, bounds, inBand, out );
+    }
+
+    DeltaKeySink out( this->keys, this->deltaStart );
+    buildGraphInto<Pixel>( image, metric, bounds, inBand, out );
+    out.startScatter();
+    return buildGraphInto<Pixel>( image, metric, bounds, inBand, out );
+}
+
+template< typename Pixel, typename Metric, typename Sink >
+int SRMSeg :: buildGraphInto( const ImageView& image, Metric& metric, const Rect* bounds, const uchar* inBand, Sink& out )
+{
+    if( inBand )
+        return buildGraphBand<Pixel>( image, metric, inBand, out );
+    if( bounds )
+        return buildGraphMasked<Pixel>( image, metric, *bounds, out );
+    return buildGraph4<Pixel>( image, metric, out );
+}
+
+template< typename Pixel, typename Metric >
+int SRMSeg :: buildGraphParallel( const ImageView& image, Metric& metric )
+{
+    int width = image.width;
+    int height = image.height;
+
+    std::vector<int> offset( height + 1, 0 );
+    for ( int y = 0; y < height; y++ )
+        offset[y + 1] = offset[y] + gridRowEdges( width, height, y, 4 );
+
+    int numBands = std::min( this->numThreads, height );
+
+#ifdef _OPENMP
+    #pragma omp parallel for num_threads(numBands) schedule(static)
+#endif
+    for ( int b = 0; b < numBands; b++ )
+    {
+        int y0 = (int)( (long long)height * b / numBands );
+        int y1 = (int)( (long long)height * ( b + 1 ) / numBands );
+        PairSink out( this->pairs + offset[y0] );
+        buildGraph4<Pixel>( image, metric, out, y0, y1 );
+    }
+
+    return offset[height];
+}
+
+/**
+ * Build graph, 4 connected, rows y0 .. y1-1 (y1 < 0: all rows),
+ * edge weights (deltas) from `metric`, rounded to int
+ * out( p, dir, reg1, reg2, delta ): pair from pixel p in direction dir (GridDir)
+ */
+template< typename Pixel, typename Metric, typename Sink >
+int SRMSeg :: buildGraph4( const ImageView& image, Metric& metric, Sink& out, int y0, int y1 )
+{
+    if( y1 < 0 )
+        y1 = image.height;
+
+    ViewRows<Pixel> rows( image );
+    RoundedDelta<Metric> delta( metric );
+    return buildGridRows<4, Pixel>( rows, image.width, image.height, delta, out, y0, y1 );
+}
+
+/**
+ * Build graph over the active pixels, 4 connected, pair regions are node ids
+ */
+template< typename Pixel, typename Metric, typename Sink >
+int SRMSeg :: buildGraphMasked( const ImageView& image, Metric& metric, const Rect& bounds, Sink& out )
+{
+    int width = image.width;
+    int height = image.height;
+
+    int x,y;
+    for (y = bounds.y; y < bounds.y + bounds.height; y++) {
+
+        const Pixel* row = image.ptr<Pixel>(y);
+        const Pixel* below = ( y < height - 1 ) ? image.ptr<Pixel>(y+1) : 0;
+        const int* nrow = this->nodeMap + y * width;
+        for (x = bounds.x; x < bounds.x + bounds.width; x++) {
+
+            int a = nrow[x];
+            if ( a < 0 )
+                continue;
+
+            int p = y * width + x;
+            if ( x < width - 1 && nrow[x + 1] >= 0 )
+	            out( p, GRID_RIGHT, a, nrow[x + 1], (int)( metric( row[x], row[x+1] ) + 0.5f ) );
+
+            if ( y < height - 1 && nrow[x + width] >= 0 )
+	            out( p, GRID_DOWN, a, nrow[x + width], (int)( metric( row[x], below[x] ) + 0.5f ) );
+        }
+    }
+
+    return out.n;
+}
+
+/**
+ * Build graph over the band around the projected boundaries (segmentPyramid),
+ * 4 connected; edges between two interior pixels are skipped
+ */
+template< typename Pixel, typename Metric, typename Sink >
+int SRMSeg :: buildGraphBand( const ImageView& image, Metric& metric, const uchar* inBand, Sink& out )
+{
+    int width = image.width;
+    int height = image.height;
+
+    int ywx = 0;    //y * width + x
+    int x,y;
+    for (y = 0; y < height; y++) {
+
+        const Pixel* row = image.ptr<Pixel>(y);
+        const Pixel* below = ( y < height - 1 ) ? image.ptr<Pixel>(y+1) : 0;
+        for (x = 0, ywx = y * width; x < width; x++, ywx++) {
+
+            bool in = inBand[ywx] != 0;
+
+            if ( x < width - 1 && ( in || inBand[ywx + 1] ) )
+	            out( ywx, GRID_RIGHT, ywx, ywx + 1, (int)( metric( row[x], row[x+1] ) + 0.5f ) );
+
+            if ( y < height - 1 && ( in || inBand[ywx + width] ) )
+	            out( ywx, GRID_DOWN, ywx, ywx + width, (int)( metric( row[x], below[x] ) + 0.5f ) );
+        }
+    }
+
+    return out.n;
+}
+
 #endif
@@ -0,0 +1,80 @@
+/***************************************************************
+ * Name:      SegAsync.cpp
+ * Purpose:   Asynchronous segmentation jobs with cancellation and deadlines
+ * Author:    segment-cpp contributors
+ * Created:   18.10.2026
+ * Copyright: segment-cpp contributors
+ * License:
+ **************************************************************/
+
+#include "SegAsync.h"
+
+using namespace std;
+
+/// run one job: token set for the segmentation only, exceptions into the result
+template< typename Seg, typename Run >
+static SegResult runJob( Seg& seg, const CancelToken* token, Run run )
+{
+    SegResult result;
+    if( token && token->stopRequested() )
+    {
+        result.partial = true;
+        return result;
+    }
+
+    seg.setCancelToken( token );
+    try
+    {
+        run();
+        seg.getLabelsInt( result.labels );
+        result.numRegions = seg.getNumComps();
+        result.partial = seg.wasInterrupted();
+    }
+    catch( const char* msg )
+    {
+        result.labels.release();
+        result.error = msg;
+    }
+    seg.setCancelToken( 0 );
+
+    return result;
+}
+
+struct EGBSJob
+{
+    GreedyGraphSeg* seg;
+    Mat image;
+
+    void operator()() { seg->segmentImageColor( image ); }
+};
+
+struct SRMJob
+{
+    SRMSeg* seg;
+    Mat image;
+    float Q, minsize;
+
+    void operator()() { seg->segment( image, Q, minsize ); }
+};
+
+static SegResult runEGBS( GreedyGraphSeg* seg, Mat image, const CancelToken* token )
+{
+    EGBSJob job = { seg, image };
+    return runJob( *seg, token, job );
+}
+
+static SegResult runSRM( SRMSeg* seg, Mat image, float Q, float minsize, const CancelToken* token )
+{
+    SRMJob job = { seg, image, Q, minsize };
+    return runJob( *seg, token, job );
+}
+
+future<SegResult> segmentAsync( GreedyGraphSeg& seg, const Mat& image, const CancelToken* token )
+{
+    return async( launch::async, runEGBS, &seg, image, token );
+}
+
+future<SegResult> segmentAsync( SRMSeg& seg, const Mat& image, float Q, float minsize, const CancelToken* token )
+{
+    return async( launch::async, runSRM, &seg, image, Q, minsize, token );
+}
@@ -0,0 +1,51 @@
+/***************************************************************
+ * Name:      SegAsync.h
+ * Purpose:   Asynchronous segmentation jobs with cancellation and deadlines
+ * Author:    segment-cpp contributors
+ * Created:   18.10.2026
+ * Copyright: segment-cpp contributors
+ * License:
+ **************************************************************/
+
+#ifndef SEGASYNC_H_INCLUDED
+#define SEGASYNC_H_INCLUDED
+
+#include <future>
+#include <string>
+
+#include "opencv2/core/core.hpp"
+
+#include "CancelToken.h"
+#include "GreedyGraphSeg.h"
+#include "SRMSeg.h"
+
+using namespace cv;
+
+/// result of an asynchronous segmentation
+struct SegResult
+{
+    /// labels as getLabelsInt (CV_32SC1), empty on error or if stopped before the start
+    Mat labels;
+    int numRegions;
+    /// stopped by the token (cancel or deadline): the merges up to the stop
+    bool partial;
+    /// message of the exception thrown by the segmenter, empty if none
+    std::string error;
+
+    SegResult() : numRegions(0), partial(false) {}
+};
+
+// Each call segments on a new thread and returns at once. The segmenter (and the
+// token, if any) must stay alive and must not be used elsewhere until the future
+// is ready; the image is shared (cv::Mat reference), not copied. The token is
+// checked before the start, between the phases and in the merge loops, see
+// CancelToken; set the deadline (setTimeout) before the call.
+
+/// EGBS, segmentImageColor
+std::future<SegResult> segmentAsync( GreedyGraphSeg& seg, const Mat& image, const CancelToken* token = 0 );
+
+/// SRM, segment
+std::future<SegResult> segmentAsync( SRMSeg& seg, const Mat& image, float Q = 40.0f, float minsize = 100.0f,
+                                     const CancelToken* token = 0 );
+
+#endif
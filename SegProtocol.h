@@ -0,0 +1,107 @@
+/***************************************************************
+ * Name:      SegProtocol.h
+ * Purpose:   Messages between the segmentation server and its clients
+ * Author:    segment-cpp contributors
+ * Created:   18.10.2026
+ * Copyright: segment-cpp contributors
+ * License:
+ **************************************************************/
+
+#ifndef SEGPROTOCOL_H_INCLUDED
+#define SEGPROTOCOL_H_INCLUDED
+
+// segserver listens on a Unix domain socket; a client sends one SegRequest
+// per frame and reads one SegReply. Pixels and results are not sent over the
+// socket: the client maps a shared memory buffer (memfd, sealed with
+// F_SEAL_SHRINK so it cannot be truncated under the server), passes its file descriptor
+// (SCM_RIGHTS) with the first request (and whenever it changes the buffer,
+// newBuffer = 1), and every request gives the offsets of the image, the label
+// image and the region table in that buffer. The server reads the image in
+// place and writes the labels and regions in place.
+//
+// The buffer must not be written by the client while a request is pending.
+
+#define SEG_PROTOCOL_MAGIC  0x53454731u     // "SEG1"
+#define SEG_SOCKET_PATH     "/tmp/segserver.sock"
+
+enum SegAlgorithm
+{
+    SEG_SRM = 0,
+    SEG_EGBS
+};
+
+/// outputs written into the buffer
+enum SegOutput
+{
+    SEG_OUT_LABELS = 1,         // int labels, width x height, 0 .. numRegions-1 (getLabelsInt)
+    SEG_OUT_REGIONS = 2         // SegRegion table, one entry per label, up to maxRegions
+};
+
+/// status of a reply
+enum SegStatus
+{
+    SEG_OK = 0,
+    SEG_BAD_REQUEST,            // malformed request, offsets outside the buffer, no buffer,
+                                // buffer larger than its file or not sealed
+    SEG_FAILED                  // the segmenter threw, see SegReply::error
+};
+
+/// one entry of the region table
+struct SegRegion
+{
+    int label;
+    int size;
+    /// bounding box, inclusive
+    int x0, y0, x1, y1;
+    /// mean of the channels (gray: mean[0])
+    float mean[3];
+};
+
+struct SegRequest
+{
+    unsigned int magic;
+
+    /// SegAlgorithm, SRM Q or EGBS threshold, min region size, EGBS connectivity (4, 8)
+    int algorithm;
+    float param;
+    int minSize;
+    int connect;
+
+    /// image in the buffer: 8-bit, PixelLayout (ImageView.h), rows `stride` bytes apart
+    int width;
+    int height;
+    int layout;
+    long long stride;
+
+    /// SegOutput flags
+    int outputs;
+
+    /// 1: a new buffer, its descriptor comes with this message
+    int newBuffer;
+    /// buffer size and offsets in bytes; labels and regions are 4-byte aligned
+    long long bufferSize;
+    long long imageOffset;
+    long long labelsOffset;
+    long long regionsOffset;
+    int maxRegions;
+};
+
+struct SegReply
+{
+    unsigned int magic;
+
+    /// SegStatus, message if not SEG_OK
+    int status;
+    char error[128];
+
+    int numRegions;
+    /// entries written to the region table (<= maxRegions)
+    int regionsWritten;
+
+    /// 1 if the segmenter came from the warm pool, 0 if allocated for this request
+    int warm;
+    /// time in the server, from the request to the reply
+    double seconds;
+};
+
+#endif
@@ -0,0 +1,1108 @@
+/***************************************************************
+ * Name:      SegReference.cpp
+ * Purpose:   Reference implementations of EGBS and SRM, equivalence checks
+ * Author:    segment-cpp contributors
+ * Created:   18.10.2026
+ * Copyright: segment-cpp contributors
+ * License:
+ **************************************************************/
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <map>
+#include <vector>
+
+#include "GGBS.h"
+#include "GreedyGraphSeg.h"
+#include "LabelRuns.h"
+#include "LabelSnapshot.h"
+#include "RowSmoother.h"
+#include "SegAsync.h"
+#include "SegReference.h"
+#include "SRMSeg.h"
+#include "VideoGraphSeg.h"
+
+using namespace std;
+
+/// partition distance allowed where only the order of the equal weight edges differs
+#define TIE_TOLERANCE       0.01
+/// partition distance allowed for WEIGHTS_QUANTIZED with step 1/64; on pure noise a few
+/// changed early merges cascade through the thresholds and postProcess (up to ~0.09 seen)
+#define QUANTIZED_TOLERANCE 0.15
+/// partition distance allowed for segmentPyramid with band 1; the interior of the coarse
+/// regions is not re-evaluated (up to ~0.04 seen on blocks, ~0.13 on gradients, ~0.25 on noise)
+#define PYRAMID_TOLERANCE   0.3
+
+namespace
+{
+
+/// disjoint set forest, union by rank, path compression
+class RefDSF
+{
+public:
+    RefDSF( int n ) : p(n), rank(n, 0), size(n, 1) { for ( int i = 0; i < n; i++ ) p[i] = i; }
+
+    int find( int x )
+    {
+        if( p[x] != x )
+            p[x] = find( p[x] );
+        return p[x];
+    }
+
+    void join( int x, int y )
+    {
+        if( x == y )
+            return;
+        if( rank[x] > rank[y] )
+        {
+            p[y] = x;
+            size[x] += size[y];
+        }
+        else
+        {
+            p[x] = y;
+            size[y] += size[x];
+            if( rank[x] == rank[y] )
+                rank[y]++;
+        }
+    }
+
+    int setSize( int x ) const { return size[x]; }
+
+private:
+    vector<int> p, rank, size;
+};
+
+struct RefEdge
+{
+    float w;
+    int a, b;
+    bool operator<( const RefEdge& e ) const { return w < e.w; }
+};
+
+struct RefPair
+{
+    int reg1, reg2, delta;
+    bool operator<( const RefPair& e ) const { return delta < e.delta; }
+};
+
+/// labels 0.. in raster order of first appearance
+void labelsFromDSF( RefDSF& dsf, int w, int h, Mat& labels )
+{
+    labels.create( h, w, CV_32SC1 );
+    vector<int> label( w * h, -1 );
+    int n = 0;
+    for ( int y = 0; y < h; y++ )
+        for ( int x = 0; x < w; x++ )
+        {
+            int r = dsf.find( y * w + x );
+            if( label[r] < 0 )
+                label[r] = n++;
+            labels.at<int>(y, x) = label[r];
+        }
+}
+
+float colorL2( const Vec3b& p1, const Vec3b& p2 )
+{
+    int d0 = p1[0] - p2[0], d1 = p1[1] - p2[1], d2 = p1[2] - p2[2];
+    return (float)sqrt( (double)( d0 * d0 + d1 * d1 + d2 * d2 ) );
+}
+
+int colorLinf( const Vec3b& p1, const Vec3b& p2 )
+{
+    return max( abs( p1[0] - p2[0] ), max( abs( p1[1] - p2[1] ), abs( p1[2] - p2[2] ) ) );
+}
+
+} // namespace
+
+void referenceEGBS( const Mat& image, float threshold, int minSize, int connect, Mat& labels, bool stableOrder )
+{
+    int w = image.cols;
+    int h = image.rows;
+
+    // graph, in the order of the original builders
+    vector<RefEdge> edges;
+    edges.reserve( w * h * ( connect / 2 ) );
+    for ( int y = 0; y < h; y++ )
+        for ( int x = 0; x < w; x++ )
+        {
+            int p = y * w + x;
+            const Vec3b& pix = image.at<Vec3b>(y, x);
+            RefEdge e;
+            e.a = p;
+            if( x < w - 1 )
+            {
+                e.b = p + 1;
+                e.w = colorL2( pix, image.at<Vec3b>(y, x + 1) );
+                edges.push_back( e );
+            }
+            if( y < h - 1 )
+            {
+                e.b = p + w;
+                e.w = colorL2( pix, image.at<Vec3b>(y + 1, x) );
+                edges.push_back( e );
+            }
+            if( connect == 8 && x < w - 1 && y < h - 1 )
+            {
+                e.b = p + w + 1;
+                e.w = colorL2( pix, image.at<Vec3b>(y + 1, x + 1) );
+                edges.push_back( e );
+            }
+            if( connect == 8 && x < w - 1 && y > 0 )
+            {
+                e.b = p - w + 1;
+                e.w = colorL2( pix, image.at<Vec3b>(y - 1, x + 1) );
+                edges.push_back( e );
+            }
+        }
+
+    if( stableOrder )
+        stable_sort( edges.begin(), edges.end() );
+    else
+        sort( edges.begin(), edges.end() );
+
+    RefDSF dsf( w * h );
+    vector<float> thresholds( w * h, threshold );
+    for ( size_t i = 0; i < edges.size(); i++ )
+    {
+        int a = dsf.find( edges[i].a );
+        int b = dsf.find( edges[i].b );
+        if( a != b && edges[i].w <= thresholds[a] && edges[i].w <= thresholds[b] )
+        {
+            dsf.join( a, b );
+            a = dsf.find( a );
+            thresholds[a] = edges[i].w + threshold / dsf.setSize( a );
+        }
+    }
+
+    // small components
+    for ( size_t i = 0; i < edges.size(); i++ )
+    {
+        int a = dsf.find( edges[i].a );
+        int b = dsf.find( edges[i].b );
+        if( a != b && ( dsf.setSize( a ) < minSize || dsf.setSize( b ) < minSize ) )
+            dsf.join( a, b );
+    }
+
+    labelsFromDSF( dsf, w, h, labels );
+}
+
+void referenceSRM( const Mat& image, float Q, float minsize, Mat& labels, bool stableOrder )
+{
+    const int NUM_GRAY = 256;
+
+    int w = image.cols;
+    int h = image.rows;
+
+    vector<float> mean1( w * h ), mean2( w * h ), mean3( w * h );
+    for ( int y = 0; y < h; y++ )
+        for ( int x = 0; x < w; x++ )
+        {
+            const Vec3b& pix = image.at<Vec3b>(y, x);
+            mean1[y * w + x] = pix[0];
+            mean2[y * w + x] = pix[1];
+            mean3[y * w + x] = pix[2];
+        }
+
+    vector<RefPair> pairs;
+    pairs.reserve( 2 * w * h );
+    for ( int y = 0; y < h; y++ )
+        for ( int x = 0; x < w; x++ )
+        {
+            int p = y * w + x;
+            RefPair e;
+            e.reg1 = p;
+            if( x < w - 1 )
+            {
+                e.reg2 = p + 1;
+                e.delta = colorLinf( image.at<Vec3b>(y, x), image.at<Vec3b>(y, x + 1) );
+                pairs.push_back( e );
+            }
+            if( y < h - 1 )
+            {
+                e.reg2 = p + w;
+                e.delta = colorLinf( image.at<Vec3b>(y, x), image.at<Vec3b>(y + 1, x) );
+                pairs.push_back( e );
+            }
+        }
+
+    if( stableOrder )
+        stable_sort( pairs.begin(), pairs.end() );
+    else
+        sort( pairs.begin(), pairs.end() );
+
+    RefDSF dsf( w * h );
+    float logdelta = 2.0 * log( 6.0 * w * h );
+    float threshfactor = ( NUM_GRAY * NUM_GRAY ) / ( 2.0 * Q );
+    for ( size_t i = 0; i < pairs.size(); i++ )
+    {
+        int reg1 = dsf.find( pairs[i].reg1 );
+        int reg2 = dsf.find( pairs[i].reg2 );
+        if( reg1 == reg2 )
+            continue;
+
+        int size1 = dsf.setSize( reg1 );
+        int size2 = dsf.setSize( reg2 );
+        float threshold = sqrt( threshfactor * ( ( ( min( NUM_GRAY, size1 ) * log( 1.0 + size1 ) + logdelta ) / (float)size1 ) +
+                                                 ( ( min( NUM_GRAY, size2 ) * log( 1.0 + size2 ) + logdelta ) / (float)size2 ) ) );
+
+        if( fabs( mean1[reg1] - mean1[reg2] ) < threshold
+            && fabs( mean2[reg1] - mean2[reg2] ) < threshold
+            && fabs( mean3[reg1] - mean3[reg2] ) < threshold )
+        {
+            dsf.join( reg1, reg2 );
+            int reg = dsf.find( reg1 );
+            int size = size1 + size2;
+            mean1[reg] = ( ( size1 * mean1[reg1] ) + ( size2 * mean1[reg2] ) ) / size;
+            mean2[reg] = ( ( size1 * mean2[reg1] ) + ( size2 * mean2[reg2] ) ) / size;
+            mean3[reg] = ( ( size1 * mean3[reg1] ) + ( size2 * mean3[reg2] ) ) / size;
+        }
+    }
+
+    // small regions
+    for ( size_t i = 0; i < pairs.size(); i++ )
+    {
+        int reg1 = dsf.find( pairs[i].reg1 );
+        int reg2 = dsf.find( pairs[i].reg2 );
+        if( reg1 != reg2 && ( dsf.setSize( reg1 ) < (int)minsize || dsf.setSize( reg2 ) < (int)minsize ) )
+            dsf.join( reg1, reg2 );
+    }
+
+    labelsFromDSF( dsf, w, h, labels );
+}
+
+bool samePartition( const Mat& labels1, const Mat& labels2 )
+{
+    if( labels1.rows != labels2.rows || labels1.cols != labels2.cols )
+        return false;
+
+    // label1 -> label2 and label2 -> label1 must both be functions
+    vector<int> map12, map21;
+    for ( int y = 0; y < labels1.rows; y++ )
+        for ( int x = 0; x < labels1.cols; x++ )
+        {
+            int a = labels1.at<int>(y, x) + 1;  // -1: inactive
+            int b = labels2.at<int>(y, x) + 1;
+            if( a >= (int)map12.size() )
+                map12.resize( a + 1, -1 );
+            if( b >= (int)map21.size() )
+                map21.resize( b + 1, -1 );
+
+            if( map12[a] < 0 )
+                map12[a] = b;
+            if( map21[b] < 0 )
+                map21[b] = a;
+            if( map12[a] != b || map21[b] != a )
+                return false;
+        }
+    return true;
+}
+
+double partitionDistance( const Mat& labels1, const Mat& labels2 )
+{
+    int w = labels1.cols;
+    int h = labels1.rows;
+    int pairs = 0, disagree = 0;
+    for ( int y = 0; y < h; y++ )
+        for ( int x = 0; x < w; x++ )
+        {
+            int a = labels1.at<int>(y, x);
+            int b = labels2.at<int>(y, x);
+            if( x < w - 1 )
+            {
+                pairs++;
+                disagree += ( a == labels1.at<int>(y, x + 1) ) != ( b == labels2.at<int>(y, x + 1) );
+            }
+            if( y < h - 1 )
+            {
+                pairs++;
+                disagree += ( a == labels1.at<int>(y + 1, x) ) != ( b == labels2.at<int>(y + 1, x) );
+            }
+        }
+    return pairs ? (double)disagree / pairs : 0.0;
+}
+
+namespace
+{
+
+/// small deterministic generator, same images on every platform
+struct Random
+{
+    unsigned int state;
+    Random( unsigned int seed ) : state( seed ? seed : 1 ) {}
+    unsigned int next() { state = state * 1664525u + 1013904223u; return state >> 8; }
+    int uniform( int n ) { return (int)( next() % (unsigned int)n ); }
+};
+
+const char* imageTypes[] = { "blocks", "gradient", "constant", "noise" };
+
+/// synthetic images: noisy blocks, noisy gradient, constant, pure noise
+void makeImage( Random& rnd, int type, int w, int h, Mat& image )
+{
+    image.create( h, w, CV_8UC3 );
+    int bw = 4 + rnd.uniform( 24 ), bh = 4 + rnd.uniform( 24 );
+    int noise = 1 + rnd.uniform( 24 );
+    for ( int y = 0; y < h; y++ )
+        for ( int x = 0; x < w; x++ )
+        {
+            Vec3b& p = image.at<Vec3b>(y, x);
+            for ( int c = 0; c < 3; c++ )
+            {
+                int v;
+                if( type == 0 )
+                    v = ( ( x / bw + y / bh + c ) % 4 ) * 60 + rnd.uniform( noise );
+                else if( type == 1 )
+                    v = ( x * 255 ) / w / ( c + 1 ) + ( y * 128 ) / h + rnd.uniform( noise );
+                else if( type == 2 )
+                    v = 100 + 20 * c;
+                else
+                    v = rnd.uniform( 256 );
+                p[c] = (uchar)min( 255, v );
+            }
+        }
+}
+
+struct Checker
+{
+    std::ostream& out;
+    int failed;
+    string image;
+
+    Checker( std::ostream& out ) : out(out), failed(0) {}
+
+    /// tolerance < 0: identical partition required
+    void check( const char* name, const Mat& ref, const Mat& labels, double tolerance )
+    {
+        double dist = partitionDistance( ref, labels );
+        bool ok = ( tolerance < 0 ) ? samePartition( ref, labels ) : ( dist <= tolerance );
+        if( !ok )
+            failed++;
+
+        char line[256];
+        sprintf( line, "%s %-24s %-22s distance %.5f", ok ? "PASS" : "FAIL", name, image.c_str(), dist );
+        out << line << endl;
+    }
+
+    /// a check without a reference partition
+    void check( const char* name, bool ok )
+    {
+        if( !ok )
+            failed++;
+
+        char line[256];
+        sprintf( line, "%s %-24s %-22s", ok ? "PASS" : "FAIL", name, image.c_str() );
+        out << line << endl;
+    }
+};
+
+/// the same label values (not only the same partition)
+bool sameLabels( const Mat& labels1, const Mat& labels2 )
+{
+    if( labels1.rows != labels2.rows || labels1.cols != labels2.cols )
+        return false;
+    for ( int y = 0; y < labels1.rows; y++ )
+        if( memcmp( labels1.ptr<int>(y), labels2.ptr<int>(y), labels1.cols * sizeof(int) ) != 0 )
+            return false;
+    return true;
+}
+
+/// EGBS of the 4-connected L2 color graph of the image with GGBST<Index>, labels as CV_32SC1
+template< typename Index >
+void segmentGenericGraph( const Mat& image, float threshold, int minSize, Mat& labels )
+{
+    int w = image.cols, h = image.rows;
+    GGBST<Index> seg( (Index)w * h, (Index)( w - 1 ) * h + (Index)w * ( h - 1 ), threshold, minSize );
+    seg.start( (Index)w * h, (Index)( w - 1 ) * h + (Index)w * ( h - 1 ) );
+    for ( int y = 0; y < h; y++ )
+        for ( int x = 0; x < w; x++ )
+        {
+            Vec3b p = image.at<Vec3b>(y, x);
+            Index a = (Index)y * w + x;
+            for ( int d = 0; d < 2; d++ )
+            {
+                int nx = x + ( d == 0 ), ny = y + ( d == 1 );
+                if( nx >= w || ny >= h )
+                    continue;
+                Vec3b q = image.at<Vec3b>(ny, nx);
+                float db = (float)p[0] - q[0], dg = (float)p[1] - q[1], dr = (float)p[2] - q[2];
+                seg.addEdge( a, (Index)ny * w + nx, sqrt( db * db + dg * dg + dr * dr ) );
+            }
+        }
+    seg.segmentGraph();
+    seg.postProcess();
+
+    const Index* l = seg.getLabels();
+    labels.create( h, w, CV_32SC1 );
+    for ( int y = 0; y < h; y++ )
+        for ( int x = 0; x < w; x++ )
+            labels.at<int>(y, x) = (int)l[ (Index)y * w + x ];
+}
+
+/// EGBS of the 4-connected L2 color graph with GGBS online: the edges stable sorted by
+/// weight, adjacent pairs swapped if `swapPairs` (undone by a reorder buffer of reorderSize);
+/// returns the number of edges merged out of order
+int segmentOnline( const Mat& image, float threshold, int minSize, int reorderSize, bool swapPairs, Mat& labels )
+{
+    int w = image.cols, h = image.rows;
+    vector<RefEdge> edges;
+    for ( int y = 0; y < h; y++ )
+        for ( int x = 0; x < w; x++ )
+        {
+            RefEdge e;
+            e.a = y * w + x;
+            if( x < w - 1 )
+            {
+                e.b = e.a + 1;
+                e.w = colorL2( image.at<Vec3b>(y, x), image.at<Vec3b>(y, x + 1) );
+                edges.push_back( e );
+            }
+            if( y < h - 1 )
+            {
+                e.b = e.a + w;
+                e.w = colorL2( image.at<Vec3b>(y, x), image.at<Vec3b>(y + 1, x) );
+                edges.push_back( e );
+            }
+        }
+    stable_sort( edges.begin(), edges.end() );
+    if( swapPairs )
+        for ( size_t i = 0; i + 1 < edges.size(); i += 2 )
+            swap( edges[i], edges[i + 1] );
+
+    GGBS seg( w * h, 0, threshold, minSize );
+    seg.startOnline( w * h, reorderSize );
+    for ( size_t i = 0; i < edges.size(); i++ )
+        seg.addEdge( edges[i].a, edges[i].b, edges[i].w );
+    seg.segmentGraph();
+    seg.postProcess();
+
+    const int* l = seg.getLabels();
+    labels.create( h, w, CV_32SC1 );
+    for ( int y = 0; y < h; y++ )
+        for ( int x = 0; x < w; x++ )
+            labels.at<int>(y, x) = l[ y * w + x ];
+    return seg.getNumUnordered();
+}
+
+/// LabelSnapshot of a forest of random unions against the forest: the root and the
+/// set size of each node, dense labels in the order of the first node of each set
+template< typename Index >
+bool checkSnapshot( Random& rnd, int n )
+{
+    DisjointSetT<Index> dsf( n );
+    for ( int i = 0; i < n / 2; i++ )
+    {
+        Index a = dsf.find( rnd.uniform( n ) ), b = dsf.find( rnd.uniform( n ) );
+        if( a != b )
+            dsf.join( a, b );
+    }
+
+    LabelSnapshot snapshot;
+    snapshot.build( dsf );
+    if( snapshot.getNumNodes() != n || snapshot.getNumLabels() != (int)dsf.numSets() )
+        return false;
+
+    int next = 0;
+    for ( int i = 0; i < n; i++ )
+    {
+        int l = snapshot.label( i );
+        if( l > next )
+            return false;
+        if( l == next )
+            next++;
+        Index r = dsf.find( i );
+        if( snapshot.root( i ) != (int)r || snapshot.size( i ) != (int)dsf.setSize( r )
+            || !snapshot.sameSet( i, (int)r ) )
+            return false;
+    }
+    return next == snapshot.getNumLabels();
+}
+
+/// true if every region of `fine` lies inside one region of `coarse`
+bool refines( const Mat& fine, const Mat& coarse )
+{
+    if( fine.rows != coarse.rows || fine.cols != coarse.cols )
+        return false;
+    map<int, int> inside;
+    for ( int y = 0; y < fine.rows; y++ )
+        for ( int x = 0; x < fine.cols; x++ )
+        {
+            map<int, int>::iterator it = inside.insert( make_pair( fine.at<int>(y, x), coarse.at<int>(y, x) ) ).first;
+            if( it->second != coarse.at<int>(y, x) )
+                return false;
+        }
+    return true;
+}
+
+/// a segmentation cancelled right after the start: nothing (stopped before the start),
+/// the merges up to the stop (a refinement of `ref`, no small region merging) or, if it
+/// finished first, `ref`
+bool cancelledResult( const SegResult& result, const Mat& ref )
+{
+    if( !result.error.empty() )
+        return false;
+    if( result.labels.empty() )
+        return result.partial;
+    return result.partial ? refines( result.labels, ref ) : samePartition( result.labels, ref );
+}
+
+/// mean color of each region of `labels` in the 8-bit image (1, 3 or 4 channels, alpha
+/// dropped), rounded half up; CV_8UC1 or CV_8UC3
+void referenceMeans( const Mat& image, const Mat& labels, Mat& means )
+{
+    int w = image.cols, h = image.rows, icn = image.channels();
+    int nc = ( icn == 1 ) ? 1 : 3;
+    map<int, vector<long long> > sums;
+    for ( int y = 0; y < h; y++ )
+        for ( int x = 0; x < w; x++ )
+        {
+            vector<long long>& sum = sums[ labels.at<int>(y, x) ];
+            sum.resize( nc + 1, 0 );
+            for ( int c = 0; c < nc; c++ )
+                sum[c] += image.ptr<uchar>(y)[ x * icn + c ];
+            sum[nc]++;
+        }
+
+    means.create( h, w, nc == 1 ? CV_8UC1 : CV_8UC3 );
+    for ( int y = 0; y < h; y++ )
+        for ( int x = 0; x < w; x++ )
+        {
+            const vector<long long>& sum = sums[ labels.at<int>(y, x) ];
+            for ( int c = 0; c < nc; c++ )
+                means.ptr<uchar>(y)[ x * nc + c ] = (uchar)( ( sum[c] + sum[nc] / 2 ) / sum[nc] );
+        }
+}
+
+/// largest channel difference of two 8-bit images of the same size and type, -1 if they differ
+int maxDifference( const Mat& a, const Mat& b )
+{
+    if( a.rows != b.rows || a.cols != b.cols || a.type() != b.type() )
+        return -1;
+    int d = 0;
+    for ( int y = 0; y < a.rows; y++ )
+        for ( int i = 0; i < a.cols * a.channels(); i++ )
+            d = max( d, abs( a.ptr<uchar>(y)[i] - b.ptr<uchar>(y)[i] ) );
+    return d;
+}
+
+/// smooth the 8-bit image (1 or 3 channels) in full, the straightforward way: CV_32FC1
+/// or CV_32FC3; separable Gaussian (same kernel and sums as RowSmoother) or 3x3 median,
+/// replicated border
+void referenceSmooth( const Mat& image, int type, float sigma, Mat& smoothed )
+{
+    int w = image.cols, h = image.rows, cn = image.channels();
+    smoothed.create( h, w, CV_MAKETYPE( CV_32F, cn ) );
+
+    if( type == SMOOTH_MEDIAN3 )
+    {
+        for ( int y = 0; y < h; y++ )
+            for ( int x = 0; x < w; x++ )
+                for ( int c = 0; c < cn; c++ )
+                {
+                    vector<int> p;
+                    for ( int dy = -1; dy <= 1; dy++ )
+                        for ( int dx = -1; dx <= 1; dx++ )
+                        {
+                            int sy = min( h - 1, max( 0, y + dy ) ), sx = min( w - 1, max( 0, x + dx ) );
+                            p.push_back( image.ptr<uchar>(sy)[ sx * cn + c ] );
+                        }
+                    nth_element( p.begin(), p.begin() + 4, p.end() );
+                    smoothed.ptr<float>(y)[ x * cn + c ] = (float)p[4];
+                }
+        return;
+    }
+
+    // normalized half kernel
+    sigma = max( sigma, 0.01f );
+    int radius = (int)ceil( sigma * 4.0f );
+    vector<float> kernel( radius + 1 );
+    float sum = 0.0f;
+    for ( int i = 0; i <= radius; i++ )
+    {
+        kernel[i] = exp( -0.5f * ( i / sigma ) * ( i / sigma ) );
+        sum += ( i == 0 ) ? kernel[i] : 2.0f * kernel[i];
+    }
+    for ( int i = 0; i <= radius; i++ )
+        kernel[i] /= sum;
+
+    // horizontal, then vertical pass
+    vector<float> tmp( w * h * cn );
+    for ( int y = 0; y < h; y++ )
+    {
+        const uchar* src = image.ptr<uchar>(y);
+        for ( int x = 0; x < w; x++ )
+            for ( int c = 0; c < cn; c++ )
+            {
+                float v = kernel[0] * src[ x * cn + c ];
+                for ( int k = 1; k <= radius; k++ )
+                    v += kernel[k] * ( src[ max( 0, x - k ) * cn + c ] + src[ min( w - 1, x + k ) * cn + c ] );
+                tmp[ ( y * w + x ) * cn + c ] = v;
+            }
+    }
+    for ( int y = 0; y < h; y++ )
+        for ( int i = 0; i < w * cn; i++ )
+        {
+            float v = kernel[0] * tmp[ y * w * cn + i ];
+            for ( int k = 1; k <= radius; k++ )
+                v += kernel[k] * ( tmp[ max( 0, y - k ) * w * cn + i ] + tmp[ min( h - 1, y + k ) * w * cn + i ] );
+            smoothed.ptr<float>(y)[i] = v;
+        }
+}
+
+/// true if the signed areas of the contours of each label (outer boundaries positive,
+/// holes negative) add up to its pixel count in `labels` (CV_32SC1, < 0: no region)
+bool contoursCoverRegions( const Mat& labels, const vector<RegionContour>& contours )
+{
+    map<int, long long> pixels, area2;
+    for ( int y = 0; y < labels.rows; y++ )
+        for ( int x = 0; x < labels.cols; x++ )
+            if( labels.at<int>(y, x) >= 0 )
+                pixels[ labels.at<int>(y, x) ] += 2;
+
+    for ( size_t i = 0; i < contours.size(); i++ )
+    {
+        // shoelace, twice the area; positive for the outer boundaries (region on the right)
+        const vector<Point>& p = contours[i].points;
+        long long a = 0;
+        for ( size_t k = 0; k < p.size(); k++ )
+        {
+            const Point& q = p[ ( k + 1 ) % p.size() ];
+            a += (long long)p[k].x * q.y - (long long)q.x * p[k].y;
+        }
+        if( ( a < 0 ) != contours[i].hole || a == 0 )
+            return false;
+        area2[ contours[i].label ] += a;
+    }
+
+    return area2 == pixels;
+}
+
+/// contours of a ring around a square: two outer boundaries with a hole each, and the square
+void checkContourHoles( Checker& checker )
+{
+    checker.image = "ring 7x7";
+
+    // 0: frame, 1: ring, 2: center 3x3
+    Mat labels( 7, 7, CV_32SC1 );
+    for ( int y = 0; y < 7; y++ )
+        for ( int x = 0; x < 7; x++ )
+        {
+            int d = max( abs( x - 3 ), abs( y - 3 ) );
+            labels.at<int>(y, x) = ( d == 3 ) ? 0 : ( d == 2 ) ? 1 : 2;
+        }
+
+    for ( int connect = 4; connect <= 8; connect += 4 )
+    {
+        vector<RegionContour> contours;
+        traceContours( labels.ptr<int>(0), 7, 7, connect, contours );
+
+        int holes = 0;
+        for ( size_t i = 0; i < contours.size(); i++ )
+            holes += contours[i].hole;
+
+        checker.check( connect == 8 ? "contours8 holes" : "contours4 holes",
+                       contours.size() == 5 && holes == 2 && contoursCoverRegions( labels, contours ) );
+    }
+}
+
+/// true if decode throws on the data
+bool decodeThrows( const vector<uchar>& data )
+{
+    LabelRuns runs;
+    try
+    {
+        runs.decode( data.empty() ? 0 : &data[0], data.size() );
+    }
+    catch( const char* )
+    {
+        return true;
+    }
+    return false;
+}
+
+/// "LRL1" header with the given fields, then `stream` (an LZ block)
+vector<uchar> labelRunsHeader( unsigned int w, unsigned int h, unsigned int numLabels, unsigned int rleSize,
+                               const vector<uchar>& stream )
+{
+    vector<uchar> out;
+    out.push_back( 'L' );
+    out.push_back( 'R' );
+    out.push_back( 'L' );
+    out.push_back( '1' );
+    unsigned int fields[4] = { w, h, numLabels, rleSize };
+    for ( int i = 0; i < 4; i++ )
+    {
+        unsigned int v = fields[i];
+        for ( ; v >= 0x80; v >>= 7 )
+            out.push_back( (uchar)( v | 0x80 ) );
+        out.push_back( (uchar)v );
+    }
+    out.insert( out.end(), stream.begin(), stream.end() );
+    return out;
+}
+
+/// LabelRuns decode must reject malformed streams (before allocating for them)
+void checkMalformedRuns( Checker& checker, const vector<uchar>& valid )
+{
+    checker.image = "malformed";
+
+    vector<uchar> truncated( valid.begin(), valid.begin() + valid.size() / 2 );
+    checker.check( "runs truncated", decodeThrows( truncated ) );
+
+    vector<uchar> block;
+    lzCompress( 0, 0, block );
+    checker.check( "runs huge rle size", decodeThrows( labelRunsHeader( 100, 100, 1, 0xFFFFFFFFu, block ) ) );
+    checker.check( "runs w*h overflow", decodeThrows( labelRunsHeader( 65536, 65536, 1, 0, block ) ) );
+
+    // 1x1: one run of length 1, label+1 = 0xFFFFFFFF (label -2)
+    const uchar rle[] = { 1, 1, 0xFF, 0xFF, 0xFF, 0xFF, 0x0F };
+    block.clear();
+    lzCompress( rle, sizeof(rle), block );
+    checker.check( "runs label < -1", decodeThrows( labelRunsHeader( 1, 1, 1, sizeof(rle), block ) ) );
+}
+
+} // namespace
+
+int verifySegmenters( std::ostream& out, int numRandom, unsigned int seed )
+{
+    Random rnd( seed );
+    Checker checker( out );
+
+    vector<Rect> noRois;
+    Mat ref, stableRef, grayRef, replayRef, smoothRef, labels;
+    vector<uchar> encoded;
+
+    for ( int t = 0; t < numRandom; t++ )
+    {
+        int type = t % 4;
+        int w = 8 + rnd.uniform( 120 );
+        int h = 8 + rnd.uniform( 90 );
+        Mat image;
+        makeImage( rnd, type, w, h, image );
+        Mat fullMask( h, w, CV_8UC1, Scalar(1) );
+
+        char name[64];
+        sprintf( name, "%s %dx%d", imageTypes[type], w, h );
+        checker.image = name;
+
+        // gray (the green channel), also expanded to BGR, and BGRA with a random alpha
+        Mat gray( h, w, CV_8UC1 ), grayBGR( h, w, CV_8UC3 ), bgra( h, w, CV_8UC4 );
+        for ( int y = 0; y < h; y++ )
+            for ( int x = 0; x < w; x++ )
+            {
+                const Vec3b& p = image.at<Vec3b>(y, x);
+                gray.at<uchar>(y, x) = p[1];
+                grayBGR.at<Vec3b>(y, x) = Vec3b( p[1], p[1], p[1] );
+                bgra.at<Vec4b>(y, x) = Vec4b( p[0], p[1], p[2], (uchar)rnd.uniform( 256 ) );
+            }
+
+        // coarse level of the pyramid checks: 2x2 or 4x4 blocks
+        int levels = ( w >= 16 && h >= 16 ) ? 2 : 1;
+
+        // EGBS
+        float k = (float)( 50 + rnd.uniform( 800 ) );
+        int minSize = 1 + rnd.uniform( 40 );
+        for ( int connect = 4; connect <= 8; connect += 4 )
+        {
+            referenceEGBS( image, k, minSize, connect, ref );
+            bool c8 = ( connect == 8 );
+
+            GreedyGraphSeg seg( w, h, k, minSize, connect );
+            seg.segmentImageColor( image );
+            seg.getLabelsInt( labels );
+            checker.check( c8 ? "egbs8 default" : "egbs4 default", ref, labels, -1 );
+
+            // label runs: encode, decode, the same labels
+            LabelRuns runs, decoded;
+            seg.getLabelRuns( runs );
+            runs.encode( encoded );
+            decoded.decode( &encoded[0], encoded.size() );
+            Mat runLabels;
+            decoded.toMat( runLabels );
+            checker.check( c8 ? "egbs8 runs round trip" : "egbs4 runs round trip",
+                           sameLabels( runLabels, labels ) && decoded.getNumLabels() == seg.getNumComps() );
+
+            vector<RegionContour> contours;
+            seg.getContours( contours );
+            checker.check( c8 ? "egbs8 contour areas" : "egbs4 contour areas", contoursCoverRegions( labels, contours ) );
+
+            // merge phase replayed at another threshold: the same as a fresh segmentation
+            float k2 = 2 * k + 100;
+            GreedyGraphSeg fresh( w, h, k2, minSize, connect );
+            fresh.segmentImageColor( image );
+            fresh.getLabelsInt( replayRef );
+            seg.replayMerge( k2 );
+            seg.getLabelsInt( labels );
+            checker.check( c8 ? "egbs8 replay" : "egbs4 replay", replayRef, labels, -1 );
+            seg.setParameters( minSize, k, connect );
+
+            // video, window of one frame: a 2D segmentation of the frame
+            VideoGraphSeg video( w, h, 1, k, minSize, connect );
+            video.addFrame( image );
+            video.flush();
+            video.getFinalLabels( labels );
+            checker.check( c8 ? "video8 window 1" : "video4 window 1", ref, labels, -1 );
+
+            // mean colors of the regions, BGR, BGRA and gray
+            GreedyGraphSeg means( w, h, k, minSize, connect );
+            Mat rendered, refMeans;
+            means.segmentImageColor( image );
+            means.renderMeans( image, rendered );
+            referenceMeans( image, ref, refMeans );
+            checker.check( c8 ? "egbs8 means" : "egbs4 means", maxDifference( rendered, refMeans ) == 0 );
+            means.segmentImageColor( bgra );
+            means.renderMeans( bgra, rendered );
+            checker.check( c8 ? "egbs8 means bgra" : "egbs4 means bgra", maxDifference( rendered, refMeans ) == 0 );
+            means.segmentImageColor( gray );
+            means.getLabelsInt( labels );
+            means.renderMeans( gray, rendered );
+            referenceMeans( gray, labels, refMeans );
+            checker.check( c8 ? "egbs8 means gray" : "egbs4 means gray", maxDifference( rendered, refMeans ) == 0 );
+
+            // region count search: the segmentation kept is the one of the threshold returned
+            int target = 1 + rnd.uniform( 30 );
+            float found = means.segmentToCount( image, target );
+            means.getLabelsInt( labels );
+            GreedyGraphSeg counted( w, h, found, minSize, connect );
+            counted.segmentImageColor( image );
+            counted.getLabelsInt( replayRef );
+            checker.check( c8 ? "egbs8 to count" : "egbs4 to count", replayRef, labels, -1 );
+
+            // asynchronous: the same result; cancelled: nothing, a partial or the full result
+            future<SegResult> pending = segmentAsync( means, image );
+            SegResult result = pending.get();
+            checker.check( c8 ? "egbs8 async" : "egbs4 async", ref, result.labels, -1 );
+            CancelToken token;
+            pending = segmentAsync( means, image, &token );
+            token.cancel();
+            checker.check( c8 ? "egbs8 async cancel" : "egbs4 async cancel", cancelledResult( pending.get(), ref ) );
+
+            seg.setNumThreads( 4 );
+            seg.segmentImageColor( image );
+            seg.getLabelsInt( labels );
+            checker.check( c8 ? "egbs8 threads" : "egbs4 threads", ref, labels, -1 );
+
+            seg.setNumThreads( 1 );
+            seg.segmentImageColor( image, fullMask, noRois );
+            seg.getLabelsInt( labels );
+            checker.check( c8 ? "egbs8 full mask" : "egbs4 full mask", ref, labels, -1 );
+
+            // pre-smoothing fused into graph building: the same as segmenting the smoothed
+            // image; BGRA (alpha ignored) as BGR
+            GreedyGraphSeg smooth( w, h, k, minSize, connect );
+            Mat smoothed;
+            smooth.setSmoothing( SMOOTH_GAUSSIAN, 0.8f );
+            referenceSmooth( image, SMOOTH_GAUSSIAN, 0.8f, smoothed );
+            smooth.segmentImage<Vec3f>( smoothed, DistL2() );
+            smooth.getLabelsInt( smoothRef );
+            smooth.segmentImageColor( image );
+            smooth.getLabelsInt( labels );
+            checker.check( c8 ? "egbs8 gaussian" : "egbs4 gaussian", smoothRef, labels, -1 );
+            smooth.segmentImageColor( bgra );
+            smooth.getLabelsInt( labels );
+            checker.check( c8 ? "egbs8 gaussian bgra" : "egbs4 gaussian bgra", smoothRef, labels, -1 );
+
+            referenceSmooth( gray, SMOOTH_GAUSSIAN, 0.8f, smoothed );
+            smooth.segmentImage<float>( smoothed, DistL2() );
+            smooth.getLabelsInt( smoothRef );
+            smooth.segmentImageColor( gray );
+            smooth.getLabelsInt( labels );
+            checker.check( c8 ? "egbs8 gaussian gray" : "egbs4 gaussian gray", smoothRef, labels, -1 );
+
+            smooth.setSmoothing( SMOOTH_MEDIAN3 );
+            referenceSmooth( image, SMOOTH_MEDIAN3, 0.0f, smoothed );
+            smooth.segmentImage<Vec3f>( smoothed, DistL2() );
+            smooth.getLabelsInt( smoothRef );
+            smooth.segmentImageColor( image );
+            smooth.getLabelsInt( labels );
+            checker.check( c8 ? "egbs8 median" : "egbs4 median", smoothRef, labels, -1 );
+            smooth.segmentImageColor( bgra );
+            smooth.getLabelsInt( labels );
+            checker.check( c8 ? "egbs8 median bgra" : "egbs4 median bgra", smoothRef, labels, -1 );
+
+            // partial blocks at the right and bottom
+            seg.setNodeOrder( ORDER_TILED, 5 );
+            seg.segmentImageColor( image );
+            seg.getLabelsInt( labels );
+            checker.check( c8 ? "egbs8 tiled" : "egbs4 tiled", ref, labels, -1 );
+
+            seg.setNodeOrder( ORDER_MORTON, 8 );
+            seg.segmentImageColor( image );
+            seg.getLabelsInt( labels );
+            checker.check( c8 ? "egbs8 morton" : "egbs4 morton", ref, labels, -1 );
+            seg.setNodeOrder( ORDER_RASTER );
+
+            // pyramid: a band over the whole coarse grid is the plain segmentation,
+            // the default band an approximation of it
+            GreedyGraphSeg pyramid( w, h, k, minSize, connect );
+            pyramid.segmentPyramid( image, levels, max( w, h ) );
+            pyramid.getLabelsInt( labels );
+            checker.check( c8 ? "egbs8 pyramid full band" : "egbs4 pyramid full band", ref, labels, -1 );
+            pyramid.segmentPyramid( image, levels, 1 );
+            pyramid.getLabelsInt( labels );
+            checker.check( c8 ? "egbs8 pyramid" : "egbs4 pyramid", ref, labels, PYRAMID_TOLERANCE );
+
+            seg.setCompactEdges( true );
+            seg.setNumThreads( 4 );
+            seg.segmentImageColor( image );
+            seg.getLabelsInt( labels );
+            referenceEGBS( image, k, minSize, connect, stableRef, true );
+            checker.check( c8 ? "egbs8 compact" : "egbs4 compact", stableRef, labels, -1 );
+
+            seg.setCompactEdges( false );
+            seg.setNumThreads( 1 );
+            seg.setWeightMode( WEIGHTS_SQUARED );
+            seg.segmentImageColor( image );
+            seg.getLabelsInt( labels );
+            checker.check( c8 ? "egbs8 squared" : "egbs4 squared", ref, labels, TIE_TOLERANCE );
+
+            seg.setWeightMode( WEIGHTS_QUANTIZED, 1.0f / 64 );
+            seg.segmentImageColor( image );
+            seg.getLabelsInt( labels );
+            checker.check( c8 ? "egbs8 quantized" : "egbs4 quantized", ref, labels, QUANTIZED_TOLERANCE );
+
+            // compact edges in the bucket modes: keys only, sorted while building the graph
+            seg.setCompactEdges( true );
+            seg.segmentImageColor( image );
+            seg.getLabelsInt( labels );
+            checker.check( c8 ? "egbs8 compact quantized" : "egbs4 compact quantized", ref, labels, QUANTIZED_TOLERANCE );
+
+            seg.setWeightMode( WEIGHTS_SQUARED );
+            seg.segmentImageColor( image );
+            seg.getLabelsInt( labels );
+            checker.check( c8 ? "egbs8 compact squared" : "egbs4 compact squared", ref, labels, TIE_TOLERANCE );
+            seg.segmentImageColor( image, fullMask, noRois );
+            seg.getLabelsInt( labels );
+            checker.check( c8 ? "egbs8 compact squared mask" : "egbs4 compact squared mask", ref, labels, TIE_TOLERANCE );
+        }
+
+        // generic graph: 64-bit indices, the same partition as 32-bit
+        Mat labels32;
+        segmentGenericGraph<int>( image, k, minSize, labels32 );
+        segmentGenericGraph<long long>( image, k, minSize, labels );
+        checker.check( "ggbs64", labels32, labels, -1 );
+
+        // online: sorted edges merged as they come, the same as the stable order reference
+        // (GGBS merges components of up to minSize pixels, the reference of less than minSize);
+        // out of order by one, a reorder buffer restores the order (up to the equal weights)
+        referenceEGBS( image, k, minSize + 1, 4, stableRef, true );
+        segmentOnline( image, k, minSize, 0, false, labels );
+        checker.check( "ggbs online", stableRef, labels, -1 );
+        int unordered = segmentOnline( image, k, minSize, 4, true, labels );
+        checker.check( "ggbs online reorder", stableRef, labels, TIE_TOLERANCE );
+        checker.check( "ggbs online reorder order", unordered == 0 );
+
+        checker.check( "snapshot", checkSnapshot<int>( rnd, w * h ) );
+        checker.check( "snapshot64", checkSnapshot<long long>( rnd, w * h ) );
+
+        // SRM
+        float Q = (float)( 8 + rnd.uniform( 200 ) );
+        float minsize = (float)( 1 + rnd.uniform( 40 ) );
+        referenceSRM( image, Q, minsize, ref );
+
+        SRMSeg srm( w, h );
+        srm.segment( image, Q, minsize );
+        srm.getLabelsInt( labels );
+        checker.check( "srm default", ref, labels, -1 );
+
+        vector<RegionContour> contours;
+        srm.getContours( contours );
+        checker.check( "srm contour areas", contoursCoverRegions( labels, contours ) );
+
+        // mean colors from the region means: the float means round to within 1
+        Mat rendered, refMeans;
+        srm.renderMeans( rendered );
+        referenceMeans( image, ref, refMeans );
+        int difference = maxDifference( rendered, refMeans );
+        checker.check( "srm means", difference >= 0 && difference <= 1 );
+
+        // region count search: the segmentation kept is the one of the Q returned
+        SRMSeg counted( w, h );
+        float foundQ = counted.segmentToCount( image, 1 + rnd.uniform( 30 ), Q, minsize );
+        counted.getLabelsInt( labels );
+        SRMSeg countedRef( w, h );
+        countedRef.segment( image, foundQ, minsize );
+        countedRef.getLabelsInt( replayRef );
+        checker.check( "srm to count", replayRef, labels, -1 );
+
+        future<SegResult> pending = segmentAsync( counted, image, Q, minsize );
+        SegResult result = pending.get();
+        checker.check( "srm async", ref, result.labels, -1 );
+        CancelToken token;
+        pending = segmentAsync( counted, image, Q, minsize, &token );
+        token.cancel();
+        checker.check( "srm async cancel", cancelledResult( pending.get(), ref ) );
+
+        // merge phase replayed at another Q: the same as a fresh segmentation
+        float Q2 = Q / 2 + 4;
+        SRMSeg fresh( w, h );
+        fresh.segment( image, Q2, minsize );
+        fresh.getLabelsInt( replayRef );
+        srm.replayMerge( image, Q2 );
+        srm.getLabelsInt( labels );
+        checker.check( "srm replay", replayRef, labels, -1 );
+
+        srm.setNumThreads( 4 );
+        srm.segment( image, Q, minsize );
+        srm.getLabelsInt( labels );
+        checker.check( "srm threads", ref, labels, -1 );
+
+        srm.setNumThreads( 1 );
+        srm.segment( image, fullMask, noRois, Q, minsize );
+        srm.getLabelsInt( labels );
+        checker.check( "srm full mask", ref, labels, -1 );
+
+        srm.setNodeOrder( ORDER_TILED, 5 );
+        srm.segment( image, Q, minsize );
+        srm.getLabelsInt( labels );
+        checker.check( "srm tiled", ref, labels, -1 );
+
+        srm.setNodeOrder( ORDER_MORTON, 8 );
+        srm.segment( image, Q, minsize );
+        srm.getLabelsInt( labels );
+        checker.check( "srm morton", ref, labels, -1 );
+        srm.setNodeOrder( ORDER_RASTER );
+
+        SRMSeg pyramid( w, h );
+        pyramid.segmentPyramid( image, Q, minsize, levels, max( w, h ) );
+        pyramid.getLabelsInt( labels );
+        checker.check( "srm pyramid full band", ref, labels, -1 );
+        pyramid.segmentPyramid( image, Q, minsize, levels, 1 );
+        pyramid.getLabelsInt( labels );
+        checker.check( "srm pyramid", ref, labels, PYRAMID_TOLERANCE );
+
+        srm.setFixedPoint( true );
+        srm.segment( image, Q, minsize );
+        srm.getLabelsInt( labels );
+        checker.check( "srm fixed point", ref, labels, -1 );
+        srm.setFixedPoint( false );
+
+        // gray: the same as the gray values expanded to BGR
+        referenceSRM( grayBGR, Q, minsize, grayRef );
+
+        srm.segment( gray, Q, minsize );
+        srm.getLabelsInt( labels );
+        checker.check( "srm gray", grayRef, labels, -1 );
+
+        srm.setFixedPoint( true );
+        srm.segment( gray, Q, minsize );
+        srm.getLabelsInt( labels );
+        checker.check( "srm gray fixed point", grayRef, labels, -1 );
+        srm.setFixedPoint( false );
+
+        srm.setCompactEdges( true );
+        srm.setNumThreads( 4 );
+        srm.segment( image, Q, minsize );
+        srm.getLabelsInt( labels );
+        referenceSRM( image, Q, minsize, stableRef, true );
+        checker.check( "srm compact", stableRef, labels, -1 );
+    }
+
+    if( !encoded.empty() )
+        checkMalformedRuns( checker, encoded );
+    checkContourHoles( checker );
+
+    out << ( checker.failed ? "FAILED: " : "All checks passed, " ) << checker.failed << " failed" << endl;
+    return checker.failed;
+}
@@ -0,0 +1,57 @@
+/***************************************************************
+ * Name:      SegReference.h
+ * Purpose:   Reference implementations of EGBS and SRM, equivalence checks
+ * Author:    segment-cpp contributors
+ * Created:   18.10.2026
+ * Copyright: segment-cpp contributors
+ * License:
+ **************************************************************/
+
+#ifndef SEGREFERENCE_H_INCLUDED
+#define SEGREFERENCE_H_INCLUDED
+
+#include <iostream>
+
+#include "opencv2/core/core.hpp"
+
+using namespace cv;
+
+// The original, straightforward versions of GreedyGraphSeg and SRMSeg on 8-bit
+// BGR images (edge list, std::sort, own disjoint set), kept unchanged as the
+// reference for the optimized paths. Labels as getLabelsInt (CV_32SC1).
+// stableOrder: equal weight edges in the order of the graph builders
+// (std::stable_sort), the order of the compact edge paths.
+
+/// EGBS: L2 color distance, 4 or 8 connected
+void referenceEGBS( const Mat& image, float threshold, int minSize, int connect, Mat& labels,
+                    bool stableOrder = false );
+
+/// SRM: Linf color distance, 4 connected
+void referenceSRM( const Mat& image, float Q, float minsize, Mat& labels, bool stableOrder = false );
+
+/// true if the two label maps (CV_32SC1) are the same partition (labels may differ)
+bool samePartition( const Mat& labels1, const Mat& labels2 );
+
+/// fraction of the 4-neighbor pixel pairs on which the two partitions disagree
+/// (same region in one, different regions in the other), 0: same partition
+double partitionDistance( const Mat& labels1, const Mat& labels2 );
+
+/// Compare the optimized paths of GreedyGraphSeg and SRMSeg with the reference on
+/// synthetic and random images: identical partitions where the path is exact
+/// (default float path, parallel build, full mask; compact edges against the stable
+/// order reference), partition distance within a tolerance elsewhere (bucket sorted
+/// weights: different order of the equal weight edges; quantized weights). Further checks:
+/// replayMerge at another threshold (Q) against a fresh segmentation; the signed areas
+/// of the region contours (holes negative) against the region sizes; VideoGraphSeg with
+/// a window of one frame against EGBS; segmentPyramid with a band over the whole coarse
+/// grid against the reference, with band 1 within a partition distance bound; EGBS with
+/// pre-smoothing fused into graph building against the smoothed image segmented; online
+/// GGBS against the stable order reference; LabelSnapshot against its forest; segmentAsync
+/// against the reference, and cancelled right after the start (nothing, a refinement of
+/// the reference or the reference); segmentToCount against a fresh segmentation with the
+/// parameter found; renderMeans against the region means of the reference labels.
+/// Writes one line per check to `out`, returns the number of failed checks.
+/// The test program segverify.cpp (target SegVerify) runs it.
+int verifySegmenters( std::ostream& out, int numRandom = 10, unsigned int seed = 1 );
+
+#endif
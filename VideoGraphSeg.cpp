@@ -0,0 +1,243 @@
+/***************************************************************
+ * Name:      VideoGraphSeg.cpp
+ * Purpose:   Spatio-temporal graph-based segmentation of video frames
+ * Author:    segment-cpp contributors
+ * Created:   18.10.2026
+ * Copyright: segment-cpp contributors
+ * License:
+ **************************************************************/
+
+#include <climits>
+#include <new>
+
+#include "VideoGraphSeg.h"
+
+using namespace std;
+
+VideoGraphSeg :: VideoGraphSeg( int width, int height, int window, float threshold, int minSize, int connect )
+{
+    if( width < 1 || height < 1 || window < 1 )
+        throw "VideoGraphSeg :: VideoGraphSeg - Illegal width-height-window!";
+    if( (double)width * height * window > INT_MAX )
+        throw "VideoGraphSeg :: VideoGraphSeg - window too large!";
+
+    this->width = width;
+    this->height = height;
+    this->window = window;
+    this->threshold = 300;
+    this->minSize = 100;
+    this->connect = 4;
+
+    this->dsf = NULL;
+    this->thresholds = NULL;
+    this->regionIds = NULL;
+    this->edges = NULL;
+
+    this->setParameters( threshold, minSize, connect );
+    this->allocate();
+    this->reset();
+}
+
+VideoGraphSeg :: ~VideoGraphSeg()
+{
+    this->deallocate();
+}
+
+void VideoGraphSeg :: allocate()
+{
+    int n = this->width * this->height;
+    int numNodes = n * this->window;
+
+    try
+    {
+        this->dsf = new DisjointSet( numNodes );
+        this->thresholds = new float[ numNodes ];
+        this->regionIds = new int[ numNodes ];
+        // grid edges and one temporal edge per pixel
+        this->edges = new edge[ (size_t)n * ( this->connect / 2 + 1 ) ];
+    }
+    catch( ... )
+    {
+        this->deallocate();
+        throw "VideoGraphSeg :: allocate - out of memory!";
+    }
+
+    this->slotFrame.assign( this->window, -1 );
+}
+
+void VideoGraphSeg :: deallocate()
+{
+    if( dsf )
+        delete dsf;
+    dsf = NULL;
+
+    if( thresholds )
+        delete[] thresholds;
+    thresholds = NULL;
+
+    if( regionIds )
+        delete[] regionIds;
+    regionIds = NULL;
+
+    if( edges )
+        delete[] edges;
+    edges = NULL;
+}
+
+void VideoGraphSeg :: setParameters( float threshold, int minSize, int connect )
+{
+    if( threshold > 0 )
+        this->threshold = threshold;
+
+    if( minSize > 0 )
+        this->minSize = minSize;
+
+    if( ( connect == 4 || connect == 8 ) && connect != this->connect )
+    {
+        // edge buffer for the new connectivity, allocated before the old one is released:
+        // out of memory leaves the segmenter as it was
+        if( this->edges )
+        {
+            edge* resized = new (std::nothrow) edge[ (size_t)this->width * this->height * ( connect / 2 + 1 ) ];
+            if( !resized )
+                throw "VideoGraphSeg :: setParameters - out of memory!";
+            delete[] this->edges;
+            this->edges = resized;
+        }
+
+        this->connect = connect;
+    }
+}
+
+void VideoGraphSeg :: reset()
+{
+    this->dsf->reset();
+    this->slotFrame.assign( this->window, -1 );
+    this->numFrames = 0;
+    this->oldest = 0;
+    this->prevPixels.clear();
+    this->prevPixelSize = 0;
+    this->nextRegionId = 0;
+    this->finalFrame = -1;
+}
+
+/**
+ * add a frame, based on color only
+ */
+bool VideoGraphSeg :: addFrame( const ImageView& frame, const Mat& flow )
+{
+    if( frame.depth != CV_8U )
+        throw "VideoGraphSeg :: addFrame - 8-bit frame expected!";
+
+    switch( frame.channels() )
+    {
+        case 1:  return this->addFrame<uchar>( frame, DistL2(), flow );
+        case 4:  return this->addFrame<Vec4b>( frame, ColorOnly<DistL2>(), flow );
+        default: return this->addFrame<Vec3b>( frame, DistL2(), flow );
+    }
+}
+
+bool VideoGraphSeg :: flush()
+{
+    if( this->oldest >= this->numFrames )
+        return false;
+
+    this->finalizeOldest();
+    return true;
+}
+
+/**
+ * greedy merge of the new edges into the regions of the window, then small regions
+ */
+void VideoGraphSeg :: mergeFrame( int numEdges )
+{
+    std::sort( edges, edges + numEdges );
+
+    int i, a, b;
+    edge* pedge = this->edges;
+    for ( i = 0; i < numEdges; i++, pedge++ )
+    {
+        a = dsf->find( pedge->a );
+        b = dsf->find( pedge->b );
+        if ( a != b && ( pedge->w <= thresholds[a] ) && ( pedge->w <= thresholds[b] ) )
+        {
+            a = this->joinNewer( a, b );
+            thresholds[a] = pedge->w + this->threshold / dsf->setSize(a);
+        }
+    }
+
+    // small regions, sizes over the whole window
+    pedge = this->edges;
+    for ( i = 0; i < numEdges; i++, pedge++ )
+    {
+        a = dsf->find( pedge->a );
+        b = dsf->find( pedge->b );
+        if ( (a != b) && ( (dsf->setSize(a) < minSize) || ( dsf->setSize(b) < minSize)))
+            this->joinNewer( a, b );
+    }
+}
+
+/**
+ * join roots a, b: the root of the newer frame becomes the root (same frame: union by rank);
+ * the region keeps the older of the region ids
+ */
+int VideoGraphSeg :: joinNewer( int a, int b )
+{
+    int n = this->width * this->height;
+    int fa = slotFrame[ a / n ];
+    int fb = slotFrame[ b / n ];
+
+    int r;
+    if( fa < fb )
+    {
+        dsf->link( a, b );
+        r = b;
+    }
+    else if( fa > fb )
+    {
+        dsf->link( b, a );
+        r = a;
+    }
+    else
+    {
+        dsf->join( a, b );
+        r = dsf->find( a );
+    }
+
+    int ida = regionIds[a];
+    int idb = regionIds[b];
+    if( ida < 0 || ( idb >= 0 && idb < ida ) )
+        ida = idb;
+    regionIds[r] = ida;
+
+    return r;
+}
+
+/**
+ * region ids of the pixels of the oldest frame, then take its nodes out of the forest
+ */
+void VideoGraphSeg :: finalizeOldest()
+{
+    int w = this->width;
+    int h = this->height;
+    int base = frameBase( this->oldest );
+
+    finalLabels.create( h, w, CV_32SC1 );
+    for ( int y = 0; y < h; y++ )
+    {
+        int* lrow = finalLabels.ptr<int>(y);
+        for ( int x = 0; x < w; x++ )
+        {
+            int r = dsf->find( base + y * w + x );
+            if( regionIds[r] < 0 )
+                regionIds[r] = this->nextRegionId++;
+            lrow[x] = regionIds[r];
+        }
+    }
+
+    // no node of a newer frame points into this frame, see joinNewer
+    dsf->detach( base, base + w * h );
+
+    this->finalFrame = this->oldest;
+    this->oldest++;
+}
@@ -0,0 +1,252 @@
+/***************************************************************
+ * Name:      VideoGraphSeg.h
+ * Purpose:   Spatio-temporal graph-based segmentation of video frames
+ * Author:    segment-cpp contributors
+ * Created:   18.10.2026
+ * Copyright: segment-cpp contributors
+ * License:
+ **************************************************************/
+
+#ifndef VIDEOGRAPHSEG_H_INCLUDED
+#define VIDEOGRAPHSEG_H_INCLUDED
+
+#include <algorithm>
+#include <cstring>
+#include <vector>
+
+#include "opencv2/core/core.hpp"
+
+#include "DisjointSet.h"
+#include "Distance.h"
+#include "Edge.h"
+#include "ImageView.h"
+
+using namespace cv;
+
+/**
+ * EGBS over a 3D graph: the frames in a sliding window of `window` frames
+ * are one disjoint set forest, each new frame adds its grid edges and one
+ * temporal edge per pixel to the co-located (or flow-warped) pixel of the
+ * previous frame, merged greedily into the regions of the window (only the
+ * edges of the new frame are sorted, so a frame costs about as much as a 2D
+ * segmentation). Regions keep their id over the frames.
+ *
+ * When the window is full the oldest frame is finalized: its pixels get
+ * the ids of their regions (getFinalLabels) and its nodes are taken out of
+ * the forest and reused for the new frame. The roots of the forest are
+ * always in the newest frame of their region (link toward newer frames),
+ * so no node points into the oldest frame from outside: the frame is cut
+ * out with DisjointSet::detach, no rebuild of the forest.
+ */
+class VideoGraphSeg
+{
+public:
+
+    /// frames of width x height, `window` frames (>= 1) in memory
+    VideoGraphSeg( int width, int height, int window = 3, float threshold = 300, int minSize = 100, int connect = 4 );
+    ~VideoGraphSeg();
+
+    void setParameters( float threshold, int minSize, int connect = 4 );
+
+    /// start a new video (frames in the window are dropped, not finalized)
+    void reset();
+
+    /// add the next frame (8-bit gray, BGR/RGB or BGRA/RGBA, L2 distance);
+    /// flow (optional, CV_32FC2): pixel (x,y) of this frame was at (x + flow.x, y + flow.y)
+    /// in the previous frame. Returns true if a frame was finalized, see getFinalLabels
+    bool addFrame( const ImageView& frame, const Mat& flow = Mat() );
+
+    /// add a frame with the distance functor `metric` (see Distance.h), frame rows as `Pixel`
+    template< typename Pixel, typename Metric >
+    bool addFrame( const ImageView& frame, Metric metric, const Mat& flow = Mat() );
+
+    /// end of the video: finalize the oldest frame left in the window,
+    /// false if there is none; call until false
+    bool flush();
+
+    /// region ids of the last finalized frame (CV_32SC1), the same id for the same region in all frames
+    void getFinalLabels( Mat& labels ) const { finalLabels.copyTo( labels ); }
+    /// index of the last finalized frame (0: first frame), -1 if none
+    int getFinalFrame() const { return finalFrame; }
+
+    /// frames added since the start
+    int getNumFrames() const { return numFrames; }
+    /// region ids given so far (ids are 0 .. getNumRegionIds()-1; a region id is
+    /// not used anymore if its region merged with an older region)
+    int getNumRegionIds() const { return nextRegionId; }
+
+private:
+
+    void allocate();
+    void deallocate();
+
+    /// grid and temporal edges of the new frame, in `edges`, returns the number of edges
+    template< typename Pixel, typename Metric >
+    int buildGraph( const ImageView& frame, Metric& metric, const Mat& flow, int base, int prevBase );
+
+    /// greedy merge and small regions over the edges of the new frame
+    void mergeFrame( int numEdges );
+
+    /// join the sets of roots a and b, root in the newer frame; returns the root
+    int joinNewer( int a, int b );
+
+    /// region ids of the oldest frame in finalLabels, take it out of the forest
+    void finalizeOldest();
+
+    /// first node of the frame
+    int frameBase( int frame ) const { return ( frame % window ) * width * height; }
+
+private:
+
+    int width;
+    int height;
+    int window;
+    float threshold;
+    int minSize;
+    int connect;
+
+    /// frames added, oldest frame still in the window
+    int numFrames;
+    int oldest;
+
+    /// DSF over window * width * height nodes, frame f at frameBase(f)
+    DisjointSet* dsf;
+    /// per node (meaningful at the roots): merge threshold, region id or -1
+    float* thresholds;
+    int* regionIds;
+    /// frame of the nodes of each window slot
+    std::vector<int> slotFrame;
+
+    /// edges of the new frame
+    edge* edges;
+
+    /// pixels of the previous frame, copied (temporal edges), and their size in bytes
+    std::vector<uchar> prevPixels;
+    size_t prevPixelSize;
+
+    int nextRegionId;
+
+    Mat finalLabels;
+    int finalFrame;
+};
+
+/**
+ * add a frame: finalize the oldest frame if the window is full, build and merge the new edges
+ */
+template< typename Pixel, typename Metric >
+bool VideoGraphSeg :: addFrame( const ImageView& frame, Metric metric, const Mat& flow )
+{
+    if( frame.width != this->width || frame.height != this->height )
+        throw "VideoGraphSeg :: addFrame - frame size differs!";
+    if( !flow.empty() && ( flow.cols != this->width || flow.rows != this->height || flow.type() != CV_32FC2 ) )
+        throw "VideoGraphSeg :: addFrame - flow must be CV_32FC2 of the frame size!";
+
+    bool finalized = false;
+    if( this->numFrames - this->oldest == this->window )
+    {
+        this->finalizeOldest();
+        finalized = true;
+    }
+
+    // new frame in the slot of the finalized one
+    int base = frameBase( this->numFrames );
+    int n = this->width * this->height;
+    for ( int i = base; i < base + n; i++ )
+    {
+        thresholds[i] = this->threshold;
+        regionIds[i] = -1;
+    }
+    slotFrame[ this->numFrames % this->window ] = this->numFrames;
+
+    // temporal edges only to a previous frame in the window, with the same pixel type
+    int prevBase = -1;
+    if( this->numFrames > this->oldest && this->prevPixelSize == sizeof(Pixel) )
+        prevBase = frameBase( this->numFrames - 1 );
+
+    int numEdges = this->buildGraph<Pixel>( frame, metric, flow, base, prevBase );
+    this->mergeFrame( numEdges );
+
+    // keep the pixels for the next frame
+    size_t rowBytes = this->width * sizeof(Pixel);
+    this->prevPixels.resize( rowBytes * this->height );
+    for ( int y = 0; y < this->height; y++ )
+        memcpy( &this->prevPixels[ y * rowBytes ], frame.ptr<Pixel>(y), rowBytes );
+    this->prevPixelSize = sizeof(Pixel);
+
+    this->numFrames++;
+    return finalized;
+}
+
+/**
+ * grid edges of the new frame (right, down, [down-right, up-right]) and the
+ * temporal edge of each pixel to the previous frame (prevBase >= 0)
+ */
+template< typename Pixel, typename Metric >
+int VideoGraphSeg :: buildGraph( const ImageView& frame, Metric& metric, const Mat& flow, int base, int prevBase )
+{
+    int w = this->width;
+    int h = this->height;
+    const Pixel* prev = (const Pixel*)( this->prevPixels.empty() ? 0 : &this->prevPixels[0] );
+
+    int n = 0;
+    for ( int y = 0; y < h; y++ )
+    {
+        const Pixel* row = frame.ptr<Pixel>(y);
+        const Pixel* down = ( y < h - 1 ) ? frame.ptr<Pixel>(y + 1) : 0;
+        const Pixel* up = ( y > 0 ) ? frame.ptr<Pixel>(y - 1) : 0;
+        const Vec2f* frow = flow.empty() ? 0 : flow.ptr<Vec2f>(y);
+
+        for ( int x = 0; x < w; x++ )
+        {
+            int p = base + y * w + x;
+
+            if( x < w - 1 )
+            {
+                edges[n].a = p;
+                edges[n].b = p + 1;
+                edges[n].w = metric( row[x], row[x + 1] );
+                n++;
+            }
+            if( down )
+            {
+                edges[n].a = p;
+                edges[n].b = p + w;
+                edges[n].w = metric( row[x], down[x] );
+                n++;
+            }
+            if( this->connect == 8 && down && x < w - 1 )
+            {
+                edges[n].a = p;
+                edges[n].b = p + w + 1;
+                edges[n].w = metric( row[x], down[x + 1] );
+                n++;
+            }
+            if( this->connect == 8 && up && x < w - 1 )
+            {
+                edges[n].a = p;
+                edges[n].b = p - w + 1;
+                edges[n].w = metric( row[x], up[x + 1] );
+                n++;
+            }
+
+            if( prevBase >= 0 )
+            {
+                int px = x, py = y;
+                if( frow )
+                {
+                    px = cvRound( x + frow[x][0] );
+                    py = cvRound( y + frow[x][1] );
+                    if( px < 0 || px >= w || py < 0 || py >= h )
+                        continue;
+                }
+                edges[n].a = p;
+                edges[n].b = prevBase + py * w + px;
+                edges[n].w = metric( row[x], prev[ py * w + px ] );
+                n++;
+            }
+        }
+    }
+    return n;
+}
+
+#endif
@@ -1,64 +1,608 @@
 /***************************************************************
  * Name:     main.cpp
- * Purpose:   Driver for image segmentation algorithms SRM and EGBS
+ * Purpose:   Batch driver for image segmentation algorithms SRM and EGBS
  * Author:    Muhammet Bastan (mubastan@gmail.com)
  * Created:   09.07.2010
  * Copyright: Muhammet Bastan (https://sites.google.com/site/mubastan)
  * License:
  **************************************************************/
 
+// Segments a set of images (directories, files, file lists) headless and writes
+// the results. Decoding, segmentation and encoding run in separate stages with
+// their own threads, connected by bounded queues, so the stages overlap and at
+// most a few images per stage are in memory.
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <climits>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <exception>
+#include <fstream>
 #include <iostream>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <dirent.h>
+#include <sys/stat.h>
+
 #include "opencv2/highgui/highgui.hpp"
 #include "opencv2/imgproc/imgproc.hpp"
 
+#include "BoundedQueue.h"
 #include "GreedyGraphSeg.h"
+#include "PerfProfiler.h"
 #include "SRMSeg.h"
 
 using namespace std;
 
-int main(int argc, char** argv)
+/// outputs
+enum
+{
+    OUT_LABELS = 1,         // <name>_labels.png, 16-bit label image
+    OUT_BOUNDARIES = 2,     // <name>_boundaries.png, boundaries drawn on the image
+    OUT_REGIONS = 4,        // <name>_regions.csv, one row per region
+    OUT_RUNS = 8,           // <name>.lrl, compressed label runs (LabelRuns)
+    OUT_MEANS = 16          // <name>_means.png, regions painted with their mean color
+};
+
+struct Options
+{
+    string algorithm;       // srm, egbs
+    float Q;                // SRM
+    float threshold;        // EGBS
+    int minSize;
+    int connect;            // EGBS
+    int smoothType;
+    float sigma;
+    int outputs;
+    string outDir;
+    int decodeThreads;
+    int segmentThreads;
+    int encodeThreads;
+    int queueSize;
+    int nodeOrder;          // NodeOrder of the segmenters
+    int orderTile;
+    bool profile;           // phase timings and counters of the segmenters
+    bool fixedPoint;        // SRM fixed-point merge predicate
+    int targetRegions;      // > 0: search Q / threshold for about this many regions
+
+    Options() : algorithm("srm"), Q(40.0f), threshold(300.0f), minSize(100), connect(4),
+                smoothType(SMOOTH_NONE), sigma(0.8f), outputs(OUT_LABELS), outDir("."),
+                decodeThreads(1), segmentThreads(2), encodeThreads(1), queueSize(4),
+                nodeOrder(ORDER_RASTER), orderTile(64), profile(false), fixedPoint(false),
+                targetRegions(0) {}
+};
+
+/// one image through the pipeline
+struct Job
+{
+    string path;
+    string name;            // output file name stem
+    Mat image;
+    Mat labels;             // CV_32SC1
+    Mat boundaries;
+    Mat means;
+    int numRegions;
+    string error;
+};
+
+static mutex logMutex;
+static mutex profileMutex;
+
+static void log( const string& msg, bool error = false )
+{
+    lock_guard<mutex> lock( logMutex );
+    ( error ? cerr : cout ) << msg << endl;
+}
+
+static void usage()
+{
+    cout <<
+    "usage: Segmentation [options] <image | directory> ...\n"
+    "  -a srm|egbs        algorithm (srm)\n"
+    "  -q Q               SRM complexity, larger: more regions (40)\n"
+    "  -k threshold       EGBS threshold, larger: larger regions (300)\n"
+    "  -m minsize         min region size in pixels (100)\n"
+    "  -r n               about n regions per image: Q or threshold searched from -q/-k\n"
+    "  -c 4|8             EGBS connectivity (4)\n"
+    "  -p none|median|gauss[:sigma]  pre-smoothing (none)\n"
+    "  -w labels,boundaries,regions,runs,means  outputs (labels)\n"
+    "  -o dir             output directory (.)\n"
+    "  -l file            read image paths from a file, one per line\n"
+    "  -t D,S,E           decode, segment, encode threads (1,2,1)\n"
+    "  -b n               queue size between the stages (4)\n"
+    "  -n raster|tiled|morton[:tile]  graph node order, tiled/morton for wide images (raster)\n"
+    "  --profile          report time and hardware counters per segmentation phase\n"
+    "  --fixed-point      SRM merge predicate in integers, same result on every build\n";
+}
+
+static bool isDirectory( const string& path )
+{
+    struct stat st;
+    return stat( path.c_str(), &st ) == 0 && S_ISDIR( st.st_mode );
+}
+
+static bool isImageFile( const string& name )
 {
-    Mat img = imread("ugurbocegi.jpg");
+    static const char* exts[] = { ".jpg", ".jpeg", ".png", ".bmp", ".tif", ".tiff", ".ppm", ".pgm", 0 };
+
+    size_t dot = name.rfind( '.' );
+    if( dot == string::npos )
+        return false;
+
+    string ext = name.substr( dot );
+    transform( ext.begin(), ext.end(), ext.begin(), ::tolower );
+    for ( int i = 0; exts[i]; i++ )
+        if( ext == exts[i] )
+            return true;
+    return false;
+}
+
+/// image files of a directory, sorted by name
+static void listDirectory( const string& dir, vector<string>& paths )
+{
+    DIR* d = opendir( dir.c_str() );
+    if( !d )
+    {
+        log( "Could not read the directory " + dir, true );
+        return;
+    }
+
+    vector<string> names;
+    struct dirent* entry;
+    while( ( entry = readdir( d ) ) != NULL )
+    {
+        string name = entry->d_name;
+        if( isImageFile( name ) && !isDirectory( dir + "/" + name ) )
+            names.push_back( name );
+    }
+    closedir( d );
+
+    sort( names.begin(), names.end() );
+    for ( size_t i = 0; i < names.size(); i++ )
+        paths.push_back( dir + "/" + names[i] );
+}
+
+static void readFileList( const string& file, vector<string>& paths )
+{
+    ifstream in( file.c_str() );
+    if( !in )
+    {
+        log( "Could not read the file list " + file, true );
+        return;
+    }
+
+    string line;
+    while( getline( in, line ) )
+    {
+        size_t end = line.find_last_not_of( " \t\r" );
+        if( end == string::npos || line[0] == '#' )
+            continue;
+        paths.push_back( line.substr( 0, end + 1 ) );
+    }
+}
+
+/// output name: file name without the directory and the extension
+static string stem( const string& path )
+{
+    size_t slash = path.rfind( '/' );
+    string name = ( slash == string::npos ) ? path : path.substr( slash + 1 );
+    size_t dot = name.rfind( '.' );
+    return ( dot == string::npos ) ? name : name.substr( 0, dot );
+}
+
+static bool parseOptions( int argc, char** argv, Options& opt, vector<string>& paths )
+{
+    for ( int i = 1; i < argc; i++ )
+    {
+        string arg = argv[i];
+        if( arg == "-h" || arg == "--help" )
+            return false;
+
+        if( arg == "--profile" )
+        {
+            opt.profile = true;
+            continue;
+        }
+
+        if( arg == "--fixed-point" )
+        {
+            opt.fixedPoint = true;
+            continue;
+        }
+
+        if( arg.size() == 2 && arg[0] == '-' )
+        {
+            if( i + 1 >= argc )
+            {
+                log( "Missing value for " + arg, true );
+                return false;
+            }
+
+            string val = argv[++i];
+            switch( arg[1] )
+            {
+                case 'a': opt.algorithm = val; break;
+                case 'q': opt.Q = (float)atof( val.c_str() ); break;
+                case 'k': opt.threshold = (float)atof( val.c_str() ); break;
+                case 'm': opt.minSize = atoi( val.c_str() ); break;
+                case 'r': opt.targetRegions = atoi( val.c_str() ); break;
+                case 'c': opt.connect = atoi( val.c_str() ); break;
+                case 'o': opt.outDir = val; break;
+                case 'l': readFileList( val, paths ); break;
+                case 'b': opt.queueSize = atoi( val.c_str() ); break;
+                case 'p':
+                {
+                    string type = val.substr( 0, val.find( ':' ) );
+                    if( type == "median" )
+                        opt.smoothType = SMOOTH_MEDIAN3;
+                    else if( type == "gauss" )
+                        opt.smoothType = SMOOTH_GAUSSIAN;
+                    else
+                        opt.smoothType = SMOOTH_NONE;
 
-    if(img.empty()){ cout << "Could not read the image" << endl; return 0;}
+                    if( val.find( ':' ) != string::npos )
+                        opt.sigma = (float)atof( val.c_str() + val.find( ':' ) + 1 );
+                    break;
+                }
+                case 'n':
+                {
+                    string order = val.substr( 0, val.find( ':' ) );
+                    if( order == "tiled" )
+                        opt.nodeOrder = ORDER_TILED;
+                    else if( order == "morton" )
+                        opt.nodeOrder = ORDER_MORTON;
+                    else
+                        opt.nodeOrder = ORDER_RASTER;
+
+                    if( val.find( ':' ) != string::npos )
+                        opt.orderTile = atoi( val.c_str() + val.find( ':' ) + 1 );
+                    break;
+                }
+                case 'w':
+                {
+                    opt.outputs = 0;
+                    if( val.find( "labels" ) != string::npos )      opt.outputs |= OUT_LABELS;
+                    if( val.find( "boundaries" ) != string::npos )  opt.outputs |= OUT_BOUNDARIES;
+                    if( val.find( "regions" ) != string::npos )     opt.outputs |= OUT_REGIONS;
+                    if( val.find( "runs" ) != string::npos )        opt.outputs |= OUT_RUNS;
+                    if( val.find( "means" ) != string::npos )       opt.outputs |= OUT_MEANS;
+                    break;
+                }
+                case 't':
+                    if( sscanf( val.c_str(), "%d,%d,%d", &opt.decodeThreads, &opt.segmentThreads, &opt.encodeThreads ) != 3 )
+                    {
+                        log( "Thread counts expected as D,S,E: " + val, true );
+                        return false;
+                    }
+                    break;
+                default:
+                    log( "Unknown option " + arg, true );
+                    return false;
+            }
+            continue;
+        }
+
+        if( isDirectory( arg ) )
+            listDirectory( arg, paths );
+        else
+            paths.push_back( arg );
+    }
+
+    if( opt.algorithm != "srm" && opt.algorithm != "egbs" )
+    {
+        log( "Unknown algorithm " + opt.algorithm, true );
+        return false;
+    }
+
+    if( opt.smoothType == SMOOTH_GAUSSIAN && !( opt.sigma > 0.0f ) )
+    {
+        log( "Gaussian smoothing needs a sigma > 0", true );
+        return false;
+    }
+
+    // a capacity < 1 would wrap around to an unbounded queue
+    opt.queueSize = max( 1, opt.queueSize );
+    opt.decodeThreads = max( 1, opt.decodeThreads );
+    opt.segmentThreads = max( 1, opt.segmentThreads );
+    opt.encodeThreads = max( 1, opt.encodeThreads );
+    return !paths.empty();
+}
+
+/// decode stage: read the images in `paths`, shared index
+static void decodeStage( const vector<string>& paths, atomic<int>& next, BoundedQueue<Job*>& out )
+{
+    int i;
+    while( ( i = next++ ) < (int)paths.size() )
+    {
+        Job* job = new Job;
+        job->path = paths[i];
+        job->name = stem( paths[i] );
+        job->numRegions = 0;
+        job->image = imread( paths[i] );
+        if( job->image.empty() )
+            job->error = "could not read the image";
+        out.push( job );
+    }
+    out.producerDone();
+}
 
-    //medianBlur(img, img, 3);
-    medianBlur(img, img, 3);
+/// segment stage: one segmenter per thread, reused (reallocated only on size change)
+static void segmentStage( const Options& opt, BoundedQueue<Job*>& in, BoundedQueue<Job*>& out, PerfProfiler* total )
+{
+    SRMSeg* srm = 0;
+    GreedyGraphSeg* egbs = 0;
+
+    // counters are per thread
+    PerfProfiler* profiler = opt.profile ? new PerfProfiler() : 0;
+
+    Job* job;
+    while( in.pop( job ) )
+    {
+        if( job->error.empty() )
+        {
+            try
+            {
+                Mat& img = job->image;
+                if( opt.algorithm == "srm" )
+                {
+                    if( !srm )
+                        srm = new SRMSeg( img.cols, img.rows );
+                    srm->setProfiler( profiler );
+                    srm->setNodeOrder( opt.nodeOrder, opt.orderTile );
+                    srm->setFixedPoint( opt.fixedPoint );
+
+                    // SRM has no fused smoothing
+                    Mat smoothed = img;
+                    if( opt.smoothType == SMOOTH_MEDIAN3 )
+                        medianBlur( img, smoothed, 3 );
+                    else if( opt.smoothType == SMOOTH_GAUSSIAN )
+                        GaussianBlur( img, smoothed, Size(0,0), opt.sigma );
+
+                    if( opt.targetRegions > 0 )
+                        srm->segmentToCount( smoothed, opt.targetRegions, opt.Q, (float)opt.minSize );
+                    else
+                        srm->segment( smoothed, opt.Q, (float)opt.minSize );
+                    job->numRegions = srm->getNumComps();
+                    srm->getLabelsInt( job->labels );
+                    if( opt.outputs & OUT_BOUNDARIES )
+                    {
+                        job->boundaries = img.clone();
+                        srm->drawSegmentBoundaries( job->boundaries );
+                    }
+                    if( opt.outputs & OUT_MEANS )
+                        srm->renderMeans( job->means );
+                }
+                else
+                {
+                    if( !egbs )
+                        egbs = new GreedyGraphSeg( img.cols, img.rows, opt.threshold, opt.minSize, opt.connect );
+                    egbs->setSmoothing( opt.smoothType, opt.sigma );
+                    egbs->setProfiler( profiler );
+                    egbs->setNodeOrder( opt.nodeOrder, opt.orderTile );
+
+                    if( opt.targetRegions > 0 )
+                        egbs->segmentToCount( img, opt.targetRegions );
+                    else
+                        egbs->segmentImageColor( img );
+                    job->numRegions = egbs->getNumComps();
+                    egbs->getLabelsInt( job->labels );
+                    if( opt.outputs & OUT_BOUNDARIES )
+                    {
+                        job->boundaries = img.clone();
+                        egbs->drawSegmentBoundaries( job->boundaries );
+                    }
+                    if( opt.outputs & OUT_MEANS )
+                        egbs->renderMeans( img, job->means );
+                }
+            }
+            catch( const char* e )
+            {
+                job->error = e;
+            }
+            catch( const std::exception& e )
+            {
+                job->error = e.what();
+            }
+            catch( ... )
+            {
+                job->error = "unknown error";
+            }
+
+            // the state of a segmenter that threw is not reused
+            if( !job->error.empty() )
+            {
+                delete srm;
+                delete egbs;
+                srm = 0;
+                egbs = 0;
+            }
+        }
+        out.push( job );
+    }
+    out.producerDone();
+
+    delete srm;
+    delete egbs;
+
+    if( profiler )
+    {
+        lock_guard<mutex> lock( profileMutex );
+        total->add( *profiler );
+        delete profiler;
+    }
+}
+
+/// region table: label, size, bounding box, mean color
+static bool writeRegions( const string& file, const Mat& image, const Mat& labels, int numRegions )
+{
+    vector<int> size( numRegions, 0 );
+    vector<int> x0( numRegions, INT_MAX ), y0( numRegions, INT_MAX ), x1( numRegions, -1 ), y1( numRegions, -1 );
+    vector<double> sum( 3 * numRegions, 0.0 );
 
-    //namedWindow("image", CV_WINDOW_FREERATIO);
-    namedWindow("image", CV_WINDOW_KEEPRATIO);
-    imshow("image", img);
-
-    /*
-    GreedyGraphSeg gseg(img.cols, img.rows, 100, 10);
-    gseg.segmentImageColor(img);
-    gseg.drawSegmentBoundaries(img, Scalar(0,255,222));
-    cout << "Done! Number of components: " << gseg.getNumComps() << endl;
-    //Mat labels;
-    //gseg.getLabels(labels);
-    */
+    for ( int y = 0; y < labels.rows; y++ )
+    {
+        const int* lrow = labels.ptr<int>(y);
+        const Vec3b* irow = image.ptr<Vec3b>(y);
+        for ( int x = 0; x < labels.cols; x++ )
+        {
+            int l = lrow[x];
+            if( l < 0 || l >= numRegions )
+                continue;
+
+            size[l]++;
+            x0[l] = min( x0[l], x );
+            y0[l] = min( y0[l], y );
+            x1[l] = max( x1[l], x );
+            y1[l] = max( y1[l], y );
+            for ( int c = 0; c < 3; c++ )
+                sum[3 * l + c] += irow[x][c];
+        }
+    }
 
+    FILE* f = fopen( file.c_str(), "w" );
+    if( !f )
+        return false;
+
+    fprintf( f, "label,size,x,y,width,height,mean0,mean1,mean2\n" );
+    for ( int l = 0; l < numRegions; l++ )
+    {
+        if( !size[l] )
+            continue;
+        fprintf( f, "%d,%d,%d,%d,%d,%d,%.2f,%.2f,%.2f\n", l, size[l], x0[l], y0[l],
+                 x1[l] - x0[l] + 1, y1[l] - y0[l] + 1,
+                 sum[3*l] / size[l], sum[3*l+1] / size[l], sum[3*l+2] / size[l] );
+    }
+    return fclose( f ) == 0;
+}
+
+/// compressed label runs of a dense label map
+static bool writeRuns( const string& file, const Mat& labels )
+{
+    LabelRuns runs;
+    runs.create( labels.cols, labels.rows );
+    for ( int y = 0; y < labels.rows; y++ )
+    {
+        const int* lrow = labels.ptr<int>(y);
+        int x0 = 0;
+        for ( int x = 1; x <= labels.cols; x++ )
+        {
+            if( x < labels.cols && lrow[x] == lrow[x0] )
+                continue;
+            runs.addRun( x0, x - x0, lrow[x0] );
+            x0 = x;
+        }
+        runs.endRow();
+    }
+
+    vector<uchar> data;
+    runs.encode( data );
+
+    FILE* f = fopen( file.c_str(), "wb" );
+    if( !f )
+        return false;
+    bool ok = fwrite( &data[0], 1, data.size(), f ) == data.size();
+    return ( fclose( f ) == 0 ) && ok;
+}
+
+/// encode stage: write the outputs
+static void encodeStage( const Options& opt, BoundedQueue<Job*>& in, atomic<int>& failed )
+{
+    Job* job;
+    while( in.pop( job ) )
+    {
+        string base = opt.outDir + "/" + job->name;
+        bool ok = job->error.empty();
+
+        if( ok && ( opt.outputs & OUT_LABELS ) )
+        {
+            if( job->numRegions > 65535 )
+                job->error = "too many regions for a 16-bit label image, use -w runs";
+            else
+            {
+                // 16-bit labels, inactive pixels (-1) are 65535
+                Mat labels16( job->labels.rows, job->labels.cols, CV_16UC1 );
+                for ( int y = 0; y < labels16.rows; y++ )
+                {
+                    const int* lrow = job->labels.ptr<int>(y);
+                    ushort* orow = labels16.ptr<ushort>(y);
+                    for ( int x = 0; x < labels16.cols; x++ )
+                        orow[x] = ( lrow[x] < 0 ) ? 65535 : (ushort)lrow[x];
+                }
+                ok = imwrite( base + "_labels.png", labels16 );
+            }
+        }
 
-    SRMSeg srm(img.cols, img.rows);
-    srm.segment(img, 45, 10);
-    srm.drawSegmentBoundaries(img);
-    cout << "Done! Number of components: " << srm.getNumComps() << endl;
-    Mat labels;
-    srm.getLabels(labels);
+        if( ok && ( opt.outputs & OUT_BOUNDARIES ) )
+            ok = imwrite( base + "_boundaries.png", job->boundaries );
 
+        if( ok && ( opt.outputs & OUT_MEANS ) )
+            ok = imwrite( base + "_means.png", job->means );
+
+        if( ok && ( opt.outputs & OUT_REGIONS ) )
+            ok = writeRegions( base + "_regions.csv", job->image, job->labels, job->numRegions );
+
+        if( ok && ( opt.outputs & OUT_RUNS ) )
+            ok = writeRuns( base + ".lrl", job->labels );
+
+        if( ok && job->error.empty() )
+        {
+            char msg[32];
+            sprintf( msg, ": %d regions", job->numRegions );
+            log( job->path + msg );
+        }
+        else
+        {
+            log( job->path + ": " + ( job->error.empty() ? string("could not write the output") : job->error ), true );
+            failed++;
+        }
+
+        delete job;
+    }
+}
+
+int main(int argc, char** argv)
+{
+    Options opt;
+    vector<string> paths;
+    if( !parseOptions( argc, argv, opt, paths ) )
+    {
+        usage();
+        return 1;
+    }
+
+    chrono::steady_clock::time_point start = chrono::steady_clock::now();
 
-    namedWindow("Segmentation", CV_WINDOW_FREERATIO);
-    imshow("Segmentation", img);
-    waitKey();
+    BoundedQueue<Job*> decoded( opt.queueSize, opt.decodeThreads );
+    BoundedQueue<Job*> segmented( opt.queueSize, opt.segmentThreads );
+    atomic<int> next( 0 );
+    atomic<int> failed( 0 );
+    PerfProfiler* profile = opt.profile ? new PerfProfiler() : 0;
+
+    vector<thread> threads;
+    for ( int i = 0; i < opt.decodeThreads; i++ )
+        threads.push_back( thread( decodeStage, cref( paths ), ref( next ), ref( decoded ) ) );
+    for ( int i = 0; i < opt.segmentThreads; i++ )
+        threads.push_back( thread( segmentStage, cref( opt ), ref( decoded ), ref( segmented ), profile ) );
+    for ( int i = 0; i < opt.encodeThreads; i++ )
+        threads.push_back( thread( encodeStage, cref( opt ), ref( segmented ), ref( failed ) ) );
 
-    //imwrite("seg2400.png", img);
+    for ( size_t i = 0; i < threads.size(); i++ )
+        threads[i].join();
 
-    //imwrite("labels.png", labels);
-    //namedWindow("regions", CV_WINDOW_FREERATIO);
-    //imshow("regions", labels);
-    //waitKey();
+    double seconds = chrono::duration<double>( chrono::steady_clock::now() - start ).count();
+    cout << "Done! " << paths.size() << " images, " << failed << " failed, " << seconds << " s" << endl;
 
-    //Mat mask(src.rows, src.cols, CV_8U, Scalar(1));
+    if( profile )
+    {
+        profile->report( cout );
+        delete profile;
+    }
 
-    return 0;
+    return failed ? 2 : 0;
 }
@@ -0,0 +1,339 @@
+/***************************************************************
+ * Name:      segclient.cpp
+ * Purpose:   Test client of the local segmentation server
+ * Author:    segment-cpp contributors
+ * Created:   18.10.2026
+ * Copyright: segment-cpp contributors
+ * License:
+ **************************************************************/
+
+// Sends one image to segserver n times through a shared memory buffer (see
+// SegProtocol.h) and reports the request latencies (round trip and time in
+// the server). --check segments the image in this process too and compares
+// the labels and the region count with those of the server.
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include "opencv2/highgui/highgui.hpp"
+
+#include "GreedyGraphSeg.h"
+#include "SegProtocol.h"
+#include "SRMSeg.h"
+
+using namespace std;
+
+struct Options
+{
+    string socketPath;
+    string image;
+    int synthWidth, synthHeight;    // synthetic image if > 0
+    int algorithm;
+    float Q;
+    float threshold;
+    int minSize;
+    int connect;
+    int requests;
+    string labelsFile;
+    bool check;
+
+    Options() : socketPath(SEG_SOCKET_PATH), synthWidth(0), synthHeight(0), algorithm(SEG_SRM),
+                Q(40.0f), threshold(300.0f), minSize(100), connect(4), requests(100), check(false) {}
+};
+
+static void usage()
+{
+    cout <<
+    "usage: segclient [options] <image | WxH>\n"
+    "  WxH                synthetic image of this size\n"
+    "  -s path            server socket (" SEG_SOCKET_PATH ")\n"
+    "  -a srm|egbs        algorithm (srm)\n"
+    "  -q Q               SRM complexity (40)\n"
+    "  -k threshold       EGBS threshold (300)\n"
+    "  -m minsize         min region size in pixels (100)\n"
+    "  -c 4|8             EGBS connectivity (4)\n"
+    "  -n requests        number of requests (100)\n"
+    "  -o file            write the labels of the last request (16-bit png)\n"
+    "  --check            compare with a segmentation in this process\n";
+}
+
+static bool parseOptions( int argc, char** argv, Options& opt )
+{
+    for ( int i = 1; i < argc; i++ )
+    {
+        string arg = argv[i];
+        if( arg == "--check" )
+        {
+            opt.check = true;
+            continue;
+        }
+
+        if( arg.size() == 2 && arg[0] == '-' )
+        {
+            if( i + 1 >= argc )
+                return false;
+
+            string val = argv[++i];
+            switch( arg[1] )
+            {
+                case 's': opt.socketPath = val; break;
+                case 'a': opt.algorithm = ( val == "egbs" ) ? SEG_EGBS : SEG_SRM; break;
+                case 'q': opt.Q = (float)atof( val.c_str() ); break;
+                case 'k': opt.threshold = (float)atof( val.c_str() ); break;
+                case 'm': opt.minSize = atoi( val.c_str() ); break;
+                case 'c': opt.connect = atoi( val.c_str() ); break;
+                case 'n': opt.requests = max( 1, atoi( val.c_str() ) ); break;
+                case 'o': opt.labelsFile = val; break;
+                default:  return false;
+            }
+            continue;
+        }
+
+        if( sscanf( arg.c_str(), "%dx%d", &opt.synthWidth, &opt.synthHeight ) != 2 )
+        {
+            opt.synthWidth = opt.synthHeight = 0;
+            opt.image = arg;
+        }
+    }
+    return !opt.image.empty() || ( opt.synthWidth > 0 && opt.synthHeight > 0 );
+}
+
+/// blocks of colors with noise
+static Mat synthetic( int width, int height )
+{
+    Mat img( height, width, CV_8UC3 );
+    srand( 1 );
+    for ( int y = 0; y < height; y++ )
+    {
+        Vec3b* row = img.ptr<Vec3b>(y);
+        for ( int x = 0; x < width; x++ )
+        {
+            int v = ( ( x / 64 + y / 48 ) % 5 ) * 50;
+            row[x] = Vec3b( (uchar)( v + rand() % 8 ), (uchar)( 255 - v ), (uchar)( ( v * 3 ) % 256 ) );
+        }
+    }
+    return img;
+}
+
+/// shared memory of `size` bytes, sealed against shrinking (the server requires it); -1 on error
+static int createBuffer( size_t size, uchar*& data )
+{
+    int fd = memfd_create( "segclient", MFD_CLOEXEC | MFD_ALLOW_SEALING );
+    if( fd < 0 )
+        return -1;
+
+    void* p = MAP_FAILED;
+    if( ftruncate( fd, (off_t)size ) == 0 && fcntl( fd, F_ADD_SEALS, F_SEAL_SHRINK | F_SEAL_SEAL ) == 0 )
+        p = mmap( 0, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0 );
+    if( p == MAP_FAILED )
+    {
+        close( fd );
+        return -1;
+    }
+    data = (uchar*)p;
+    return fd;
+}
+
+/// send the request, with the descriptor fd if >= 0
+static bool sendRequest( int sock, const SegRequest& req, int fd )
+{
+    struct iovec iov;
+    iov.iov_base = (void*)&req;
+    iov.iov_len = sizeof(req);
+
+    union
+    {
+        struct cmsghdr align;
+        char buf[ CMSG_SPACE( sizeof(int) ) ];
+    } control;
+
+    struct msghdr msg;
+    memset( &msg, 0, sizeof(msg) );
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    if( fd >= 0 )
+    {
+        msg.msg_control = control.buf;
+        msg.msg_controllen = sizeof(control.buf);
+        struct cmsghdr* cmsg = CMSG_FIRSTHDR( &msg );
+        cmsg->cmsg_level = SOL_SOCKET;
+        cmsg->cmsg_type = SCM_RIGHTS;
+        cmsg->cmsg_len = CMSG_LEN( sizeof(int) );
+        memcpy( CMSG_DATA( cmsg ), &fd, sizeof(int) );
+    }
+
+    return sendmsg( sock, &msg, MSG_NOSIGNAL ) == (ssize_t)sizeof(req);
+}
+
+/// labels of the same segmentation in this process
+static int segmentLocal( const Options& opt, const Mat& image, Mat& labels )
+{
+    if( opt.algorithm == SEG_SRM )
+    {
+        SRMSeg seg( image.cols, image.rows );
+        seg.segment( image, opt.Q, (float)opt.minSize );
+        seg.getLabelsInt( labels );
+        return seg.getNumComps();
+    }
+
+    GreedyGraphSeg seg( image.cols, image.rows, opt.threshold, opt.minSize, opt.connect );
+    seg.segmentImageColor( image );
+    seg.getLabelsInt( labels );
+    return seg.getNumComps();
+}
+
+static double percentile( vector<double> v, double p )
+{
+    sort( v.begin(), v.end() );
+    size_t i = (size_t)( p * ( v.size() - 1 ) + 0.5 );
+    return v[i];
+}
+
+int main( int argc, char** argv )
+{
+    Options opt;
+    if( !parseOptions( argc, argv, opt ) )
+    {
+        usage();
+        return 1;
+    }
+
+    Mat image = opt.image.empty() ? synthetic( opt.synthWidth, opt.synthHeight ) : imread( opt.image );
+    if( image.empty() || image.depth() != CV_8U )
+    {
+        cerr << "Cannot read an 8-bit image: " << opt.image << endl;
+        return 1;
+    }
+
+    // buffer: image rows, labels, region table
+    int w = image.cols, h = image.rows;
+    size_t rowBytes = (size_t)w * image.channels();
+    size_t stride = ( rowBytes + 63 ) & ~(size_t)63;
+    int maxRegions = min( w * h, 1 << 16 );
+
+    SegRequest req;
+    memset( &req, 0, sizeof(req) );
+    req.magic = SEG_PROTOCOL_MAGIC;
+    req.algorithm = opt.algorithm;
+    req.param = ( opt.algorithm == SEG_SRM ) ? opt.Q : opt.threshold;
+    req.minSize = opt.minSize;
+    req.connect = opt.connect;
+    req.width = w;
+    req.height = h;
+    req.layout = ( image.channels() == 1 ) ? LAYOUT_GRAY : ( image.channels() == 4 ) ? LAYOUT_BGRA : LAYOUT_BGR;
+    req.stride = (long long)stride;
+    req.outputs = SEG_OUT_LABELS | SEG_OUT_REGIONS;
+    req.imageOffset = 0;
+    req.labelsOffset = (long long)( stride * h );
+    req.regionsOffset = req.labelsOffset + (long long)w * h * sizeof(int);
+    req.maxRegions = maxRegions;
+    req.bufferSize = req.regionsOffset + (long long)maxRegions * sizeof(SegRegion);
+
+    uchar* data = 0;
+    int fd = createBuffer( (size_t)req.bufferSize, data );
+    if( fd < 0 )
+    {
+        cerr << "Cannot create the shared memory buffer" << endl;
+        return 1;
+    }
+    for ( int y = 0; y < h; y++ )
+        memcpy( data + y * stride, image.ptr(y), rowBytes );
+
+    int sock = socket( AF_UNIX, SOCK_SEQPACKET, 0 );
+    struct sockaddr_un addr;
+    memset( &addr, 0, sizeof(addr) );
+    addr.sun_family = AF_UNIX;
+    strncpy( addr.sun_path, opt.socketPath.c_str(), sizeof(addr.sun_path) - 1 );
+    if( sock < 0 || connect( sock, (struct sockaddr*)&addr, sizeof(addr) ) < 0 )
+    {
+        cerr << "Cannot connect to " << opt.socketPath << endl;
+        return 1;
+    }
+
+    vector<double> roundTrip, server;
+    SegReply reply;
+    int cold = 0;
+    for ( int i = 0; i < opt.requests; i++ )
+    {
+        req.newBuffer = ( i == 0 ) ? 1 : 0;
+
+        chrono::steady_clock::time_point start = chrono::steady_clock::now();
+        if( !sendRequest( sock, req, ( i == 0 ) ? fd : -1 ) ||
+            recv( sock, &reply, sizeof(reply), 0 ) != (ssize_t)sizeof(reply) )
+        {
+            cerr << "Connection to the server lost" << endl;
+            return 1;
+        }
+        roundTrip.push_back( chrono::duration<double>( chrono::steady_clock::now() - start ).count() );
+        server.push_back( reply.seconds );
+
+        if( reply.status != SEG_OK )
+        {
+            cerr << "Request failed: " << reply.error << endl;
+            return 1;
+        }
+        if( !reply.warm )
+            cold++;
+    }
+
+    printf( "%dx%d, %d requests, %d regions (%d in the table), %d cold\n", w, h, opt.requests,
+            reply.numRegions, reply.regionsWritten, cold );
+    printf( "round trip ms: first %.2f  p50 %.2f  p99 %.2f  max %.2f\n", roundTrip[0] * 1e3,
+            percentile( roundTrip, 0.5 ) * 1e3, percentile( roundTrip, 0.99 ) * 1e3,
+            *max_element( roundTrip.begin(), roundTrip.end() ) * 1e3 );
+    printf( "server ms:     first %.2f  p50 %.2f  p99 %.2f\n", server[0] * 1e3,
+            percentile( server, 0.5 ) * 1e3, percentile( server, 0.99 ) * 1e3 );
+
+    // the labels in the buffer, no copy
+    Mat labels( h, w, CV_32SC1, data + req.labelsOffset );
+
+    int status = 0;
+    if( opt.check )
+    {
+        Mat local;
+        int numLocal = segmentLocal( opt, image, local );
+        int diff = 0;
+        for ( int y = 0; y < h; y++ )
+            for ( int x = 0; x < w; x++ )
+                if( local.at<int>(y, x) != labels.at<int>(y, x) )
+                    diff++;
+
+        const SegRegion* regions = (const SegRegion*)( data + req.regionsOffset );
+        long long covered = 0;
+        for ( int l = 0; l < reply.regionsWritten; l++ )
+            covered += regions[l].size;
+
+        bool ok = ( diff == 0 && numLocal == reply.numRegions &&
+                    ( reply.regionsWritten < reply.numRegions || covered == (long long)w * h ) );
+        printf( "check: %d local regions, %d labels differ, region table %s\n", numLocal, diff,
+                ok ? "consistent" : "inconsistent" );
+        status = ok ? 0 : 2;
+    }
+
+    if( !opt.labelsFile.empty() )
+    {
+        Mat labels16( h, w, CV_16UC1 );
+        for ( int y = 0; y < h; y++ )
+            for ( int x = 0; x < w; x++ )
+                labels16.at<ushort>(y, x) = (ushort)std::min( labels.at<int>(y, x), 65535 );
+        if( !imwrite( opt.labelsFile, labels16 ) )
+            cerr << "Cannot write " << opt.labelsFile << endl;
+    }
+
+    close( sock );
+    munmap( data, (size_t)req.bufferSize );
+    close( fd );
+    return status;
+}
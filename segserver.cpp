@@ -0,0 +1,673 @@
+/***************************************************************
+ * Name:      segserver.cpp
+ * Purpose:   Local segmentation server, shared memory images, warm workspaces
+ * Author:    segment-cpp contributors
+ * Created:   18.10.2026
+ * Copyright: segment-cpp contributors
+ * License:
+ **************************************************************/
+
+// A long running process that segments frames for local clients (see
+// SegProtocol.h): the frames and the results stay in shared memory buffers of
+// the clients, only the small request and reply messages go over the socket.
+// The segmenters are kept in pools by image size and reused, so a request
+// does not pay for the allocation of its workspace (edges, DSF, means) unless
+// it is the first of its size; sizes given with -w are allocated and touched
+// at the start. One thread per client connection, requests of a connection in
+// order.
+
+#include <algorithm>
+#include <chrono>
+#include <climits>
+#include <csignal>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <exception>
+#include <iostream>
+#include <map>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include "GreedyGraphSeg.h"
+#include "ImageView.h"
+#include "SegProtocol.h"
+#include "SRMSeg.h"
+
+using namespace std;
+
+/// segmenters warmed at the start
+struct WarmSpec
+{
+    int algorithm;
+    int width;
+    int height;
+    int count;
+};
+
+struct Options
+{
+    string socketPath;
+    int maxIdle;            // idle segmenters kept per size
+    int connect;            // EGBS connectivity of the warmed segmenters
+    vector<WarmSpec> warm;
+
+    Options() : socketPath(SEG_SOCKET_PATH), maxIdle(2), connect(4) {}
+};
+
+static mutex logMutex;
+
+static void log( const string& msg, bool error = false )
+{
+    lock_guard<mutex> lock( logMutex );
+    ( error ? cerr : cout ) << msg << endl;
+}
+
+/// new segmenter of the pool (EGBS parameters are set per request)
+static void createSegmenter( SRMSeg*& seg, int width, int height, int )
+{
+    seg = new SRMSeg( width, height );
+}
+
+static void createSegmenter( GreedyGraphSeg*& seg, int width, int height, int connect )
+{
+    seg = new GreedyGraphSeg( width, height, 300, 100, connect );
+}
+
+/**
+ * Idle segmenters of one type by size (and connectivity: the EGBS edge storage
+ * depends on it). acquire() takes an idle one or creates one, release() keeps
+ * up to the capacity of its size (maxIdle, or the number warmed), deletes the rest.
+ */
+template< typename Seg >
+class WorkspacePool
+{
+public:
+
+    WorkspacePool( int maxIdle ) : maxIdle(maxIdle) {}
+
+    ~WorkspacePool()
+    {
+        typename map< Key, vector<Seg*> >::iterator it;
+        for ( it = idle.begin(); it != idle.end(); ++it )
+            for ( size_t i = 0; i < it->second.size(); i++ )
+                delete it->second[i];
+    }
+
+    /// an idle segmenter of this size (warm = true) or a new one; throws if it cannot be allocated
+    Seg* acquire( int width, int height, int connect, bool& warm )
+    {
+        {
+            lock_guard<mutex> lock( this->poolMutex );
+            vector<Seg*>& segs = idle[ Key( width, height, connect ) ];
+            if( !segs.empty() )
+            {
+                Seg* seg = segs.back();
+                segs.pop_back();
+                warm = true;
+                return seg;
+            }
+        }
+
+        warm = false;
+        Seg* seg = 0;
+        createSegmenter( seg, width, height, connect );
+        return seg;
+    }
+
+    /// back to the pool, or deleted if the pool of its size is full
+    void release( Seg* seg, int width, int height, int connect )
+    {
+        {
+            lock_guard<mutex> lock( this->poolMutex );
+            Key key( width, height, connect );
+            vector<Seg*>& segs = idle[key];
+            size_t cap = max( (size_t)maxIdle, capacity[key] );
+            if( segs.size() < cap )
+            {
+                segs.push_back( seg );
+                return;
+            }
+        }
+        delete seg;
+    }
+
+    /// keep at least n idle segmenters of this size
+    void reserve( int width, int height, int connect, size_t n )
+    {
+        lock_guard<mutex> lock( this->poolMutex );
+        size_t& cap = capacity[ Key( width, height, connect ) ];
+        cap = max( cap, n );
+    }
+
+private:
+
+    struct Key
+    {
+        int width, height, connect;
+
+        Key( int width, int height, int connect ) : width(width), height(height), connect(connect) {}
+
+        bool operator<( const Key& k ) const
+        {
+            if( width != k.width )
+                return width < k.width;
+            if( height != k.height )
+                return height < k.height;
+            return connect < k.connect;
+        }
+    };
+
+    int maxIdle;
+    map< Key, vector<Seg*> > idle;
+    map< Key, size_t > capacity;
+    mutex poolMutex;
+};
+
+struct Pools
+{
+    WorkspacePool<SRMSeg> srm;
+    WorkspacePool<GreedyGraphSeg> egbs;
+
+    Pools( int maxIdle ) : srm(maxIdle), egbs(maxIdle) {}
+};
+
+/// shared memory buffer of a client, mapped
+struct Buffer
+{
+    uchar* data;
+    long long size;
+
+    Buffer() : data(0), size(0) {}
+
+    /// map `size` bytes of the file, empty message if mapped; the file must be at least
+    /// that long and sealed against shrinking (a later truncation would raise SIGBUS here)
+    const char* map( int fd, long long size )
+    {
+        this->unmap();
+
+        struct stat st;
+        if( size <= 0 || fstat( fd, &st ) < 0 || size > (long long)st.st_size )
+            return "buffer size larger than the file";
+
+        int seals = fcntl( fd, F_GET_SEALS );
+        if( seals < 0 || !( seals & F_SEAL_SHRINK ) )
+            return "buffer not sealed against shrinking (memfd with F_SEAL_SHRINK expected)";
+
+        void* p = mmap( 0, (size_t)size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0 );
+        if( p == MAP_FAILED )
+            return "cannot map the buffer";
+        this->data = (uchar*)p;
+        this->size = size;
+        return "";
+    }
+
+    void unmap()
+    {
+        if( data )
+            munmap( data, (size_t)size );
+        data = 0;
+        size = 0;
+    }
+
+    /// true if [offset, offset + bytes) is inside the buffer
+    bool contains( long long offset, long long bytes ) const
+    {
+        return offset >= 0 && bytes >= 0 && offset <= size && bytes <= size - offset;
+    }
+};
+
+/// per connection scratch memory, reused over the requests
+struct Scratch
+{
+    Mat labels;
+    vector<long long> sums;
+    vector<int> boxes;
+};
+
+/**
+ * region table from the labels: size, bounding box and mean color of each label,
+ * the first maxRegions labels; returns the number of entries written
+ */
+static int writeRegionTable( const ImageView& image, const Mat& labels, int numRegions,
+                             SegRegion* regions, int maxRegions, Scratch& scratch )
+{
+    int n = min( numRegions, maxRegions );
+    int ch = image.channels();
+    int sc = min( ch, 3 );
+
+    scratch.sums.assign( 3 * (size_t)n, 0 );
+    scratch.boxes.resize( 4 * (size_t)n );
+    for ( int l = 0; l < n; l++ )
+    {
+        regions[l].label = l;
+        regions[l].size = 0;
+        scratch.boxes[4*l] = INT_MAX;
+        scratch.boxes[4*l+1] = INT_MAX;
+        scratch.boxes[4*l+2] = -1;
+        scratch.boxes[4*l+3] = -1;
+    }
+
+    for ( int y = 0; y < labels.rows; y++ )
+    {
+        const int* lrow = labels.ptr<int>(y);
+        const uchar* irow = image.ptr<uchar>(y);
+        for ( int x = 0; x < labels.cols; x++ )
+        {
+            int l = lrow[x];
+            if( l < 0 || l >= n )
+                continue;
+
+            regions[l].size++;
+            int* box = &scratch.boxes[4*l];
+            box[0] = min( box[0], x );
+            box[1] = min( box[1], y );
+            box[2] = max( box[2], x );
+            box[3] = max( box[3], y );
+            for ( int c = 0; c < sc; c++ )
+                scratch.sums[3*l + c] += irow[ x * ch + c ];
+        }
+    }
+
+    for ( int l = 0; l < n; l++ )
+    {
+        SegRegion& r = regions[l];
+        const int* box = &scratch.boxes[4*l];
+        r.x0 = box[0];
+        r.y0 = box[1];
+        r.x1 = box[2];
+        r.y1 = box[3];
+        for ( int c = 0; c < 3; c++ )
+            r.mean[c] = ( r.size && c < sc ) ? (float)scratch.sums[3*l + c] / r.size : 0.0f;
+    }
+    return n;
+}
+
+static void fail( SegReply& reply, int status, const char* msg )
+{
+    reply.status = status;
+    strncpy( reply.error, msg, sizeof(reply.error) - 1 );
+    reply.error[ sizeof(reply.error) - 1 ] = 0;
+}
+
+/// check the request against the buffer, empty message if valid
+static const char* checkRequest( const SegRequest& req, const Buffer& buf )
+{
+    if( req.magic != SEG_PROTOCOL_MAGIC )
+        return "bad magic";
+    if( !buf.data )
+        return "no buffer, send the descriptor with newBuffer = 1";
+    if( req.algorithm != SEG_SRM && req.algorithm != SEG_EGBS )
+        return "unknown algorithm";
+    if( req.width < 1 || req.height < 1 || req.width > 65536 || req.height > 65536 )
+        return "illegal image size";
+    if( req.layout < LAYOUT_GRAY || req.layout > LAYOUT_RGBA )
+        return "unknown pixel layout";
+
+    // stride from the client: bounded before the multiplication
+    long long rowBytes = (long long)req.width * layoutChannels( req.layout );
+    if( req.stride < rowBytes )
+        return "stride less than a row";
+    if( req.stride > buf.size || ( req.height > 1 && req.stride > buf.size / ( req.height - 1 ) ) )
+        return "image outside the buffer";
+    if( !buf.contains( req.imageOffset, req.stride * ( req.height - 1 ) + rowBytes ) )
+        return "image outside the buffer";
+
+    long long pixels = (long long)req.width * req.height;
+    if( ( req.outputs & SEG_OUT_LABELS ) &&
+        ( req.labelsOffset % 4 || !buf.contains( req.labelsOffset, pixels * (long long)sizeof(int) ) ) )
+        return "labels outside the buffer or not aligned";
+    if( ( req.outputs & SEG_OUT_REGIONS ) &&
+        ( req.regionsOffset % 4 || req.maxRegions < 0 ||
+          !buf.contains( req.regionsOffset, req.maxRegions * (long long)sizeof(SegRegion) ) ) )
+        return "region table outside the buffer or not aligned";
+
+    return "";
+}
+
+static void runSegmenter( SRMSeg* seg, const SegRequest& req, const ImageView& image )
+{
+    seg->segment( image, req.param, (float)req.minSize );
+}
+
+static void runSegmenter( GreedyGraphSeg* seg, const SegRequest& req, const ImageView& image )
+{
+    seg->setParameters( req.minSize, req.param, req.connect );
+    seg->segmentImageColor( image );
+}
+
+/// segment one frame with a pooled segmenter, outputs into the buffer
+template< typename Seg >
+static void segmentRequest( const SegRequest& req, const ImageView& image, Buffer& buf,
+                            WorkspacePool<Seg>& pool, Scratch& scratch, SegReply& reply )
+{
+    int connect = ( req.algorithm == SEG_EGBS && req.connect == 8 ) ? 8 : 4;
+    bool warm = false;
+    Seg* seg = 0;
+    try
+    {
+        seg = pool.acquire( req.width, req.height, connect, warm );
+        runSegmenter( seg, req, image );
+        reply.numRegions = seg->getNumComps();
+
+        // labels in place: getLabelsInt does not reallocate a CV_32SC1 matrix of the image size
+        Mat labels;
+        if( req.outputs & SEG_OUT_LABELS )
+            labels = Mat( req.height, req.width, CV_32SC1, buf.data + req.labelsOffset );
+        else if( req.outputs & SEG_OUT_REGIONS )
+            labels = scratch.labels;
+
+        if( req.outputs & ( SEG_OUT_LABELS | SEG_OUT_REGIONS ) )
+        {
+            seg->getLabelsInt( labels );
+            if( !( req.outputs & SEG_OUT_LABELS ) )
+                scratch.labels = labels;
+        }
+
+        if( req.outputs & SEG_OUT_REGIONS )
+            reply.regionsWritten = writeRegionTable( image, labels, reply.numRegions,
+                                                     (SegRegion*)( buf.data + req.regionsOffset ),
+                                                     req.maxRegions, scratch );
+    }
+    catch( const char* msg )
+    {
+        fail( reply, SEG_FAILED, msg );
+    }
+    catch( const std::exception& e )
+    {
+        fail( reply, SEG_FAILED, e.what() );
+    }
+    catch( ... )
+    {
+        fail( reply, SEG_FAILED, "unknown error" );
+    }
+
+    if( reply.status != SEG_OK )
+    {
+        // the state of a segmenter that threw is not reused
+        delete seg;
+        return;
+    }
+
+    reply.warm = warm ? 1 : 0;
+    pool.release( seg, req.width, req.height, connect );
+}
+
+/// receive one request and the descriptor sent with it (-1 if none); false at the end of the connection
+static bool receiveRequest( int sock, SegRequest& req, int& fd )
+{
+    fd = -1;
+
+    struct iovec iov;
+    iov.iov_base = &req;
+    iov.iov_len = sizeof(req);
+
+    union
+    {
+        struct cmsghdr align;
+        char buf[ CMSG_SPACE( sizeof(int) ) ];
+    } control;
+
+    struct msghdr msg;
+    memset( &msg, 0, sizeof(msg) );
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = control.buf;
+    msg.msg_controllen = sizeof(control.buf);
+
+    ssize_t n = recvmsg( sock, &msg, 0 );
+    if( n <= 0 )
+        return false;
+
+    struct cmsghdr* cmsg = CMSG_FIRSTHDR( &msg );
+    if( cmsg && cmsg->cmsg_level == SOL_SOCKET && cmsg->cmsg_type == SCM_RIGHTS )
+        memcpy( &fd, CMSG_DATA( cmsg ), sizeof(int) );
+
+    if( n != (ssize_t)sizeof(req) )
+        req.magic = 0;      // rejected by checkRequest
+    return true;
+}
+
+/// requests of one client, in order, until it disconnects
+static void serveClient( int sock, Pools* pools )
+{
+    Buffer buf;
+    Scratch scratch;
+
+    SegRequest req;
+    int fd;
+    while( receiveRequest( sock, req, fd ) )
+    {
+        chrono::steady_clock::time_point start = chrono::steady_clock::now();
+
+        SegReply reply;
+        memset( &reply, 0, sizeof(reply) );
+        reply.magic = SEG_PROTOCOL_MAGIC;
+
+        // a new buffer replaces the old one, also if it cannot be mapped
+        const char* error = "";
+        if( fd >= 0 )
+        {
+            if( req.newBuffer )
+                error = buf.map( fd, req.bufferSize );
+            else
+                buf.unmap();
+            close( fd );
+        }
+
+        if( !*error )
+            error = checkRequest( req, buf );
+        if( *error )
+            fail( reply, SEG_BAD_REQUEST, error );
+        else
+        {
+            ImageView image( buf.data + req.imageOffset, req.width, req.height, (size_t)req.stride, req.layout );
+            if( req.algorithm == SEG_SRM )
+                segmentRequest( req, image, buf, pools->srm, scratch, reply );
+            else
+                segmentRequest( req, image, buf, pools->egbs, scratch, reply );
+        }
+
+        reply.seconds = chrono::duration<double>( chrono::steady_clock::now() - start ).count();
+        if( send( sock, &reply, sizeof(reply), MSG_NOSIGNAL ) != (ssize_t)sizeof(reply) )
+            break;
+    }
+
+    buf.unmap();
+    close( sock );
+}
+
+/**
+ * allocate the warm segmenters and segment a blank frame with each,
+ * so their memory is mapped before the first request
+ */
+template< typename Seg >
+static void warmPool( WorkspacePool<Seg>& pool, const WarmSpec& spec, int connect )
+{
+    Mat blank( spec.height, spec.width, CV_8UC3, Scalar(0, 0, 0) );
+    SegRequest req;
+    memset( &req, 0, sizeof(req) );
+    req.param = ( spec.algorithm == SEG_SRM ) ? 40.0f : 300.0f;
+    req.minSize = 100;
+    req.connect = connect;
+
+    vector<Seg*> segs;
+    for ( int i = 0; i < spec.count; i++ )
+    {
+        bool warm;
+        Seg* seg = pool.acquire( spec.width, spec.height, connect, warm );
+        runSegmenter( seg, req, blank );
+        segs.push_back( seg );
+    }
+
+    pool.reserve( spec.width, spec.height, connect, segs.size() );
+    for ( size_t i = 0; i < segs.size(); i++ )
+        pool.release( segs[i], spec.width, spec.height, connect );
+}
+
+static void usage()
+{
+    cout <<
+    "usage: segserver [options]\n"
+    "  -s path            socket path (" SEG_SOCKET_PATH ")\n"
+    "  -w srm|egbs:WxH[:n]  keep n (1) warm segmenters of this size from the start, repeatable\n"
+    "  -c 4|8             EGBS connectivity of the warm segmenters (4)\n"
+    "  -p n               idle segmenters kept per size (2)\n";
+}
+
+static bool parseOptions( int argc, char** argv, Options& opt )
+{
+    for ( int i = 1; i < argc; i++ )
+    {
+        string arg = argv[i];
+        if( arg.size() != 2 || arg[0] != '-' || i + 1 >= argc )
+            return false;
+
+        string val = argv[++i];
+        switch( arg[1] )
+        {
+            case 's': opt.socketPath = val; break;
+            case 'c': opt.connect = ( atoi( val.c_str() ) == 8 ) ? 8 : 4; break;
+            case 'p': opt.maxIdle = max( 0, atoi( val.c_str() ) ); break;
+            case 'w':
+            {
+                WarmSpec spec;
+                char alg[8];
+                spec.count = 1;
+                if( sscanf( val.c_str(), "%7[a-z]:%dx%d:%d", alg, &spec.width, &spec.height, &spec.count ) < 3 ||
+                    spec.width < 1 || spec.height < 1 || spec.count < 1 )
+                {
+                    log( "Warm segmenters expected as srm|egbs:WxH[:n]: " + val, true );
+                    return false;
+                }
+                spec.algorithm = ( strcmp( alg, "egbs" ) == 0 ) ? SEG_EGBS : SEG_SRM;
+                opt.warm.push_back( spec );
+                break;
+            }
+            default:
+                return false;
+        }
+    }
+
+    if( opt.socketPath.size() >= sizeof( ((struct sockaddr_un*)0)->sun_path ) )
+    {
+        log( "Socket path too long: " + opt.socketPath, true );
+        return false;
+    }
+    return true;
+}
+
+/// socket path, removed on SIGINT/SIGTERM
+static char socketFile[108];
+
+static void onSignal( int )
+{
+    unlink( socketFile );
+    _exit( 0 );
+}
+
+int main( int argc, char** argv )
+{
+    Options opt;
+    if( !parseOptions( argc, argv, opt ) )
+    {
+        usage();
+        return 1;
+    }
+
+    Pools* pools = new Pools( opt.maxIdle );
+    try
+    {
+        for ( size_t i = 0; i < opt.warm.size(); i++ )
+        {
+            const WarmSpec& spec = opt.warm[i];
+            if( spec.algorithm == SEG_SRM )
+                warmPool( pools->srm, spec, 4 );
+            else
+                warmPool( pools->egbs, spec, opt.connect );
+
+            char msg[96];
+            sprintf( msg, "warm: %d %s segmenters of %dx%d", spec.count,
+                     spec.algorithm == SEG_SRM ? "srm" : "egbs", spec.width, spec.height );
+            log( msg );
+        }
+    }
+    catch( const char* e )
+    {
+        log( string( "Cannot warm the segmenters: " ) + e, true );
+        return 1;
+    }
+    catch( const std::exception& e )
+    {
+        log( string( "Cannot warm the segmenters: " ) + e.what(), true );
+        return 1;
+    }
+
+    int server = socket( AF_UNIX, SOCK_SEQPACKET, 0 );
+    if( server < 0 )
+    {
+        log( "Cannot create the socket", true );
+        return 1;
+    }
+
+    struct sockaddr_un addr;
+    memset( &addr, 0, sizeof(addr) );
+    addr.sun_family = AF_UNIX;
+    strcpy( addr.sun_path, opt.socketPath.c_str() );
+    strcpy( socketFile, opt.socketPath.c_str() );
+
+    // a socket left by a server that is gone is replaced, a live one or another file is not
+    struct stat st;
+    if( lstat( socketFile, &st ) == 0 )
+    {
+        int probe = socket( AF_UNIX, SOCK_SEQPACKET, 0 );
+        bool live = !S_ISSOCK( st.st_mode ) || connect( probe, (struct sockaddr*)&addr, sizeof(addr) ) == 0;
+        close( probe );
+        if( live )
+        {
+            log( opt.socketPath + " is in use (another server, or not a socket)", true );
+            return 1;
+        }
+        unlink( socketFile );
+    }
+
+    // local clients of this user only, from the creation of the socket file on
+    mode_t mask = umask( 0077 );
+    bool bound = bind( server, (struct sockaddr*)&addr, sizeof(addr) ) == 0;
+    umask( mask );
+    if( !bound || listen( server, 16 ) < 0 )
+    {
+        log( "Cannot listen on " + opt.socketPath, true );
+        return 1;
+    }
+
+    signal( SIGPIPE, SIG_IGN );
+    signal( SIGINT, onSignal );
+    signal( SIGTERM, onSignal );
+    log( "listening on " + opt.socketPath );
+
+    for ( ;; )
+    {
+        int client = accept( server, 0, 0 );
+        if( client < 0 )
+            continue;
+        try
+        {
+            thread( serveClient, client, pools ).detach();
+        }
+        catch( const std::exception& e )
+        {
+            log( string( "Cannot serve a client: " ) + e.what(), true );
+            close( client );
+        }
+    }
+}
@@ -0,0 +1,36 @@
+/***************************************************************
+ * Name:      segverify.cpp
+ * Purpose:   Test program: optimized segmentation paths against the reference
+ * Author:    segment-cpp contributors
+ * Created:   18.10.2026
+ * Copyright: segment-cpp contributors
+ * License:
+ **************************************************************/
+
+// Runs verifySegmenters (see SegReference.h) on n synthetic images and exits
+// with 1 if a check failed, 0 otherwise.
+
+#include <cstdlib>
+#include <iostream>
+
+#include "SegReference.h"
+
+using namespace std;
+
+int main( int argc, char** argv )
+{
+    int numRandom = 10;
+    unsigned int seed = 1;
+    if( argc >= 2 )
+        numRandom = atoi( argv[1] );
+    if( argc >= 3 )
+        seed = (unsigned int)strtoul( argv[2], 0, 10 );
+
+    if( argc > 3 || numRandom < 1 )
+    {
+        cerr << "usage: segverify [n [seed]]  (n >= 1 synthetic images, default 10, seed 1)" << endl;
+        return 2;
+    }
+
+    return verifySegmenters( cout, numRandom, seed ) ? 1 : 0;
+}